@@ -0,0 +1,154 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+/*
+ * Compares the mutex protected buffer of IQueue with the lock-free ring (startQueue() with "lockFree" set) for 1, 4 and 16
+ * producers.
+ *
+ * Usage: iQueue [entries per run] [processing threads] [buffer size] [runs]
+ *
+ * The producers enqueue the entries with "waitWhenFull" set, so no entry is dropped. A run ends when all entries are
+ * processed. The median of all runs is printed.
+ */
+
+#include "../src/BaseLib.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+using namespace BaseLib;
+
+namespace
+{
+
+class BenchmarkQueue : public IQueue
+{
+public:
+	BenchmarkQueue(SharedObjects* baseLib, uint32_t bufferSize) : IQueue(baseLib, 1, bufferSize) {}
+	virtual ~BenchmarkQueue() {}
+
+	std::atomic<int64_t> processed{0};
+
+	virtual void processQueueEntry(int32_t index, std::shared_ptr<IQueueEntry>& entry)
+	{
+		processed++;
+	}
+};
+
+/**
+ * @return Returns the time needed to enqueue and process all entries in microseconds.
+ */
+int64_t run(SharedObjects& bl, int32_t entries, int32_t producers, int32_t processingThreads, int32_t bufferSize, bool lockFree)
+{
+	BenchmarkQueue queue(&bl, bufferSize);
+	queue.startQueue(0, true, processingThreads, 0, SCHED_OTHER, lockFree);
+
+	//The entries are created before the time is taken, so only the queue is measured.
+	std::vector<std::vector<std::shared_ptr<IQueueEntry>>> producerEntries(producers);
+	for(int32_t i = 0; i < entries; i++)
+	{
+		producerEntries.at(i % producers).push_back(std::make_shared<IQueueEntry>());
+	}
+
+	int64_t startTime = HelperFunctions::getTimeMicroseconds();
+	std::vector<std::thread> producerThreads;
+	producerThreads.reserve(producers);
+	for(int32_t i = 0; i < producers; i++)
+	{
+		producerThreads.emplace_back([&queue, &producerEntries, i]()
+		{
+			for(auto& entry : producerEntries.at(i))
+			{
+				queue.enqueue(0, entry, true);
+			}
+		});
+	}
+	for(auto& thread : producerThreads)
+	{
+		thread.join();
+	}
+	while(queue.processed < entries) std::this_thread::yield();
+	int64_t time = HelperFunctions::getTimeMicroseconds() - startTime;
+
+	queue.stopQueue(0);
+	return time;
+}
+
+int64_t median(std::vector<int64_t> times)
+{
+	std::sort(times.begin(), times.end());
+	return times.at(times.size() / 2);
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	int32_t entries = argc > 1 ? std::atoi(argv[1]) : 400000;
+	int32_t processingThreads = argc > 2 ? std::atoi(argv[2]) : 4;
+	int32_t bufferSize = argc > 3 ? std::atoi(argv[3]) : 1000;
+	int32_t runs = argc > 4 ? std::atoi(argv[4]) : 5;
+	if(entries <= 0 || processingThreads <= 0 || bufferSize <= 0 || runs <= 0)
+	{
+		std::cerr << "Usage: " << argv[0] << " [entries per run] [processing threads] [buffer size] [runs]" << std::endl;
+		return 1;
+	}
+
+	try
+	{
+		SharedObjects bl;
+		std::cout << entries << " entries, " << processingThreads << " processing threads, buffer size " << bufferSize << ", " << std::thread::hardware_concurrency() << " CPUs, median of " << runs << " runs" << std::endl;
+		std::cout << "Producers   Mutex       Lock-free" << std::endl;
+		for(int32_t producers : { 1, 4, 16 })
+		{
+			std::vector<int64_t> mutexTimes;
+			std::vector<int64_t> lockFreeTimes;
+			for(int32_t i = 0; i < runs; i++)
+			{
+				mutexTimes.push_back(run(bl, entries, producers, processingThreads, bufferSize, false));
+				lockFreeTimes.push_back(run(bl, entries, producers, processingThreads, bufferSize, true));
+			}
+			std::cout << std::left << std::setw(12) << producers << std::setw(12) << (std::to_string(median(mutexTimes) / 1000) + " ms") << (median(lockFreeTimes) / 1000) << " ms" << std::endl;
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		std::cerr << "Error: " << ex.what() << std::endl;
+		return 1;
+	}
+	catch(const Exception& ex)
+	{
+		std::cerr << "Error: " << ex.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,292 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+/*
+ * Compares the select() and the io_uring code paths of TcpSocket::proofread()/proofwrite() and SerialReaderWriter::readChar()
+ * with request/response round trips over loopback TCP and a pseudo terminal.
+ *
+ * Usage: ioUring [round trips per run] [message size]
+ *
+ * An echo thread answers every message. For each round trip the latency and the number of system calls made by the measuring
+ * thread are printed. System calls of the select() path are counted by wrapping the libc functions used by the library.
+ * System calls of the io_uring path are counted by IoUring itself. SerialReaderWriter::writeData() always uses write(), so it
+ * adds one system call per message in both modes.
+ */
+
+#include "../src/BaseLib.h"
+#include "../src/Sockets/IoUring.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+#include <dlfcn.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+using namespace BaseLib;
+
+namespace
+{
+
+thread_local bool countSystemCalls = false;
+uint64_t systemCallCount = 0;
+
+template<typename Function> Function getNextFunction(const char* name)
+{
+	return reinterpret_cast<Function>(dlsym(RTLD_NEXT, name));
+}
+
+}
+
+// {{{ libc wrappers counting the system calls of the measuring thread
+extern "C"
+{
+
+int select(int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds, struct timeval* timeout)
+{
+	static auto nextFunction = getNextFunction<int(*)(int, fd_set*, fd_set*, fd_set*, struct timeval*)>("select");
+	if(countSystemCalls) systemCallCount++;
+	return nextFunction(nfds, readfds, writefds, exceptfds, timeout);
+}
+
+int poll(struct pollfd* fds, nfds_t nfds, int timeout)
+{
+	static auto nextFunction = getNextFunction<int(*)(struct pollfd*, nfds_t, int)>("poll");
+	if(countSystemCalls) systemCallCount++;
+	return nextFunction(fds, nfds, timeout);
+}
+
+ssize_t read(int fd, void* buf, size_t count)
+{
+	static auto nextFunction = getNextFunction<ssize_t(*)(int, void*, size_t)>("read");
+	if(countSystemCalls) systemCallCount++;
+	return nextFunction(fd, buf, count);
+}
+
+ssize_t write(int fd, const void* buf, size_t count)
+{
+	static auto nextFunction = getNextFunction<ssize_t(*)(int, const void*, size_t)>("write");
+	if(countSystemCalls) systemCallCount++;
+	return nextFunction(fd, buf, count);
+}
+
+ssize_t send(int sockfd, const void* buf, size_t len, int flags)
+{
+	static auto nextFunction = getNextFunction<ssize_t(*)(int, const void*, size_t, int)>("send");
+	if(countSystemCalls) systemCallCount++;
+	return nextFunction(sockfd, buf, len, flags);
+}
+
+ssize_t recv(int sockfd, void* buf, size_t len, int flags)
+{
+	static auto nextFunction = getNextFunction<ssize_t(*)(int, void*, size_t, int)>("recv");
+	if(countSystemCalls) systemCallCount++;
+	return nextFunction(sockfd, buf, len, flags);
+}
+
+}
+// }}}
+
+namespace
+{
+
+/**
+ * Loads a settings file with only "useIoUring" set.
+ */
+void setUseIoUring(SharedObjects& bl, bool useIoUring)
+{
+	std::string filename = "/tmp/ioUringBenchmark.conf";
+	{
+		std::ofstream settingsFile(filename);
+		settingsFile << "useIoUring = " << (useIoUring ? "true" : "false") << std::endl;
+	}
+	bl.settings.load(filename, "");
+	unlink(filename.c_str());
+}
+
+uint64_t getSystemCallCount(bool useIoUring)
+{
+	if(useIoUring) return IoUring::getThreadInstance()->getSystemCallCount();
+	return systemCallCount;
+}
+
+void printResult(const std::string& name, bool useIoUring, int32_t roundTrips, int64_t time, uint64_t systemCalls)
+{
+	std::cout << name << (useIoUring ? ", io_uring: " : ", select():  ") << (time * 1000 / roundTrips) << " ns/round trip, " << ((double)systemCalls / roundTrips) << " system calls/round trip" << std::endl;
+}
+
+/**
+ * Echoes everything until the peer closes the connection. Uses the libc functions directly, so nothing is counted.
+ */
+void echo(int32_t fileDescriptor)
+{
+	std::vector<char> buffer(4096);
+	while(true)
+	{
+		ssize_t bytesRead = ::read(fileDescriptor, buffer.data(), buffer.size());
+		if(bytesRead <= 0) return;
+		ssize_t bytesWritten = 0;
+		while(bytesWritten < bytesRead)
+		{
+			ssize_t result = ::write(fileDescriptor, buffer.data() + bytesWritten, bytesRead - bytesWritten);
+			if(result <= 0) return;
+			bytesWritten += result;
+		}
+	}
+}
+
+void benchmarkTcp(SharedObjects& bl, bool useIoUring, int32_t roundTrips, int32_t messageSize)
+{
+	setUseIoUring(bl, useIoUring);
+
+	int32_t listenDescriptor = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in address{};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addressLength = sizeof(address);
+	if(listenDescriptor == -1 || bind(listenDescriptor, (sockaddr*)&address, sizeof(address)) == -1 || listen(listenDescriptor, 1) == -1 || getsockname(listenDescriptor, (sockaddr*)&address, &addressLength) == -1)
+	{
+		throw Exception(std::string("Could not create listening socket: ") + strerror(errno));
+	}
+	std::thread echoThread([listenDescriptor]()
+	{
+		int32_t clientDescriptor = accept(listenDescriptor, nullptr, nullptr);
+		if(clientDescriptor == -1) return;
+		echo(clientDescriptor);
+		close(clientDescriptor);
+	});
+
+	TcpSocket socket(&bl, "127.0.0.1", std::to_string(ntohs(address.sin_port)));
+	socket.open();
+	std::vector<char> message(messageSize, 'x');
+	std::vector<char> buffer(messageSize);
+	//Warm up. This also creates the ring of this thread.
+	socket.proofwrite(message);
+	for(int32_t received = 0; received < messageSize;) received += socket.proofread(buffer.data() + received, messageSize - received);
+
+	uint64_t systemCalls = getSystemCallCount(useIoUring);
+	countSystemCalls = true;
+	int64_t startTime = HelperFunctions::getTimeMicroseconds();
+	for(int32_t i = 0; i < roundTrips; i++)
+	{
+		socket.proofwrite(message);
+		for(int32_t received = 0; received < messageSize;) received += socket.proofread(buffer.data() + received, messageSize - received);
+	}
+	int64_t time = HelperFunctions::getTimeMicroseconds() - startTime;
+	countSystemCalls = false;
+	systemCalls = getSystemCallCount(useIoUring) - systemCalls;
+
+	socket.close();
+	echoThread.join();
+	close(listenDescriptor);
+	printResult("TCP        ", useIoUring, roundTrips, time, systemCalls);
+}
+
+void benchmarkSerial(SharedObjects& bl, bool useIoUring, int32_t roundTrips, int32_t messageSize)
+{
+	setUseIoUring(bl, useIoUring);
+
+	int32_t masterDescriptor = posix_openpt(O_RDWR | O_NOCTTY);
+	if(masterDescriptor == -1 || grantpt(masterDescriptor) == -1 || unlockpt(masterDescriptor) == -1) throw Exception(std::string("Could not create pseudo terminal: ") + strerror(errno));
+	std::string slaveName = ptsname(masterDescriptor);
+	std::thread echoThread(echo, masterDescriptor);
+
+	SerialReaderWriter serial(&bl, slaveName, 115200, O_RDWR | O_NOCTTY, false, -1);
+	serial.openDevice(false, false, false);
+	std::vector<char> message(messageSize, 'x');
+	char data = 0;
+	//Warm up. This also creates the ring of this thread.
+	serial.writeData(message);
+	for(int32_t i = 0; i < messageSize; i++) serial.readChar(data, 1000000);
+
+	uint64_t systemCalls = getSystemCallCount(useIoUring);
+	countSystemCalls = true;
+	int64_t startTime = HelperFunctions::getTimeMicroseconds();
+	for(int32_t i = 0; i < roundTrips; i++)
+	{
+		serial.writeData(message);
+		for(int32_t j = 0; j < messageSize; j++)
+		{
+			if(serial.readChar(data, 1000000) != 0) throw Exception("Reading from pseudo terminal failed.");
+		}
+	}
+	int64_t time = HelperFunctions::getTimeMicroseconds() - startTime;
+	countSystemCalls = false;
+	systemCalls = getSystemCallCount(useIoUring) - systemCalls;
+	//writeData() doesn't go through io_uring.
+	if(useIoUring) systemCalls += roundTrips;
+
+	serial.closeDevice();
+	close(masterDescriptor);
+	echoThread.join();
+	printResult("Serial, pty", useIoUring, roundTrips, time, systemCalls);
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	int32_t roundTrips = argc > 1 ? std::atoi(argv[1]) : 20000;
+	int32_t messageSize = argc > 2 ? std::atoi(argv[2]) : 16;
+	if(roundTrips <= 0 || messageSize <= 0)
+	{
+		std::cerr << "Usage: " << argv[0] << " [round trips per run] [message size]" << std::endl;
+		return 1;
+	}
+	if(!IoUring::isAvailable())
+	{
+		std::cerr << "io_uring is not available on this system." << std::endl;
+		return 1;
+	}
+
+	try
+	{
+		SharedObjects bl;
+		std::cout << roundTrips << " round trips of " << messageSize << " bytes per run" << std::endl;
+		benchmarkTcp(bl, false, roundTrips, messageSize);
+		benchmarkTcp(bl, true, roundTrips, messageSize);
+		benchmarkSerial(bl, false, roundTrips, messageSize);
+		benchmarkSerial(bl, true, roundTrips, messageSize);
+	}
+	catch(const std::exception& ex)
+	{
+		std::cerr << "Error: " << ex.what() << std::endl;
+		return 1;
+	}
+	catch(const Exception& ex)
+	{
+		std::cerr << "Error: " << ex.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
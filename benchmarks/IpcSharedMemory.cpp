@@ -0,0 +1,314 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+/*
+ * Compares the socket with the shared memory transport of IIpcClient (see IIpcClient::setSharedMemoryTransport()).
+ *
+ * Usage: ipcSharedMemory [calls per run] [ring size]
+ *
+ * A forked stand-in server answers "echo" and implements "enableSharedMemoryTransport" with
+ * SharedMemoryTransport::receive() and SharedMemoryTransport::attach(). For both transports the latency of invoke() and the
+ * throughput of pipelined invokeAsync() calls (256 in flight) are printed.
+ */
+
+#include "../src/BaseLib.h"
+
+#include <cstdlib>
+#include <iostream>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+using namespace BaseLib;
+
+namespace
+{
+
+const std::string socketPath = "/tmp/ipcSharedMemoryBenchmark.sock";
+
+class BenchmarkClient : public Ipc::IIpcClient
+{
+public:
+	BenchmarkClient(SharedObjects* bl, std::string socketPath) : IIpcClient(bl, socketPath) {}
+	virtual ~BenchmarkClient() {}
+
+	bool connected() { return !_closed; }
+};
+
+// {{{ Stand-in server
+bool writeToSocket(int32_t fileDescriptor, const std::vector<char>& data)
+{
+	size_t totallySentBytes = 0;
+	while(totallySentBytes < data.size())
+	{
+		ssize_t sentBytes = ::send(fileDescriptor, data.data() + totallySentBytes, data.size() - totallySentBytes, MSG_NOSIGNAL);
+		if(sentBytes == -1 && errno == EINTR) continue;
+		if(sentBytes <= 0) return false;
+		totallySentBytes += sentBytes;
+	}
+	return true;
+}
+
+void serveClient(SharedObjects& bl, int32_t clientDescriptor)
+{
+	Rpc::BinaryRpc socketRpc(&bl);
+	Rpc::BinaryRpc ringRpc(&bl);
+	Rpc::RpcDecoder rpcDecoder(&bl, false, false);
+	Rpc::RpcEncoder rpcEncoder(&bl, true, true);
+	std::shared_ptr<Ipc::SharedMemoryTransport> transport;
+	std::vector<int32_t> receivedDescriptors;
+	std::vector<char> buffer(65536);
+
+	//Requests are arrays of thread ID, packet ID and parameters. Responses echo thread ID and packet ID.
+	auto processData = [&](Rpc::BinaryRpc& binaryRpc, char* data, int32_t size) -> bool
+	{
+		int32_t processedBytes = 0;
+		while(processedBytes < size)
+		{
+			processedBytes += binaryRpc.process(data + processedBytes, size - processedBytes);
+			if(!binaryRpc.isFinished()) continue;
+
+			std::string methodName;
+			PArray request = rpcDecoder.decodeRequest(binaryRpc.getData(), methodName);
+			binaryRpc.reset();
+			if(request->size() < 3) return false;
+			PArray& parameters = request->at(2)->arrayValue;
+
+			PVariable result;
+			bool enableTransport = false;
+			if(methodName == "echo" && !parameters->empty()) result = parameters->at(0);
+			else if(methodName == "enableSharedMemoryTransport" && !parameters->empty())
+			{
+				try
+				{
+					transport = Ipc::SharedMemoryTransport::attach(receivedDescriptors, parameters->at(0)->integerValue);
+					enableTransport = true;
+				}
+				catch(const Exception& ex)
+				{
+					std::cerr << "Server: " << ex.what() << std::endl;
+				}
+				receivedDescriptors.clear();
+				result = std::make_shared<Variable>(enableTransport);
+			}
+			else result = Variable::createError(-32601, "Requested method not found.");
+
+			std::vector<char> response;
+			rpcEncoder.encodeResponse(std::make_shared<Variable>(PArray(new Array{ request->at(0), request->at(1), result })), response);
+			//The answer to "enableSharedMemoryTransport" still uses the socket.
+			if(transport && !enableTransport)
+			{
+				if(!transport->sendRing().write(response.data(), response.size(), 10000)) return false;
+			}
+			else if(!writeToSocket(clientDescriptor, response)) return false;
+		}
+		return true;
+	};
+
+	while(true)
+	{
+		int32_t ringEventDescriptor = -1;
+		if(transport)
+		{
+			Ipc::SharedMemoryRing& receiveRing = transport->receiveRing();
+			uint32_t bytesRead = 0;
+			bool error = false;
+			while(!error && (bytesRead = receiveRing.read(buffer.data(), buffer.size())) > 0) error = !processData(ringRpc, buffer.data(), bytesRead);
+			if(error) break;
+			if(!receiveRing.prepareWait()) continue;
+			ringEventDescriptor = receiveRing.dataEventDescriptor();
+		}
+
+		pollfd pollInfo[2];
+		pollInfo[0].fd = clientDescriptor;
+		pollInfo[0].events = POLLIN;
+		pollInfo[0].revents = 0;
+		pollInfo[1].fd = ringEventDescriptor;
+		pollInfo[1].events = POLLIN;
+		pollInfo[1].revents = 0;
+		int32_t result = poll(pollInfo, ringEventDescriptor == -1 ? 1 : 2, 1000);
+		if(result == -1 && errno == EINTR) continue;
+		if(result == -1) break;
+		if(pollInfo[1].revents) Ipc::SharedMemoryRing::clearEvent(ringEventDescriptor);
+		if(!pollInfo[0].revents) continue;
+
+		ssize_t bytesRead = Ipc::SharedMemoryTransport::receive(clientDescriptor, buffer.data(), buffer.size(), receivedDescriptors);
+		if(bytesRead <= 0 || !processData(socketRpc, buffer.data(), bytesRead)) break;
+	}
+
+	for(auto descriptor : receivedDescriptors)
+	{
+		close(descriptor);
+	}
+}
+
+void runServer(int32_t listenDescriptor)
+{
+	try
+	{
+		SharedObjects bl;
+		while(true)
+		{
+			int32_t clientDescriptor = accept(listenDescriptor, nullptr, nullptr);
+			if(clientDescriptor == -1)
+			{
+				if(errno == EINTR) continue;
+				return;
+			}
+			//IIpcClient doesn't close its socket in stop(), so every client gets its own thread.
+			std::thread([&bl, clientDescriptor]()
+			{
+				serveClient(bl, clientDescriptor);
+				close(clientDescriptor);
+			}).detach();
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		std::cerr << "Server error: " << ex.what() << std::endl;
+	}
+	catch(const Exception& ex)
+	{
+		std::cerr << "Server error: " << ex.what() << std::endl;
+	}
+}
+// }}}
+
+void benchmark(SharedObjects& bl, bool useSharedMemory, int32_t calls, uint32_t ringSize)
+{
+	BenchmarkClient client(&bl, socketPath);
+	client.setSharedMemoryTransport(useSharedMemory, ringSize);
+	client.start();
+	for(int32_t i = 0; i < 500 && (!client.connected() || client.sharedMemoryTransportActive() != useSharedMemory); i++)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	if(!client.connected()) throw Exception("Could not connect to the server.");
+	if(client.sharedMemoryTransportActive() != useSharedMemory) throw Exception("The server did not accept the shared memory transport.");
+
+	PArray parameters(new Array{ std::make_shared<Variable>(std::string(64, 'x')) });
+	//Warm up
+	for(int32_t i = 0; i < 1000; i++)
+	{
+		if(client.invoke("echo", parameters)->errorStruct) throw Exception("Warm up call failed.");
+	}
+
+	int64_t startTime = HelperFunctions::getTimeMicroseconds();
+	for(int32_t i = 0; i < calls; i++)
+	{
+		if(client.invoke("echo", parameters)->errorStruct) throw Exception("Synchronous call failed.");
+	}
+	int64_t synchronousTime = HelperFunctions::getTimeMicroseconds() - startTime;
+
+	const int32_t callsInFlight = 256;
+	std::vector<std::future<PVariable>> futures;
+	futures.reserve(callsInFlight);
+	startTime = HelperFunctions::getTimeMicroseconds();
+	for(int32_t i = 0; i < calls; i += callsInFlight)
+	{
+		for(int32_t j = i; j < calls && j < i + callsInFlight; j++)
+		{
+			futures.push_back(client.invokeAsync("echo", parameters));
+		}
+		for(auto& future : futures)
+		{
+			if(future.wait_for(std::chrono::seconds(10)) != std::future_status::ready || future.get()->errorStruct) throw Exception("Pipelined call failed.");
+		}
+		futures.clear();
+	}
+	int64_t pipelinedTime = HelperFunctions::getTimeMicroseconds() - startTime;
+
+	client.stop();
+	std::cout << (useSharedMemory ? "Shared memory: " : "Socket:        ") << (synchronousTime * 1000 / calls) << " ns/invoke(), " << ((int64_t)calls * 1000000 / (pipelinedTime > 0 ? pipelinedTime : 1)) << " pipelined calls/s" << std::endl;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	int32_t calls = argc > 1 ? std::atoi(argv[1]) : 20000;
+	int32_t ringSize = argc > 2 ? std::atoi(argv[2]) : 1048576;
+	if(calls <= 0 || ringSize <= 0)
+	{
+		std::cerr << "Usage: " << argv[0] << " [calls per run] [ring size]" << std::endl;
+		return 1;
+	}
+
+	unlink(socketPath.c_str());
+	int32_t listenDescriptor = socket(AF_LOCAL, SOCK_STREAM, 0);
+	sockaddr_un address{};
+	address.sun_family = AF_LOCAL;
+	strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+	if(listenDescriptor == -1 || bind(listenDescriptor, (sockaddr*)&address, sizeof(address)) == -1 || listen(listenDescriptor, 1) == -1)
+	{
+		std::cerr << "Could not create listening socket: " << strerror(errno) << std::endl;
+		return 1;
+	}
+
+	//The server runs in its own process, so the rings are really shared between processes.
+	pid_t serverPid = fork();
+	if(serverPid == -1)
+	{
+		std::cerr << "Could not fork: " << strerror(errno) << std::endl;
+		return 1;
+	}
+	if(serverPid == 0)
+	{
+		runServer(listenDescriptor);
+		_exit(0);
+	}
+	close(listenDescriptor);
+
+	int32_t exitCode = 0;
+	try
+	{
+		SharedObjects bl;
+		std::cout << calls << " calls per run, ring size " << Ipc::SharedMemoryTransport::getRingSize(ringSize) << " bytes" << std::endl;
+		benchmark(bl, false, calls, ringSize);
+		benchmark(bl, true, calls, ringSize);
+	}
+	catch(const std::exception& ex)
+	{
+		std::cerr << "Error: " << ex.what() << std::endl;
+		exitCode = 1;
+	}
+	catch(const Exception& ex)
+	{
+		std::cerr << "Error: " << ex.what() << std::endl;
+		exitCode = 1;
+	}
+	kill(serverPid, SIGTERM);
+	waitpid(serverPid, nullptr, 0);
+	unlink(socketPath.c_str());
+	return exitCode;
+}
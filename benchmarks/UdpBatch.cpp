@@ -0,0 +1,162 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+/*
+ * Compares UdpSocket::proofwrite()/proofread() with proofwriteBatch()/proofreadBatch() on loopback.
+ *
+ * Usage: udpBatch [seconds per run] [batch size] [packet size]
+ *
+ * Sending is measured without a reader. Receiving queues one batch at a time and only measures the time needed to read it, so
+ * both results don't depend on how the scheduler distributes sender and receiver over the CPUs. The batch size must fit
+ * into the socket's receive buffer, otherwise datagrams are dropped.
+ */
+
+#include "../src/BaseLib.h"
+
+#include <cstdlib>
+#include <iostream>
+
+using namespace BaseLib;
+
+namespace
+{
+
+void printResult(const std::string& name, int64_t packets, int64_t time)
+{
+	std::cout << name << ": " << packets << " datagrams in " << time / 1000 << " ms, " << (time > 0 ? packets * 1000000 / time : 0) << " datagrams/s" << std::endl;
+}
+
+/**
+ * Nobody reads the datagrams, so the kernel drops them once the receive buffer is full. This only measures the cost of
+ * sending and is independent of the number of CPUs.
+ */
+void benchmarkSend(std::shared_ptr<UdpSocket> sender, int32_t seconds, int32_t batchSize, int32_t packetSize, bool batched)
+{
+	int64_t packets = 0;
+	std::vector<char> packet(packetSize, 'x');
+	std::vector<std::vector<char>> batch(batchSize, packet);
+	int64_t startTime = HelperFunctions::getTimeMicroseconds();
+	int64_t endTime = startTime + seconds * 1000000ll;
+	while(HelperFunctions::getTimeMicroseconds() < endTime)
+	{
+		if(batched) packets += sender->proofwriteBatch(batch);
+		else
+		{
+			for(int32_t i = 0; i < batchSize; i++)
+			{
+				sender->proofwrite(packet);
+				packets++;
+			}
+		}
+	}
+	printResult(batched ? "Send, proofwriteBatch()  " : "Send, proofwrite()       ", packets, HelperFunctions::getTimeMicroseconds() - startTime);
+}
+
+/**
+ * Queues one batch on the receiving socket and then measures the time needed to read it. Only reading is timed.
+ */
+void benchmarkReceive(std::shared_ptr<UdpSocket> sender, std::shared_ptr<UdpSocket> receiver, int32_t seconds, int32_t batchSize, int32_t packetSize, bool batched)
+{
+	int64_t packets = 0;
+	int64_t time = 0;
+	std::vector<std::vector<char>> batch(batchSize, std::vector<char>(packetSize, 'x'));
+	std::vector<char> buffer(packetSize);
+	std::vector<UdpSocket::UdpPacket> packetBuffer;
+	std::string senderIp;
+	int64_t endTime = HelperFunctions::getTimeMicroseconds() + seconds * 1000000ll;
+	while(HelperFunctions::getTimeMicroseconds() < endTime)
+	{
+		sender->proofwriteBatch(batch);
+		int64_t startTime = HelperFunctions::getTimeMicroseconds();
+		int32_t received = 0;
+		try
+		{
+			while(received < batchSize)
+			{
+				if(batched) received += receiver->proofreadBatch(packetBuffer, batchSize - received, packetSize, 10000);
+				else
+				{
+					receiver->proofread(buffer.data(), buffer.size(), senderIp);
+					received++;
+				}
+			}
+		}
+		catch(const SocketTimeOutException& ex)
+		{
+			//Datagrams were dropped. Don't count the timeout.
+			startTime += 10000;
+		}
+		time += HelperFunctions::getTimeMicroseconds() - startTime;
+		packets += received;
+	}
+	printResult(batched ? "Receive, proofreadBatch()" : "Receive, proofread()     ", packets, time);
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	int32_t seconds = argc > 1 ? std::atoi(argv[1]) : 3;
+	int32_t batchSize = argc > 2 ? std::atoi(argv[2]) : 32;
+	int32_t packetSize = argc > 3 ? std::atoi(argv[3]) : 100;
+	if(seconds <= 0 || batchSize <= 0 || packetSize <= 0)
+	{
+		std::cerr << "Usage: " << argv[0] << " [seconds per run] [batch size] [packet size]" << std::endl;
+		return 1;
+	}
+
+	try
+	{
+		SharedObjects bl;
+		//The receiver never sends, so its destination port doesn't matter.
+		std::shared_ptr<UdpSocket> receiver = std::make_shared<UdpSocket>(&bl, "127.0.0.1", "9");
+		receiver->open();
+		receiver->setReadTimeout(10000);
+		std::shared_ptr<UdpSocket> sender = std::make_shared<UdpSocket>(&bl, "127.0.0.1", std::to_string(receiver->getListenPort()));
+		sender->open();
+
+		std::cout << "Batch size " << batchSize << ", " << packetSize << " byte datagrams, " << seconds << " s per run" << std::endl;
+		benchmarkSend(sender, seconds, batchSize, packetSize, false);
+		benchmarkSend(sender, seconds, batchSize, packetSize, true);
+		benchmarkReceive(sender, receiver, seconds, batchSize, packetSize, false);
+		benchmarkReceive(sender, receiver, seconds, batchSize, packetSize, true);
+	}
+	catch(const std::exception& ex)
+	{
+		std::cerr << "Error: " << ex.what() << std::endl;
+		return 1;
+	}
+	catch(const Exception& ex)
+	{
+		std::cerr << "Error: " << ex.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
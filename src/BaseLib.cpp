@@ -34,18 +34,21 @@
 namespace BaseLib
 {
 
-SharedObjects::SharedObjects(bool testMaxThreadCount)
+SharedObjects::SharedObjects(bool testMaxThreadCount) : eventCoalescerQueue(this)
 {
 	booting = true;
 	shuttingDown = false;
 
+	//Initialize output first, so messages of the other members are filtered by debugLevel.
+	out.init(this);
 	threadManager.init(this, testMaxThreadCount);
 	fileDescriptorManager.init(this);
+	tlsCredentialManager.init(this);
 	serialDeviceManager.init(this);
+	eventReplayBuffer.init(this);
 	hf.init(this);
 	io.init(this);
 	settings.init(this);
-	out.init(this);
 }
 
 SharedObjects::~SharedObjects()
@@ -45,9 +45,11 @@
 #include "Encoding/Html.h"
 #include "Encoding/WebSocket.h"
 #include "Encoding/BitReaderWriter.h"
+#include "IPC/IIpcClient.h"
 #include "Managers/SerialDeviceManager.h"
 #include "Managers/FileDescriptorManager.h"
 #include "Managers/ThreadManager.h"
+#include "Managers/TlsCredentialManager.h"
 #include "HelperFunctions/HelperFunctions.h"
 #include "HelperFunctions/Color.h"
 #include "HelperFunctions/Math.h"
@@ -70,10 +72,13 @@
 #include "Systems/Peer.h"
 #include "Systems/SystemFactory.h"
 #include "Systems/UpdateInfo.h"
+#include "Systems/EventReplayBuffer.h"
 #include "Licensing/LicensingFactory.h"
 #include "Sockets/Ssdp.h"
 #include "IQueue.h"
 #include "ITimedQueue.h"
+#include "TimerWheel.h"
+#include "LatencyHistogram.h"
 #include "Sockets/HttpClient.h"
 #include "Sockets/HttpServer.h"
 #include "Sockets/TcpSocket.h"
@@ -121,6 +126,16 @@ public:
 	 */
 	FileDescriptorManager fileDescriptorManager;
 
+	/**
+	 * Process wide cache of TLS certificate credentials and DH parameters. All TcpSocket objects get their credentials from here.
+	 */
+	TlsCredentialManager tlsCredentialManager;
+
+	/**
+	 * Cache of SSDP device descriptions shared by all Ssdp objects.
+	 */
+	SsdpDescriptionCache ssdpDescriptionCache;
+
 	/**
 	 * The serial device manager can be used to access one serial device across multiple modules.
 	 */
@@ -146,6 +161,12 @@ public:
 	 */
 	Systems::UpdateInfo deviceUpdateInfo;
 
+	/**
+	 * Assigns sequence numbers to all events raised by centrals and stores recent events, so reconnecting clients can fetch
+	 * the events they missed.
+	 */
+	Systems::EventReplayBuffer eventReplayBuffer;
+
 	/**
 	 * Functions to ease your life for a lot of standard operations.
 	 */
@@ -166,10 +187,16 @@ public:
 	 */
 	ThreadManager threadManager;
 
+	/**
+	 * Timer queue of all event coalescers of the peers. Declared after threadManager, so it is destroyed first.
+	 */
+	Systems::EventCoalescerQueue eventCoalescerQueue;
+
 	/**
 	 * Main constructor.
 	 *
-	 * @param testMaxThreadCount If set to "true", the library tests the maximum number of threads possible. This takes some time.
+	 * @param testMaxThreadCount If set to "true", the library determines the maximum number of threads possible from the
+	 * resource limits of the process, the kernel and the cgroup.
 	 */
 	SharedObjects(bool testMaxThreadCount = false);
 
@@ -78,7 +78,6 @@ void EventHandler::unlock()
 
 void EventHandler::invalidate()
 {
-	//We don't lock mutex here. Make sure it is locked before calling this method.
 	_handler = nullptr;
 }
 
@@ -111,8 +110,7 @@ IEventSinkBase* IEvents::getEventHandler()
 
 IEventsEx::IEventsEx()
 {
-
-
+	_eventHandlerList = std::make_shared<const EventHandlerList>();
 }
 
 IEventsEx::~IEventsEx()
@@ -135,6 +133,7 @@ PEventHandler IEventsEx::addEventHandler(IEventSinkBase* eventHandler)
 	}
 	handler.reset(new EventHandler(_currentId++, eventHandler));
 	_eventHandlers[eventHandler] = handler;
+	publishEventHandlers();
     return handler;
 }
 
@@ -153,26 +152,39 @@ std::vector<PEventHandler> IEventsEx::addEventHandlers(EventHandlers eventHandle
 		}
 		else newHandlers.push_back(handlerIterator->second);
 	}
+	publishEventHandlers();
     return newHandlers;
 }
 
 void IEventsEx::removeEventHandler(PEventHandler eventHandler)
 {
 	if(!eventHandler) return;
+	{
+		std::lock_guard<std::mutex> eventHandlerGuard(_eventHandlerMutex);
+		EventHandlers::iterator handlerIterator = _eventHandlers.find(eventHandler->handler());
+		if(handlerIterator == _eventHandlers.end()) return;
+		_eventHandlers.erase(handlerIterator);
+		publishEventHandlers();
+	}
 
-	std::unique_ptr<std::lock_guard<std::mutex>> eventHandlerGuard(new std::lock_guard<std::mutex>(_eventHandlerMutex));
+	//Dispatchers still holding the old list either locked the handler before it was invalidated (and are waited for here)
+	//or see nullptr when calling handler().
+	eventHandler->invalidate();
 	while(eventHandler->useCount() != 0)
 	{
-		eventHandlerGuard.reset();
-		std::this_thread::sleep_for(std::chrono::milliseconds(100));
-		eventHandlerGuard.reset(new std::lock_guard<std::mutex>(_eventHandlerMutex));
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
 	}
-	EventHandlers::iterator handlerIterator = _eventHandlers.find(eventHandler->handler());
-	if(handlerIterator != _eventHandlers.end())
+}
+
+void IEventsEx::publishEventHandlers()
+{
+	std::shared_ptr<EventHandlerList> eventHandlerList = std::make_shared<EventHandlerList>();
+	eventHandlerList->reserve(_eventHandlers.size());
+	for(EventHandlers::iterator i = _eventHandlers.begin(); i != _eventHandlers.end(); ++i)
 	{
-		_eventHandlers.erase(eventHandler->handler());
-		eventHandler->invalidate();
+		eventHandlerList->push_back(i->second);
 	}
+	std::atomic_store(&_eventHandlerList, PEventHandlerList(eventHandlerList));
 }
 
 EventHandlers IEventsEx::getEventHandlers()
@@ -35,7 +35,9 @@
 
 #include <atomic>
 #include <forward_list>
+#include <memory>
 #include <mutex>
+#include <vector>
 
 namespace BaseLib
 {
@@ -58,12 +60,18 @@ public:
 private:
 	int32_t _id;
 	std::atomic<int32_t> _useCount;
-	IEventSinkBase* _handler = nullptr;
+	std::atomic<IEventSinkBase*> _handler{nullptr};
 };
 
 typedef std::shared_ptr<EventHandler> PEventHandler;
 typedef std::map<IEventSinkBase*, PEventHandler> EventHandlers;
 
+/**
+ * Immutable list of event handlers. It is never changed after it was published, so it can be iterated without locking.
+ */
+typedef std::vector<PEventHandler> EventHandlerList;
+typedef std::shared_ptr<const EventHandlerList> PEventHandlerList;
+
 class IEventSinkBase
 {
 public:
@@ -97,10 +105,41 @@ public:
 	virtual std::vector<PEventHandler> addEventHandlers(EventHandlers eventHandlers);
 	virtual void removeEventHandler(PEventHandler eventHandler);
 	virtual EventHandlers getEventHandlers();
+
+	/**
+	 * Returns the current list of event handlers without copying it. Use this method to dispatch events:
+	 *
+	 *     PEventHandlerList eventHandlers = getEventHandlerList();
+	 *     for(auto& eventHandler : *eventHandlers)
+	 *     {
+	 *         eventHandler->lock();
+	 *         IEventSinkBase* handler = eventHandler->handler();
+	 *         if(handler) ...
+	 *         eventHandler->unlock();
+	 *     }
+	 *
+	 * The handler might have been removed after the list was returned. In this case handler() returns nullptr.
+	 * removeEventHandler() waits until all dispatches that called lock() before are finished.
+	 */
+	PEventHandlerList getEventHandlerList() { return std::atomic_load(&_eventHandlerList); }
 protected:
 	int32_t _currentId = 0;
+
+	/**
+	 * Serializes changes of _eventHandlers and _eventHandlerList. Not needed to read _eventHandlerList.
+	 */
     std::mutex _eventHandlerMutex;
     EventHandlers _eventHandlers;
+
+    /**
+     * Copy of the values of _eventHandlers. Only accessed through std::atomic_load and std::atomic_store.
+     */
+    PEventHandlerList _eventHandlerList;
+
+    /**
+     * Creates a new _eventHandlerList from _eventHandlers. _eventHandlerMutex needs to be locked.
+     */
+    void publishEventHandlers();
 private:
     IEventsEx(const IEventsEx&);
     IEventsEx& operator=(const IEventsEx&);
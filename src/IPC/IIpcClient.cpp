@@ -33,6 +33,8 @@
 
 #include <sys/un.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <poll.h>
 
 namespace BaseLib
 {
@@ -50,10 +52,20 @@ IIpcClient::IIpcClient(SharedObjects* bl, std::string socketPath) : IQueue(bl, 1
 
 	_closed = true;
 	_stopped = true;
+	_disposing = false;
+
+	_currentPacketId = 0;
+	_pendingRequests.reset(new PendingRequest[_pendingRequestSlots]);
+	_coalescingWindow = 0;
+	_maxCoalescedCalls = 100;
+	_useSharedMemory = false;
+	_sharedMemoryRingSize = 1048576;
+	_sharedMemoryActive = false;
 
 	_binaryRpc = std::unique_ptr<Rpc::BinaryRpc>(new Rpc::BinaryRpc(_bl));
+	_sharedMemoryBinaryRpc = std::unique_ptr<Rpc::BinaryRpc>(new Rpc::BinaryRpc(_bl));
 	_rpcDecoder = std::unique_ptr<Rpc::RpcDecoder>(new Rpc::RpcDecoder(_bl, false, false));
-	_rpcEncoder = std::unique_ptr<Rpc::RpcEncoder>(new Rpc::RpcEncoder(_bl, true));
+	_rpcEncoder = std::unique_ptr<Rpc::RpcEncoder>(new Rpc::RpcEncoder(_bl, true, false));
 
 	_localRpcMethods.emplace("broadcastEvent", std::bind(&IIpcClient::broadcastEvent, this, std::placeholders::_1));
 	_localRpcMethods.emplace("broadcastNewDevices", std::bind(&IIpcClient::broadcastNewDevices, this, std::placeholders::_1));
@@ -74,7 +86,7 @@ void IIpcClient::dispose()
 		std::lock_guard<std::mutex> disposeGuard(_disposeMutex);
 		_disposing = true;
 		stop();
-		_rpcResponses.clear();
+		failPendingRequests();
 	}
     catch(const std::exception& ex)
     {
@@ -98,7 +110,11 @@ void IIpcClient::stop()
 		_stopped = true;
 		if(_mainThread.joinable()) _mainThread.join();
 		if (_maintenanceThread.joinable()) _maintenanceThread.join();
+		_coalescingConditionVariable.notify_all();
+		if(_coalescingThread.joinable()) _coalescingThread.join();
 		_closed = true;
+		failPendingRequests();
+		closeSharedMemory();
 		stopQueue(0);
 	}
     catch(const std::exception& ex)
@@ -159,6 +175,8 @@ void IIpcClient::connect()
 		}
 		_closed = false;
 
+		offerSharedMemory();
+
 		if (_maintenanceThread.joinable()) _maintenanceThread.join();
 		_maintenanceThread = std::thread(&IIpcClient::onConnect, this);
 
@@ -190,6 +208,9 @@ void IIpcClient::start()
 
 		if(_mainThread.joinable()) _mainThread.join();
 		_mainThread = std::thread(&IIpcClient::mainThread, this);
+
+		if(_coalescingThread.joinable()) _coalescingThread.join();
+		_coalescingThread = std::thread(&IIpcClient::coalescingThread, this);
 	}
     catch(const std::exception& ex)
     {
@@ -211,10 +232,9 @@ void IIpcClient::mainThread()
 	{
 		connect();
 
-		std::vector<char> buffer(1024);
+		std::vector<char> buffer(65536);
 		int32_t result = 0;
 		int32_t bytesRead = 0;
-		int32_t processedBytes = 0;
 		while(!_stopped)
 		{
 			if(_closed)
@@ -227,57 +247,82 @@ void IIpcClient::mainThread()
 				}
 			}
 
+			//Drain the shared memory ring before waiting. The socket is still watched to detect disconnects.
+			int32_t ringEventDescriptor = -1;
+			bool ringHasData = false;
+			std::shared_ptr<SharedMemoryTransport> transport = std::atomic_load(&_sharedMemoryTransport);
+			if(transport)
+			{
+				SharedMemoryRing& receiveRing = transport->receiveRing();
+				uint32_t ringBytesRead = 0;
+				while((ringBytesRead = receiveRing.read(&buffer[0], buffer.size())) > 0)
+				{
+					processReceivedData(*_sharedMemoryBinaryRpc, &buffer[0], ringBytesRead);
+				}
+				//When new data arrived in the meantime, only check the socket without waiting, so it isn't starved.
+				ringHasData = !receiveRing.prepareWait();
+				if(!ringHasData) ringEventDescriptor = receiveRing.dataEventDescriptor();
+			}
+
 			timeval timeout;
 			timeout.tv_sec = 0;
-			timeout.tv_usec = 100000;
+			timeout.tv_usec = ringHasData ? 0 : 100000;
 			fd_set readFileDescriptor;
 			FD_ZERO(&readFileDescriptor);
+			int32_t maxfd = 0;
 			{
 				auto fileDescriptorGuard = _bl->fileDescriptorManager.getLock();
 				fileDescriptorGuard.lock();
+				maxfd = _fileDescriptor->descriptor;
 				FD_SET(_fileDescriptor->descriptor, &readFileDescriptor);
 			}
+			if(ringEventDescriptor != -1)
+			{
+				FD_SET(ringEventDescriptor, &readFileDescriptor);
+				if(ringEventDescriptor > maxfd) maxfd = ringEventDescriptor;
+			}
 
-			result = select(_fileDescriptor->descriptor + 1, &readFileDescriptor, NULL, NULL, &timeout);
+			result = select(maxfd + 1, &readFileDescriptor, NULL, NULL, &timeout);
 			if(result == 0) continue;
 			else if(result == -1)
 			{
 				if(errno == EINTR) continue;
 				_out.printMessage("Connection to IPC server closed (1).");
 				_closed = true;
+				failPendingRequests();
+				closeSharedMemory();
 				std::this_thread::sleep_for(std::chrono::milliseconds(10000));
 				continue;
 			}
 
-			bytesRead = read(_fileDescriptor->descriptor, &buffer[0], 1024);
-			if(bytesRead <= 0) //read returns 0, when connection is disrupted.
-			{
-				_out.printMessage("Connection to IPC server closed (2).");
-				_closed = true;
-				std::this_thread::sleep_for(std::chrono::milliseconds(10000));
-				continue;
-			}
+			if(ringEventDescriptor != -1 && FD_ISSET(ringEventDescriptor, &readFileDescriptor)) SharedMemoryRing::clearEvent(ringEventDescriptor);
+			if(!FD_ISSET(_fileDescriptor->descriptor, &readFileDescriptor)) continue;
 
-			if(bytesRead > (signed)buffer.size()) bytesRead = buffer.size();
-
-			try
+			//Read until the socket is drained, so select() is only called when there is nothing left.
+			bool connectionClosed = false;
+			while(true)
 			{
-				processedBytes = 0;
-				while(processedBytes < bytesRead)
+				bytesRead = read(_fileDescriptor->descriptor, &buffer[0], buffer.size());
+				if(bytesRead > 0)
 				{
-					processedBytes += _binaryRpc->process(&buffer[processedBytes], bytesRead - processedBytes);
-					if(_binaryRpc->isFinished())
-					{
-						std::shared_ptr<IQueueEntry> queueEntry(new QueueEntry(_binaryRpc->getData(), _binaryRpc->getType() == Rpc::BinaryRpc::Type::request));
-						if(!enqueue(0, queueEntry)) printQueueFullError(_out, "Error: Could not queue RPC packet. Queue is full.");
-						_binaryRpc->reset();
-					}
+					if(bytesRead > (signed)buffer.size()) bytesRead = buffer.size();
+					processReceivedData(*_binaryRpc, &buffer[0], bytesRead);
+					if(bytesRead < (signed)buffer.size()) break;
+					continue;
 				}
+				if(bytesRead == -1 && errno == EINTR) continue;
+				if(bytesRead == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+				connectionClosed = true; //read returns 0, when connection is disrupted.
+				break;
 			}
-			catch(Rpc::BinaryRpcException& ex)
+			if(connectionClosed)
 			{
-				_out.printError("Error processing packet: " + ex.what());
-				_binaryRpc->reset();
+				_out.printMessage("Connection to IPC server closed (2).");
+				_closed = true;
+				failPendingRequests();
+				closeSharedMemory();
+				std::this_thread::sleep_for(std::chrono::milliseconds(10000));
+				continue;
 			}
 		}
 		buffer.clear();
@@ -296,6 +341,29 @@ void IIpcClient::mainThread()
 	}
 }
 
+void IIpcClient::processReceivedData(Rpc::BinaryRpc& binaryRpc, char* buffer, int32_t bufferSize)
+{
+	try
+	{
+		int32_t processedBytes = 0;
+		while(processedBytes < bufferSize)
+		{
+			processedBytes += binaryRpc.process(buffer + processedBytes, bufferSize - processedBytes);
+			if(binaryRpc.isFinished())
+			{
+				std::shared_ptr<IQueueEntry> queueEntry(new QueueEntry(std::move(binaryRpc.getData()), binaryRpc.getType() == Rpc::BinaryRpc::Type::request));
+				if(!enqueue(0, queueEntry)) printQueueFullError(_out, "Error: Could not queue RPC packet. Queue is full.");
+				binaryRpc.reset();
+			}
+		}
+	}
+	catch(Rpc::BinaryRpcException& ex)
+	{
+		_out.printError("Error processing packet: " + ex.what());
+		binaryRpc.reset();
+	}
+}
+
 void IIpcClient::processQueueEntry(int32_t index, std::shared_ptr<IQueueEntry>& entry)
 {
 	try
@@ -342,32 +410,262 @@ void IIpcClient::processQueueEntry(int32_t index, std::shared_ptr<IQueueEntry>&
 				_out.printError("Error: Response has wrong array size.");
 				return;
 			}
-			int64_t threadId = response->arrayValue->at(0)->integerValue64;
 			int32_t packetId = response->arrayValue->at(1)->integerValue;
+			finishPendingRequest(packetId, response->arrayValue->at(2));
+		}
+	}
+	catch(const std::exception& ex)
+    {
+    	_out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(Exception& ex)
+    {
+    	_out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	_out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
 
+PVariable IIpcClient::send(std::vector<char>& data, const std::vector<int32_t>* fileDescriptors)
+{
+	try
+	{
+		if(data.empty()) return PVariable(new Variable());
+
+		OutgoingMessage message;
+		message.data = &data;
+		message.fileDescriptors = fileDescriptors;
+
+		std::unique_lock<std::mutex> sendQueueGuard(_sendQueueMutex);
+		_sendQueue.push_back(&message);
+		while(!message.done)
+		{
+			if(_sendInProgress)
 			{
-				std::lock_guard<std::mutex> responseGuard(_rpcResponsesMutex);
-				auto responseIterator = _rpcResponses[threadId].find(packetId);
-				if(responseIterator != _rpcResponses[threadId].end())
+				_sendConditionVariable.wait(sendQueueGuard);
+				continue;
+			}
+
+			//No other thread is writing, so this thread writes everything queued so far.
+			_sendInProgress = true;
+			std::vector<OutgoingMessage*> messages;
+			messages.swap(_sendQueue);
+			sendQueueGuard.unlock();
+			writeMessages(messages);
+			sendQueueGuard.lock();
+			for(auto& queuedMessage : messages)
+			{
+				queuedMessage->done = true;
+			}
+			_sendInProgress = false;
+			_sendConditionVariable.notify_all();
+		}
+
+		if(message.error) return Variable::createError(-32500, "Unknown application error.");
+	}
+	catch(const std::exception& ex)
+    {
+    	_out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(Exception& ex)
+    {
+    	_out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	_out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return PVariable(new Variable());
+}
+
+bool IIpcClient::waitForWritability()
+{
+	for(int32_t i = 0; i < 10; i++)
+	{
+		if(_closed || _stopped) return false;
+		pollfd pollInfo;
+		pollInfo.fd = _fileDescriptor->descriptor;
+		pollInfo.events = POLLOUT;
+		pollInfo.revents = 0;
+		int32_t result = poll(&pollInfo, 1, 1000);
+		if(result == -1 && errno == EINTR) continue;
+		if(result == -1) return false;
+		if(result > 0) return !(pollInfo.revents & (POLLERR | POLLHUP | POLLNVAL));
+	}
+	return false;
+}
+
+void IIpcClient::writeMessages(std::vector<OutgoingMessage*>& messages)
+{
+	try
+	{
+		//Descriptors can only be passed through the socket. They are only sent while the transport is inactive anyway.
+		if(_sharedMemoryActive && std::none_of(messages.begin(), messages.end(), [](OutgoingMessage* message) { return message->fileDescriptors != nullptr; }))
+		{
+			std::shared_ptr<SharedMemoryTransport> transport = std::atomic_load(&_sharedMemoryTransport);
+			if(transport)
+			{
+				bool error = false;
+				for(auto& message : messages)
 				{
-					PIpcResponse element = responseIterator->second;
-					if(element)
+					if(!error && !transport->sendRing().write(message->data->data(), message->data->size(), 10000))
 					{
-						element->response = response;
-						element->packetId = packetId;
-						element->finished = true;
+						_out.printError("Could not send data to shared memory: Timeout waiting for free space.");
+						error = true;
+
+						//Part of a frame might have been written. Shut the connection down, mainThread releases the rings and
+						//reconnects.
+						auto fileDescriptorGuard = _bl->fileDescriptorManager.getLock();
+						fileDescriptorGuard.lock();
+						if(_fileDescriptor->descriptor != -1) ::shutdown(_fileDescriptor->descriptor, SHUT_RDWR);
 					}
+					message->error = error;
 				}
+				return;
 			}
-			std::lock_guard<std::mutex> requestInfoGuard(_requestInfoMutex);
-			std::map<int64_t, RequestInfo>::iterator requestIterator = _requestInfo.find(threadId);
-			if (requestIterator != _requestInfo.end())
+		}
+
+		const size_t maxIoVectors = 64;
+		std::vector<iovec> ioVectors;
+		ioVectors.reserve(std::min(messages.size(), maxIoVectors));
+		size_t index = 0;
+		bool error = false;
+		while(index < messages.size())
+		{
+			size_t end = std::min(index + maxIoVectors, messages.size());
+			//A message with descriptors starts a new batch, so they arrive with its first byte.
+			for(size_t i = index + 1; i < end; i++)
 			{
-				std::unique_lock<std::mutex> waitLock(requestInfo.waitMutex);
-				waitLock.unlock();
-				requestIterator->second.conditionVariable.notify_all();
+				if(messages[i]->fileDescriptors)
+				{
+					end = i;
+					break;
+				}
 			}
+
+			if(!error)
+			{
+				ioVectors.clear();
+				size_t bytesToWrite = 0;
+				for(size_t i = index; i < end; i++)
+				{
+					iovec ioVector;
+					ioVector.iov_base = (void*)messages[i]->data->data();
+					ioVector.iov_len = messages[i]->data->size();
+					ioVectors.push_back(ioVector);
+					bytesToWrite += ioVector.iov_len;
+				}
+
+				size_t currentVector = 0;
+				size_t totallySentBytes = 0;
+				while(currentVector < ioVectors.size())
+				{
+					msghdr message;
+					memset(&message, 0, sizeof(message));
+					message.msg_iov = &ioVectors[currentVector];
+					message.msg_iovlen = ioVectors.size() - currentVector;
+					std::vector<char> control;
+					const std::vector<int32_t>* fileDescriptors = messages[index]->fileDescriptors;
+					if(totallySentBytes == 0 && fileDescriptors && !fileDescriptors->empty())
+					{
+						control.resize(CMSG_SPACE(sizeof(int32_t) * fileDescriptors->size()), 0);
+						message.msg_control = control.data();
+						message.msg_controllen = control.size();
+						cmsghdr* controlMessage = CMSG_FIRSTHDR(&message);
+						controlMessage->cmsg_level = SOL_SOCKET;
+						controlMessage->cmsg_type = SCM_RIGHTS;
+						controlMessage->cmsg_len = CMSG_LEN(sizeof(int32_t) * fileDescriptors->size());
+						memcpy(CMSG_DATA(controlMessage), fileDescriptors->data(), sizeof(int32_t) * fileDescriptors->size());
+					}
+
+					ssize_t sentBytes = ::sendmsg(_fileDescriptor->descriptor, &message, MSG_NOSIGNAL);
+					if(sentBytes <= 0)
+					{
+						if(sentBytes == -1 && errno == EINTR) continue;
+						if(sentBytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK) && waitForWritability()) continue;
+						_out.printError("Could not send data to client " + std::to_string(_fileDescriptor->descriptor) + ". Sent bytes: " + std::to_string(totallySentBytes) + " of " + std::to_string(bytesToWrite) + (sentBytes == -1 ? ". Error message: " + std::string(strerror(errno)) : ""));
+						error = true;
+
+						//Part of a frame might have been written. Shut the connection down, so the next write doesn't continue in
+						//the middle of that frame. mainThread notices the closed socket, fails pending requests and reconnects.
+						auto fileDescriptorGuard = _bl->fileDescriptorManager.getLock();
+						fileDescriptorGuard.lock();
+						if(_fileDescriptor->descriptor != -1) ::shutdown(_fileDescriptor->descriptor, SHUT_RDWR);
+						break;
+					}
+					totallySentBytes += sentBytes;
+
+					//Skip completely written vectors and adjust a partially written one
+					while(sentBytes > 0 && currentVector < ioVectors.size())
+					{
+						if((size_t)sentBytes >= ioVectors[currentVector].iov_len)
+						{
+							sentBytes -= ioVectors[currentVector].iov_len;
+							currentVector++;
+						}
+						else
+						{
+							ioVectors[currentVector].iov_base = (char*)ioVectors[currentVector].iov_base + sentBytes;
+							ioVectors[currentVector].iov_len -= sentBytes;
+							sentBytes = 0;
+						}
+					}
+				}
+			}
+
+			//Once writing failed, the stream is corrupted, so all following messages fail, too.
+			for(size_t i = index; i < end; i++)
+			{
+				messages[i]->error = error;
+			}
+			index = end;
+		}
+	}
+	catch(const std::exception& ex)
+    {
+    	_out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(Exception& ex)
+    {
+    	_out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	_out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+int32_t IIpcClient::addPendingRequest(InvokeCallback& callback)
+{
+	for(int32_t i = 0; i < _pendingRequestSlots; i++)
+	{
+		int32_t packetId = (int32_t)(_currentPacketId++ & 0x7FFFFFFF);
+		PendingRequest& request = _pendingRequests[packetId & (_pendingRequestSlots - 1)];
+		std::lock_guard<std::mutex> requestGuard(request.mutex);
+		if(request.packetId != -1) continue;
+		request.packetId = packetId;
+		request.callback.swap(callback);
+		return packetId;
+	}
+	return -1;
+}
+
+void IIpcClient::finishPendingRequest(int32_t packetId, PVariable result)
+{
+	try
+	{
+		if(packetId < 0) return;
+		InvokeCallback callback;
+		{
+			PendingRequest& request = _pendingRequests[packetId & (_pendingRequestSlots - 1)];
+			std::lock_guard<std::mutex> requestGuard(request.mutex);
+			if(request.packetId != packetId) return;
+			request.packetId = -1;
+			callback.swap(request.callback);
 		}
+		if(callback) callback(result);
 	}
 	catch(const std::exception& ex)
     {
@@ -383,22 +681,18 @@ void IIpcClient::processQueueEntry(int32_t index, std::shared_ptr<IQueueEntry>&
     }
 }
 
-PVariable IIpcClient::send(std::vector<char>& data)
+void IIpcClient::failPendingRequests()
 {
 	try
 	{
-		int32_t totallySentBytes = 0;
-		std::lock_guard<std::mutex> sendGuard(_sendMutex);
-		while (totallySentBytes < (signed)data.size())
+		for(int32_t i = 0; i < _pendingRequestSlots; i++)
 		{
-			int32_t sentBytes = ::send(_fileDescriptor->descriptor, &data.at(0) + totallySentBytes, data.size() - totallySentBytes, MSG_NOSIGNAL);
-			if(sentBytes <= 0)
+			int32_t packetId = -1;
 			{
-				if(errno == EAGAIN) continue;
-				_out.printError("Could not send data to client " + std::to_string(_fileDescriptor->descriptor) + ". Sent bytes: " + std::to_string(totallySentBytes) + " of " + std::to_string(data.size()) + (sentBytes == -1 ? ". Error message: " + std::string(strerror(errno)) : ""));
-				return Variable::createError(-32500, "Unknown application error.");
+				std::lock_guard<std::mutex> requestGuard(_pendingRequests[i].mutex);
+				packetId = _pendingRequests[i].packetId;
 			}
-			totallySentBytes += sentBytes;
+			if(packetId != -1) finishPendingRequest(packetId, Variable::createError(-1, "No response received."));
 		}
 	}
 	catch(const std::exception& ex)
@@ -413,68 +707,330 @@ PVariable IIpcClient::send(std::vector<char>& data)
     {
     	_out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
     }
-    return PVariable(new Variable());
 }
 
-PVariable IIpcClient::invoke(std::string methodName, PArray& parameters)
+void IIpcClient::invokeAsync(std::string methodName, PArray& parameters, InvokeCallback callback)
 {
+	if(_coalescingWindow > 0 && methodName != "system.multicall")
+	{
+		std::lock_guard<std::mutex> coalescingGuard(_coalescingMutex);
+		if(!_stopped)
+		{
+			if(_coalescedCalls.empty()) _coalescingDeadline = std::chrono::steady_clock::now() + std::chrono::microseconds(_coalescingWindow);
+			CoalescedCall call;
+			call.methodName = methodName;
+			call.parameters = parameters;
+			call.callback.swap(callback);
+			_coalescedCalls.push_back(std::move(call));
+			if(_coalescedCalls.size() == 1 || (signed)_coalescedCalls.size() >= _maxCoalescedCalls) _coalescingConditionVariable.notify_one();
+			return;
+		}
+	}
+	sendRequest(methodName, parameters, callback);
+}
+
+void IIpcClient::sendRequest(std::string methodName, PArray& parameters, InvokeCallback& callback, const std::vector<int32_t>* fileDescriptors)
+{
+	//Keep a copy, addPendingRequest moves the callback into the slot
+	InvokeCallback errorCallback = callback;
+	int32_t packetId = -1;
 	try
 	{
-		int64_t threadId = pthread_self();
-		std::unique_lock<std::mutex> requestInfoGuard(_requestInfoMutex);
-		RequestInfo& requestInfo = _requestInfo[threadId];
-		requestInfoGuard.unlock();
+		if(_disposing)
+		{
+			PVariable error = Variable::createError(-32500, "Client is disposing.");
+			if(errorCallback) errorCallback(error);
+			return;
+		}
 
-		int32_t packetId;
+		packetId = addPendingRequest(callback);
+		if(packetId == -1)
 		{
-			std::lock_guard<std::mutex> packetIdGuard(_packetIdMutex);
-			packetId = _currentPacketId++;
+			_out.printError("Error: Too many pending RPC requests. Method: " + methodName);
+			PVariable error = Variable::createError(-32500, "Too many pending requests.");
+			if(errorCallback) errorCallback(error);
+			return;
 		}
+
+		//The server expects the thread ID, it is only echoed back.
+		int64_t threadId = pthread_self();
 		PArray array(new Array{ PVariable(new Variable(threadId)), PVariable(new Variable(packetId)), PVariable(new Variable(parameters)) });
 		std::vector<char> data;
 		_rpcEncoder->encodeRequest(methodName, array, data);
 
-		PIpcResponse response;
+		PVariable result = send(data, fileDescriptors);
+		if(result->errorStruct) finishPendingRequest(packetId, result);
+		return;
+	}
+	catch(const std::exception& ex)
+    {
+    	_out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(Exception& ex)
+    {
+    	_out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	_out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    PVariable error = Variable::createError(-32500, "Unknown application error.");
+    if(packetId != -1) finishPendingRequest(packetId, error);
+    else if(errorCallback) errorCallback(error);
+}
+
+void IIpcClient::sendMulticall(std::shared_ptr<std::vector<CoalescedCall>> calls)
+{
+	try
+	{
+		PArray methodCalls = std::make_shared<Array>();
+		methodCalls->reserve(calls->size());
+		for(auto& call : *calls)
 		{
-			std::lock_guard<std::mutex> responseGuard(_rpcResponsesMutex);
-			auto result = _rpcResponses[threadId].emplace(packetId, std::make_shared<IpcResponse>());
-			if(result.second) response = result.first->second;
+			PVariable methodCall = std::make_shared<Variable>(VariableType::tStruct);
+			methodCall->structValue->emplace("methodName", std::make_shared<Variable>(call.methodName));
+			methodCall->structValue->emplace("params", std::make_shared<Variable>(call.parameters));
+			methodCalls->push_back(methodCall);
 		}
-		if(!response)
+		PArray parameters(new Array{ std::make_shared<Variable>(methodCalls) });
+
+		InvokeCallback callback = [calls](PVariable& result)
 		{
-			_out.printError("Critical: Could not insert response struct into map.");
-			return Variable::createError(-32500, "Unknown application error.");
+			for(uint32_t i = 0; i < calls->size(); i++)
+			{
+				PVariable callResult;
+				if(result->errorStruct) callResult = result;
+				else if(result->type != VariableType::tArray || i >= result->arrayValue->size()) callResult = Variable::createError(-32500, "Invalid multicall response.");
+				else
+				{
+					//Successful calls are wrapped in an array with one element, failed calls return a fault struct.
+					callResult = result->arrayValue->at(i);
+					if(callResult->type == VariableType::tArray && callResult->arrayValue->size() == 1) callResult = callResult->arrayValue->at(0);
+					else if(callResult->type == VariableType::tStruct && callResult->structValue->find("faultCode") != callResult->structValue->end())
+					{
+						auto faultStringIterator = callResult->structValue->find("faultString");
+						callResult = Variable::createError(callResult->structValue->at("faultCode")->integerValue, faultStringIterator == callResult->structValue->end() ? "" : faultStringIterator->second->stringValue);
+					}
+				}
+				if(calls->at(i).callback) calls->at(i).callback(callResult);
+			}
+		};
+		sendRequest("system.multicall", parameters, callback);
+	}
+	catch(const std::exception& ex)
+    {
+    	_out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(Exception& ex)
+    {
+    	_out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	_out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+std::vector<PVariable> IIpcClient::invokeMulticall(std::vector<std::pair<std::string, PArray>>& calls)
+{
+	std::vector<PVariable> results;
+	try
+	{
+		if(calls.empty()) return results;
+
+		std::vector<std::future<PVariable>> futures;
+		futures.reserve(calls.size());
+		std::shared_ptr<std::vector<CoalescedCall>> methodCalls = std::make_shared<std::vector<CoalescedCall>>();
+		methodCalls->reserve(calls.size());
+		for(auto& call : calls)
+		{
+			std::shared_ptr<std::promise<PVariable>> promise = std::make_shared<std::promise<PVariable>>();
+			futures.push_back(promise->get_future());
+			CoalescedCall methodCall;
+			methodCall.methodName = call.first;
+			methodCall.parameters = call.second;
+			methodCall.callback = [promise](PVariable& result) { promise->set_value(result); };
+			methodCalls->push_back(std::move(methodCall));
 		}
+		sendMulticall(methodCalls);
 
-		std::unique_lock<std::mutex> waitLock(requestInfo.waitMutex);
-		PVariable result = send(data);
-		if(result->errorStruct)
+		results.reserve(futures.size());
+		for(auto& future : futures)
 		{
-			std::lock_guard<std::mutex> responseGuard(_rpcResponsesMutex);
-			_rpcResponses[threadId].erase(packetId);
-			if (_rpcResponses[threadId].empty()) _rpcResponses.erase(threadId);
-			return result;
+			while(future.wait_for(std::chrono::milliseconds(10000)) != std::future_status::ready)
+			{
+				if(_closed || _stopped || _disposing) break;
+			}
+			if(future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) results.push_back(Variable::createError(-1, "No response received."));
+			else results.push_back(future.get());
 		}
+		return results;
+	}
+	catch(const std::exception& ex)
+    {
+    	_out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(Exception& ex)
+    {
+    	_out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	_out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    while(results.size() < calls.size()) results.push_back(Variable::createError(-32500, "Unknown application error."));
+    return results;
+}
 
-		while (!requestInfo.conditionVariable.wait_for(waitLock, std::chrono::milliseconds(10000), [&]
+void IIpcClient::setCoalescingWindow(int32_t window, int32_t maxCalls)
+{
+	_maxCoalescedCalls = maxCalls > 0 ? maxCalls : 1;
+	_coalescingWindow = window > 0 ? window : 0;
+	_coalescingConditionVariable.notify_all();
+}
+
+void IIpcClient::coalescingThread()
+{
+	try
+	{
+		while(true)
 		{
-			return response->finished || _closed || _stopped || _disposing;
-		}));
+			std::shared_ptr<std::vector<CoalescedCall>> calls = std::make_shared<std::vector<CoalescedCall>>();
+			{
+				std::unique_lock<std::mutex> coalescingGuard(_coalescingMutex);
+				_coalescingConditionVariable.wait_for(coalescingGuard, std::chrono::milliseconds(100), [&] { return _stopped || !_coalescedCalls.empty(); });
+				if(!_stopped && !_coalescedCalls.empty())
+				{
+					_coalescingConditionVariable.wait_until(coalescingGuard, _coalescingDeadline, [&] { return _stopped || _coalescingWindow == 0 || (signed)_coalescedCalls.size() >= _maxCoalescedCalls; });
+				}
+				calls->swap(_coalescedCalls);
+				if(_stopped && calls->empty()) break;
+			}
+			if(calls->empty()) continue;
 
-		if(!response->finished || response->response->arrayValue->size() != 3 || response->packetId != packetId)
+			while((signed)calls->size() > _maxCoalescedCalls)
+			{
+				//Can happen when the maximum was lowered
+				std::shared_ptr<std::vector<CoalescedCall>> part = std::make_shared<std::vector<CoalescedCall>>(std::make_move_iterator(calls->begin()), std::make_move_iterator(calls->begin() + _maxCoalescedCalls));
+				calls->erase(calls->begin(), calls->begin() + part->size());
+				sendMulticall(part);
+			}
+			if(calls->size() == 1) sendRequest(calls->at(0).methodName, calls->at(0).parameters, calls->at(0).callback);
+			else sendMulticall(calls);
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		_out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(Exception& ex)
+	{
+		_out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+void IIpcClient::setSharedMemoryTransport(bool enabled, uint32_t ringSize)
+{
+	_sharedMemoryRingSize = SharedMemoryTransport::getRingSize(ringSize);
+	_useSharedMemory = enabled;
+}
+
+void IIpcClient::offerSharedMemory()
+{
+	try
+	{
+		closeSharedMemory();
+		if(!_useSharedMemory) return;
+
+		std::shared_ptr<SharedMemoryTransport> transport;
+		try
 		{
-			_out.printError("Error: No response received to RPC request. Method: " + methodName);
-			result = Variable::createError(-1, "No response received.");
+			transport = SharedMemoryTransport::create(_sharedMemoryRingSize);
 		}
-		else result = response->response->arrayValue->at(2);
+		catch(Exception& ex)
+		{
+			_out.printWarning("Warning: " + ex.what() + " Using socket.");
+			return;
+		}
+		//mainThread is the only reader of the ring, so it can reset the parser without locking.
+		_sharedMemoryBinaryRpc->reset();
+		{
+			std::lock_guard<std::mutex> sharedMemoryGuard(_sharedMemoryMutex);
+			std::atomic_store(&_sharedMemoryTransport, transport);
+		}
+
+		std::weak_ptr<SharedMemoryTransport> offeredTransport = transport;
+		InvokeCallback callback = [this, offeredTransport](PVariable& result)
+		{
+			std::lock_guard<std::mutex> sharedMemoryGuard(_sharedMemoryMutex);
+			std::shared_ptr<SharedMemoryTransport> transport = offeredTransport.lock();
+			//The connection was closed in the meantime
+			if(!transport || std::atomic_load(&_sharedMemoryTransport) != transport) return;
+			if(!result->errorStruct && result->type == VariableType::tBoolean && result->booleanValue)
+			{
+				_sharedMemoryActive = true;
+				if(_bl->debugLevel >= 4) _out.printInfo("Info: Using shared memory transport.");
+			}
+			else
+			{
+				std::atomic_store(&_sharedMemoryTransport, std::shared_ptr<SharedMemoryTransport>());
+				if(_bl->debugLevel >= 4) _out.printInfo("Info: Server does not support shared memory transport. Using socket.");
+			}
+		};
+		PArray parameters(new Array{ std::make_shared<Variable>((int32_t)transport->ringSize()) });
+		std::vector<int32_t> fileDescriptors = transport->descriptors();
+		sendRequest("enableSharedMemoryTransport", parameters, callback, &fileDescriptors);
+	}
+	catch(const std::exception& ex)
+	{
+		_out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(Exception& ex)
+	{
+		_out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+void IIpcClient::closeSharedMemory()
+{
+	std::lock_guard<std::mutex> sharedMemoryGuard(_sharedMemoryMutex);
+	_sharedMemoryActive = false;
+	//Threads still holding a reference finish their current read or write first.
+	std::atomic_store(&_sharedMemoryTransport, std::shared_ptr<SharedMemoryTransport>());
+}
+
+std::future<PVariable> IIpcClient::invokeAsync(std::string methodName, PArray& parameters)
+{
+	std::shared_ptr<std::promise<PVariable>> promise = std::make_shared<std::promise<PVariable>>();
+	std::future<PVariable> future = promise->get_future();
+	invokeAsync(methodName, parameters, [promise](PVariable& result) { promise->set_value(result); });
+	return future;
+}
 
+PVariable IIpcClient::invoke(std::string methodName, PArray& parameters)
+{
+	try
+	{
+		std::future<PVariable> future = invokeAsync(methodName, parameters);
+		while(future.wait_for(std::chrono::milliseconds(10000)) != std::future_status::ready)
+		{
+			if(_closed || _stopped || _disposing) break;
+		}
+		if(future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
 		{
-			std::lock_guard<std::mutex> responseGuard(_rpcResponsesMutex);
-			_rpcResponses[threadId].erase(packetId);
-			if (_rpcResponses[threadId].empty()) _rpcResponses.erase(threadId);
+			_out.printError("Error: No response received to RPC request. Method: " + methodName);
+			return Variable::createError(-1, "No response received.");
 		}
 
-		return result;
+		return future.get();
 	}
 	catch(const std::exception& ex)
     {
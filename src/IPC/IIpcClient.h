@@ -0,0 +1,309 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef IIPCCLIENT_H_
+#define IIPCCLIENT_H_
+
+#include "../IQueue.h"
+#include "../Variable.h"
+#include "../Output/Output.h"
+#include "../Encoding/BinaryRpc.h"
+#include "../Encoding/RpcDecoder.h"
+#include "../Encoding/RpcEncoder.h"
+#include "../Managers/FileDescriptorManager.h"
+#include "../Sockets/RpcClientInfo.h"
+#include "SharedMemoryTransport.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace BaseLib
+{
+
+class SharedObjects;
+
+namespace Ipc
+{
+
+/**
+ * Base class for clients connecting to Homegear's IPC server through a Unix domain socket.
+ */
+class IIpcClient : public IQueue
+{
+public:
+	/**
+	 * Called with the result of an asynchronous RPC call. On errors "result" is an error struct.
+	 */
+	typedef std::function<void(PVariable& result)> InvokeCallback;
+
+	IIpcClient(SharedObjects* bl, std::string socketPath);
+	virtual ~IIpcClient();
+	virtual void dispose();
+
+	void start();
+	void stop();
+
+	/**
+	 * Calls an RPC method on the server and waits for the result.
+	 *
+	 * @param methodName The name of the method to call.
+	 * @param parameters The parameters to pass.
+	 * @return Returns the result of the call or an error struct.
+	 */
+	PVariable invoke(std::string methodName, PArray& parameters);
+
+	/**
+	 * Calls an RPC method on the server without waiting for the result. Any number of calls (up to the number of pending
+	 * request slots) can be in flight at the same time.
+	 *
+	 * @param methodName The name of the method to call.
+	 * @param parameters The parameters to pass.
+	 * @param callback Called exactly once with the result or an error struct. The callback is executed by a queue processing
+	 * thread (or by the calling thread when the request could not be sent) and should return quickly.
+	 */
+	void invokeAsync(std::string methodName, PArray& parameters, InvokeCallback callback);
+
+	/**
+	 * Calls an RPC method on the server without waiting for the result.
+	 *
+	 * @param methodName The name of the method to call.
+	 * @param parameters The parameters to pass.
+	 * @return Returns a future which receives the result or an error struct.
+	 */
+	std::future<PVariable> invokeAsync(std::string methodName, PArray& parameters);
+
+	/**
+	 * Calls multiple RPC methods with a single "system.multicall" request and waits for the results.
+	 *
+	 * @param calls Pairs of method name and parameters.
+	 * @return Returns one result per call in the same order. Failed calls return an error struct.
+	 */
+	std::vector<PVariable> invokeMulticall(std::vector<std::pair<std::string, PArray>>& calls);
+
+	/**
+	 * Enables automatic coalescing of calls to invoke() and invokeAsync(). Calls issued within "window" microseconds after
+	 * the first queued call are sent together as one "system.multicall" request.
+	 *
+	 * @param window The coalescing window in microseconds. "0" disables coalescing (the default).
+	 * @param maxCalls The maximum number of calls per request. The request is sent immediately when this number is reached.
+	 */
+	void setCoalescingWindow(int32_t window, int32_t maxCalls = 100);
+
+	/**
+	 * Enables the shared memory transport. On every connect the client offers two SharedMemoryRings to the server by calling
+	 * "enableSharedMemoryTransport(ringSize)". The descriptors of SharedMemoryTransport are attached to this request. When the
+	 * server returns "true", all further RPC frames are exchanged through the rings and the socket is only used to detect
+	 * disconnects. Otherwise the socket is used. Takes effect on the next connect, so call it before start().
+	 *
+	 * The transport saves the socket system calls, so it mainly raises the throughput of pipelined calls. The latency of
+	 * invoke() stays about the same. See benchmarks/IpcSharedMemory.cpp.
+	 *
+	 * @param enabled Set to true to offer the shared memory transport.
+	 * @param ringSize The size of each ring in bytes. Rounded up to a power of two.
+	 */
+	void setSharedMemoryTransport(bool enabled, uint32_t ringSize = 1048576);
+
+	/**
+	 * Returns true when RPC frames are currently exchanged through shared memory.
+	 */
+	bool sharedMemoryTransportActive() { return _sharedMemoryActive; }
+protected:
+	class QueueEntry : public BaseLib::IQueueEntry
+	{
+	public:
+		QueueEntry() {}
+		QueueEntry(std::vector<char>& packet, bool isRequest) { this->packet = packet; this->isRequest = isRequest; }
+		QueueEntry(std::vector<char>&& packet, bool isRequest) : packet(std::move(packet)) { this->isRequest = isRequest; }
+		virtual ~QueueEntry() {}
+
+		std::vector<char> packet;
+		bool isRequest = false;
+	};
+
+	struct CoalescedCall
+	{
+		std::string methodName;
+		PArray parameters;
+		InvokeCallback callback;
+	};
+
+	/**
+	 * A message waiting to be written to the socket. Owned by the sending thread, which waits until "done" is set.
+	 */
+	struct OutgoingMessage
+	{
+		const std::vector<char>* data = nullptr;
+		const std::vector<int32_t>* fileDescriptors = nullptr;
+		bool done = false;
+		bool error = false;
+	};
+
+	struct PendingRequest
+	{
+		std::mutex mutex;
+		int32_t packetId = -1;
+		InvokeCallback callback;
+	};
+
+	/**
+	 * Maximum number of requests in flight. Must be a power of two.
+	 */
+	static const int32_t _pendingRequestSlots = 1024;
+
+	BaseLib::Output _out;
+	std::string _socketPath;
+	std::shared_ptr<FileDescriptor> _fileDescriptor;
+	std::atomic_bool _closed;
+	std::atomic_bool _stopped;
+	std::atomic_bool _disposing;
+	std::mutex _disposeMutex;
+	std::mutex _sendQueueMutex;
+	std::condition_variable _sendConditionVariable;
+	std::vector<OutgoingMessage*> _sendQueue;
+	bool _sendInProgress = false;
+	std::thread _mainThread;
+	std::thread _maintenanceThread;
+	PRpcClientInfo _dummyClientInfo;
+	std::map<std::string, std::function<PVariable(PArray& parameters)>> _localRpcMethods;
+
+	std::atomic<uint32_t> _currentPacketId;
+	std::unique_ptr<PendingRequest[]> _pendingRequests; //Indexed by packet ID
+
+	std::atomic_int _coalescingWindow;
+	std::atomic_int _maxCoalescedCalls;
+	std::thread _coalescingThread;
+	std::mutex _coalescingMutex;
+	std::condition_variable _coalescingConditionVariable;
+	std::chrono::steady_clock::time_point _coalescingDeadline;
+	std::vector<CoalescedCall> _coalescedCalls;
+
+	// {{{ Shared memory transport
+		std::atomic_bool _useSharedMemory;
+		std::atomic<uint32_t> _sharedMemoryRingSize;
+		std::atomic_bool _sharedMemoryActive;
+		std::mutex _sharedMemoryMutex;
+		std::shared_ptr<SharedMemoryTransport> _sharedMemoryTransport; //Only accessed with std::atomic_load() and std::atomic_store()
+		std::unique_ptr<Rpc::BinaryRpc> _sharedMemoryBinaryRpc; //Only used by mainThread
+	// }}}
+
+	std::unique_ptr<Rpc::BinaryRpc> _binaryRpc;
+	std::unique_ptr<Rpc::RpcDecoder> _rpcDecoder;
+	std::unique_ptr<Rpc::RpcEncoder> _rpcEncoder;
+
+	void connect();
+	void mainThread();
+	void processReceivedData(Rpc::BinaryRpc& binaryRpc, char* buffer, int32_t bufferSize);
+
+	/**
+	 * Sends data through the socket or the shared memory transport. Messages of concurrent callers are collected and written by
+	 * one of them with a single sendmsg() call.
+	 *
+	 * @param fileDescriptors Descriptors to pass to the server with SCM_RIGHTS. Messages with descriptors always use the socket.
+	 */
+	PVariable send(std::vector<char>& data, const std::vector<int32_t>* fileDescriptors = nullptr);
+
+	/**
+	 * Writes a batch of messages, setting "error" on every message that could not be written. Only one thread may call it at a
+	 * time.
+	 */
+	void writeMessages(std::vector<OutgoingMessage*>& messages);
+
+	/**
+	 * Waits until the socket is writable.
+	 *
+	 * @return Returns false on timeout or when the client is closed.
+	 */
+	bool waitForWritability();
+
+	void sendResponse(PVariable& packetId, PVariable& variable);
+	virtual void processQueueEntry(int32_t index, std::shared_ptr<IQueueEntry>& entry);
+
+	/**
+	 * Reserves a slot for a new request.
+	 *
+	 * @return Returns the packet ID of the request or "-1" when all slots are in use.
+	 */
+	int32_t addPendingRequest(InvokeCallback& callback);
+
+	/**
+	 * Frees the slot of a request and calls its callback.
+	 */
+	void finishPendingRequest(int32_t packetId, PVariable result);
+
+	/**
+	 * Finishes all pending requests with an error, e. g. when the connection was closed.
+	 */
+	void failPendingRequests();
+
+	/**
+	 * Encodes and sends a request and registers its callback.
+	 *
+	 * @param fileDescriptors Descriptors to attach to the request, see send().
+	 */
+	void sendRequest(std::string methodName, PArray& parameters, InvokeCallback& callback, const std::vector<int32_t>* fileDescriptors = nullptr);
+
+	/**
+	 * Sends the calls as one "system.multicall" request and passes each result to the callback of its call.
+	 */
+	void sendMulticall(std::shared_ptr<std::vector<CoalescedCall>> calls);
+
+	void coalescingThread();
+
+	/**
+	 * Creates a SharedMemoryTransport and offers it to the server. Called by mainThread after connecting.
+	 */
+	void offerSharedMemory();
+
+	/**
+	 * Switches back to the socket and releases the shared memory transport once no thread uses it anymore.
+	 */
+	void closeSharedMemory();
+
+	// {{{ Can be overridden by derived classes
+		virtual void onConnect() {}
+		virtual PVariable broadcastEvent(PArray& parameters) { return PVariable(new Variable()); }
+		virtual PVariable broadcastNewDevices(PArray& parameters) { return PVariable(new Variable()); }
+		virtual PVariable broadcastDeleteDevices(PArray& parameters) { return PVariable(new Variable()); }
+		virtual PVariable broadcastUpdateDevice(PArray& parameters) { return PVariable(new Variable()); }
+	// }}}
+};
+
+}
+}
+#endif
@@ -0,0 +1,182 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "SharedMemoryRing.h"
+
+#include <cstring>
+#include <new>
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace BaseLib
+{
+namespace Ipc
+{
+
+size_t SharedMemoryRing::getMemorySize(uint32_t capacity)
+{
+	static_assert(sizeof(RingHeader) <= _headerSize, "RingHeader is too large.");
+	return _headerSize + capacity;
+}
+
+SharedMemoryRing::SharedMemoryRing(void* memory, uint32_t capacity, int32_t dataEventDescriptor, int32_t spaceEventDescriptor, bool initialize)
+{
+	_header = (RingHeader*)memory;
+	_data = (char*)memory + _headerSize;
+	_capacity = capacity;
+	_mask = (uint64_t)capacity - 1;
+	_dataEventDescriptor = dataEventDescriptor;
+	_spaceEventDescriptor = spaceEventDescriptor;
+
+	if(initialize)
+	{
+		new (_header) RingHeader();
+		_header->capacity = capacity;
+		_header->readerWaiting = 0;
+		_header->writerWaiting = 0;
+		_header->writePosition = 0;
+		_header->readPosition = 0;
+	}
+}
+
+bool SharedMemoryRing::isValid()
+{
+	return _capacity > 0 && (_capacity & (_capacity - 1)) == 0 && _header->capacity == _capacity;
+}
+
+void SharedMemoryRing::signal(int32_t descriptor)
+{
+	uint64_t value = 1;
+	ssize_t result = 0;
+	do
+	{
+		result = ::write(descriptor, &value, sizeof(value));
+	} while(result == -1 && errno == EINTR);
+}
+
+void SharedMemoryRing::clearEvent(int32_t descriptor)
+{
+	uint64_t value = 0;
+	ssize_t result = 0;
+	do
+	{
+		result = ::read(descriptor, &value, sizeof(value));
+	} while(result == -1 && errno == EINTR);
+}
+
+bool SharedMemoryRing::empty()
+{
+	return _header->writePosition.load(std::memory_order_acquire) == _header->readPosition.load(std::memory_order_relaxed);
+}
+
+bool SharedMemoryRing::prepareWait()
+{
+	_header->readerWaiting.store(1);
+	if(!empty())
+	{
+		_header->readerWaiting.store(0);
+		return false;
+	}
+	return true;
+}
+
+bool SharedMemoryRing::write(const char* data, uint32_t size, int32_t timeout)
+{
+	uint32_t written = 0;
+	while(written < size)
+	{
+		uint64_t writePosition = _header->writePosition.load(std::memory_order_relaxed);
+		uint64_t readPosition = _header->readPosition.load(std::memory_order_acquire);
+		//The positions live in memory the peer can write to. Never trust them to be consistent.
+		if(writePosition - readPosition > _capacity) return false;
+		uint32_t freeSpace = _capacity - (uint32_t)(writePosition - readPosition);
+		if(freeSpace == 0)
+		{
+			//Ring is full. Wait until the reader frees space.
+			_header->writerWaiting.store(1);
+			if(_header->readPosition.load() != readPosition)
+			{
+				_header->writerWaiting.store(0);
+				continue;
+			}
+			pollfd pollInfo;
+			pollInfo.fd = _spaceEventDescriptor;
+			pollInfo.events = POLLIN;
+			pollInfo.revents = 0;
+			int32_t result = 0;
+			do
+			{
+				result = poll(&pollInfo, 1, timeout);
+			} while(result == -1 && errno == EINTR);
+			_header->writerWaiting.store(0);
+			if(result <= 0) return false;
+			clearEvent(_spaceEventDescriptor);
+			continue;
+		}
+
+		uint32_t bytesToWrite = size - written;
+		if(bytesToWrite > freeSpace) bytesToWrite = freeSpace;
+		uint32_t offset = writePosition & _mask;
+		uint32_t firstPart = _capacity - offset;
+		if(firstPart > bytesToWrite) firstPart = bytesToWrite;
+		memcpy(_data + offset, data + written, firstPart);
+		if(firstPart < bytesToWrite) memcpy(_data, data + written + firstPart, bytesToWrite - firstPart);
+		_header->writePosition.store(writePosition + bytesToWrite);
+		written += bytesToWrite;
+
+		if(_header->readerWaiting.exchange(0) == 1) signal(_dataEventDescriptor);
+	}
+	return true;
+}
+
+uint32_t SharedMemoryRing::read(char* buffer, uint32_t size)
+{
+	uint64_t readPosition = _header->readPosition.load(std::memory_order_relaxed);
+	uint64_t writePosition = _header->writePosition.load(std::memory_order_acquire);
+	if(writePosition - readPosition > _capacity) return 0;
+	uint32_t available = (uint32_t)(writePosition - readPosition);
+	if(available == 0 || size == 0) return 0;
+
+	uint32_t bytesToRead = available < size ? available : size;
+	uint32_t offset = readPosition & _mask;
+	uint32_t firstPart = _capacity - offset;
+	if(firstPart > bytesToRead) firstPart = bytesToRead;
+	memcpy(buffer, _data + offset, firstPart);
+	if(firstPart < bytesToRead) memcpy(buffer + firstPart, _data, bytesToRead - firstPart);
+	_header->readPosition.store(readPosition + bytesToRead);
+
+	if(_header->writerWaiting.exchange(0) == 1) signal(_spaceEventDescriptor);
+	return bytesToRead;
+}
+
+}
+}
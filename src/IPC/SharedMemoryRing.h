@@ -0,0 +1,138 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef SHAREDMEMORYRING_H_
+#define SHAREDMEMORYRING_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace BaseLib
+{
+namespace Ipc
+{
+
+/**
+ * Single producer, single consumer byte ring in shared memory, used to transport the RPC stream between two processes on the
+ * same host. The ring does not own the memory or the event descriptors, see SharedMemoryTransport.
+ *
+ * Two eventfds are used for wakeups: "dataEventDescriptor" is signaled when data was written while the reader was waiting and
+ * "spaceEventDescriptor" is signaled when data was read while the writer was waiting for free space. Without waiting peers no
+ * system calls are made.
+ */
+class SharedMemoryRing
+{
+public:
+	/**
+	 * Returns the number of bytes of shared memory needed for a ring with the given capacity.
+	 */
+	static size_t getMemorySize(uint32_t capacity);
+
+	/**
+	 * @param memory Pointer to shared memory of at least getMemorySize(capacity) bytes.
+	 * @param capacity The capacity of the ring in bytes. Must be a power of two.
+	 * @param dataEventDescriptor eventfd signaled when new data is available.
+	 * @param spaceEventDescriptor eventfd signaled when space became available.
+	 * @param initialize Set to true by the side creating the shared memory.
+	 */
+	SharedMemoryRing(void* memory, uint32_t capacity, int32_t dataEventDescriptor, int32_t spaceEventDescriptor, bool initialize);
+	virtual ~SharedMemoryRing() {}
+
+	/**
+	 * Returns false when the shared memory was not initialized with the expected capacity.
+	 */
+	bool isValid();
+
+	uint32_t capacity() { return _capacity; }
+	int32_t dataEventDescriptor() { return _dataEventDescriptor; }
+	int32_t spaceEventDescriptor() { return _spaceEventDescriptor; }
+
+	/**
+	 * Writes all data to the ring and waits for free space if necessary. Only one thread may write at a time.
+	 *
+	 * @param data The data to write.
+	 * @param size The number of bytes to write.
+	 * @param timeout Maximum time in milliseconds to wait for free space.
+	 * @return Returns false on timeout or when the peer corrupted the ring.
+	 */
+	bool write(const char* data, uint32_t size, int32_t timeout);
+
+	/**
+	 * Reads up to "size" bytes without waiting. Only one thread may read at a time.
+	 *
+	 * @return Returns the number of bytes read. Returns "0" when the peer corrupted the ring.
+	 */
+	uint32_t read(char* buffer, uint32_t size);
+
+	bool empty();
+
+	/**
+	 * Marks the reader as waiting. Must be called before waiting on dataEventDescriptor().
+	 *
+	 * @return Returns false when data arrived in the meantime and the reader should not wait.
+	 */
+	bool prepareWait();
+
+	/**
+	 * Resets an eventfd after it was signaled.
+	 */
+	static void clearEvent(int32_t descriptor);
+private:
+	struct RingHeader
+	{
+		uint32_t capacity;
+		std::atomic<uint32_t> readerWaiting;
+		std::atomic<uint32_t> writerWaiting;
+		char padding1[52];
+		std::atomic<uint64_t> writePosition;
+		char padding2[56];
+		std::atomic<uint64_t> readPosition;
+		char padding3[56];
+	};
+
+	static const size_t _headerSize = 256;
+
+	RingHeader* _header = nullptr;
+	char* _data = nullptr;
+	uint32_t _capacity = 0;
+	uint64_t _mask = 0;
+	int32_t _dataEventDescriptor = -1;
+	int32_t _spaceEventDescriptor = -1;
+
+	SharedMemoryRing(const SharedMemoryRing&);
+	SharedMemoryRing& operator=(const SharedMemoryRing&);
+
+	static void signal(int32_t descriptor);
+};
+
+}
+}
+#endif
@@ -0,0 +1,187 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "SharedMemoryTransport.h"
+#include "../Exception.h"
+
+#include <cstring>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+namespace BaseLib
+{
+namespace Ipc
+{
+
+uint32_t SharedMemoryTransport::getRingSize(uint32_t requestedSize)
+{
+	uint32_t size = 4096;
+	while(size < requestedSize && size < 0x40000000) size <<= 1;
+	return size;
+}
+
+size_t SharedMemoryTransport::getMemorySize(uint32_t ringSize)
+{
+	//Page aligned, so the second ring starts on its own page
+	return (SharedMemoryRing::getMemorySize(ringSize) + 4095) & ~(size_t)4095;
+}
+
+std::shared_ptr<SharedMemoryTransport> SharedMemoryTransport::create(uint32_t ringSize)
+{
+	std::shared_ptr<SharedMemoryTransport> transport(new SharedMemoryTransport());
+	if(ringSize != getRingSize(ringSize)) throw Exception("Invalid ring size.");
+	transport->_ringSize = ringSize;
+	transport->_memorySize = getMemorySize(ringSize) * 2;
+#ifdef __NR_memfd_create
+	transport->_memoryDescriptor = syscall(__NR_memfd_create, "homegear-ipc", 3 /* MFD_CLOEXEC | MFD_ALLOW_SEALING */);
+#endif
+	if(transport->_memoryDescriptor == -1) throw Exception("Could not create shared memory: " + std::string(strerror(errno)));
+	if(ftruncate(transport->_memoryDescriptor, transport->_memorySize) == -1) throw Exception("Could not resize shared memory: " + std::string(strerror(errno)));
+#ifdef F_ADD_SEALS
+	//The server maps the memory, too. Make sure it can't be truncated below the server's mapping.
+	if(fcntl(transport->_memoryDescriptor, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1) throw Exception("Could not seal shared memory: " + std::string(strerror(errno)));
+#endif
+	for(int32_t i = 0; i < 4; i++)
+	{
+		transport->_eventDescriptors[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if(transport->_eventDescriptors[i] == -1) throw Exception("Could not create eventfd: " + std::string(strerror(errno)));
+	}
+	transport->map(false);
+	return transport;
+}
+
+std::shared_ptr<SharedMemoryTransport> SharedMemoryTransport::attach(const std::vector<int32_t>& descriptors, uint32_t ringSize)
+{
+	std::shared_ptr<SharedMemoryTransport> transport(new SharedMemoryTransport());
+	for(int32_t i = 0; i < (signed)descriptors.size(); i++)
+	{
+		if(i == 0) transport->_memoryDescriptor = descriptors[i];
+		else if(i <= 4) transport->_eventDescriptors[i - 1] = descriptors[i];
+		else ::close(descriptors[i]);
+	}
+	if((signed)descriptors.size() != descriptorCount) throw Exception("Wrong number of descriptors.");
+	if(ringSize != getRingSize(ringSize)) throw Exception("Invalid ring size.");
+	transport->_ringSize = ringSize;
+	transport->_memorySize = getMemorySize(ringSize) * 2;
+
+	struct stat memoryInfo;
+	if(fstat(transport->_memoryDescriptor, &memoryInfo) == -1 || memoryInfo.st_size < (off_t)transport->_memorySize) throw Exception("Shared memory is too small.");
+#ifdef F_GET_SEALS
+	int32_t seals = fcntl(transport->_memoryDescriptor, F_GET_SEALS);
+	if(seals == -1 || !(seals & F_SEAL_SHRINK)) throw Exception("Shared memory is not sealed against shrinking.");
+#endif
+	transport->map(true);
+	if(!transport->_sendRing->isValid() || !transport->_receiveRing->isValid()) throw Exception("Shared memory does not contain rings of the given size.");
+	return transport;
+}
+
+ssize_t SharedMemoryTransport::receive(int32_t socketDescriptor, char* buffer, size_t size, std::vector<int32_t>& descriptors)
+{
+	iovec ioVector;
+	ioVector.iov_base = buffer;
+	ioVector.iov_len = size;
+	char control[CMSG_SPACE(sizeof(int32_t) * descriptorCount)];
+	msghdr message;
+	memset(&message, 0, sizeof(message));
+	message.msg_iov = &ioVector;
+	message.msg_iovlen = 1;
+	message.msg_control = control;
+	message.msg_controllen = sizeof(control);
+	ssize_t result = 0;
+	do
+	{
+		result = recvmsg(socketDescriptor, &message, MSG_CMSG_CLOEXEC);
+	} while(result == -1 && errno == EINTR);
+	if(result <= 0) return result;
+
+	for(cmsghdr* controlMessage = CMSG_FIRSTHDR(&message); controlMessage; controlMessage = CMSG_NXTHDR(&message, controlMessage))
+	{
+		if(controlMessage->cmsg_level != SOL_SOCKET || controlMessage->cmsg_type != SCM_RIGHTS) continue;
+		size_t count = (controlMessage->cmsg_len - CMSG_LEN(0)) / sizeof(int32_t);
+		for(size_t i = 0; i < count; i++)
+		{
+			int32_t descriptor = -1;
+			memcpy(&descriptor, CMSG_DATA(controlMessage) + i * sizeof(int32_t), sizeof(int32_t));
+			descriptors.push_back(descriptor);
+		}
+	}
+	return result;
+}
+
+SharedMemoryTransport::~SharedMemoryTransport()
+{
+	_sendRing.reset();
+	_receiveRing.reset();
+	if(_memory) munmap(_memory, _memorySize);
+	if(_memoryDescriptor != -1) ::close(_memoryDescriptor);
+	for(int32_t i = 0; i < 4; i++)
+	{
+		if(_eventDescriptors[i] != -1) ::close(_eventDescriptors[i]);
+	}
+}
+
+std::vector<int32_t> SharedMemoryTransport::descriptors()
+{
+	return std::vector<int32_t>{ _memoryDescriptor, _eventDescriptors[0], _eventDescriptors[1], _eventDescriptors[2], _eventDescriptors[3] };
+}
+
+void SharedMemoryTransport::map(bool server)
+{
+	_memory = mmap(nullptr, _memorySize, PROT_READ | PROT_WRITE, MAP_SHARED, _memoryDescriptor, 0);
+	if(_memory == MAP_FAILED)
+	{
+		_memory = nullptr;
+		throw Exception("Could not map shared memory: " + std::string(strerror(errno)));
+	}
+
+	//The first ring transports data from the client to the server, the second one from the server to the client.
+	std::unique_ptr<SharedMemoryRing> clientToServer(new SharedMemoryRing(_memory, _ringSize, _eventDescriptors[0], _eventDescriptors[1], !server));
+	std::unique_ptr<SharedMemoryRing> serverToClient(new SharedMemoryRing((char*)_memory + getMemorySize(_ringSize), _ringSize, _eventDescriptors[2], _eventDescriptors[3], !server));
+	if(server)
+	{
+		_sendRing.swap(serverToClient);
+		_receiveRing.swap(clientToServer);
+	}
+	else
+	{
+		_sendRing.swap(clientToServer);
+		_receiveRing.swap(serverToClient);
+	}
+}
+
+}
+}
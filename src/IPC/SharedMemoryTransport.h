@@ -0,0 +1,123 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef SHAREDMEMORYTRANSPORT_H_
+#define SHAREDMEMORYTRANSPORT_H_
+
+#include "SharedMemoryRing.h"
+
+#include <memory>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace BaseLib
+{
+namespace Ipc
+{
+
+/**
+ * Owns the shared memory and the eventfds of a pair of SharedMemoryRings, one for each direction.
+ *
+ * The client creates the transport with create() and passes descriptors() to the server with SCM_RIGHTS (see
+ * IIpcClient::setSharedMemoryTransport()). The server receives them with receive() and maps the same rings with attach().
+ * The descriptors are ordered as follows: shared memory, client to server data, client to server space, server to client
+ * data, server to client space.
+ */
+class SharedMemoryTransport
+{
+public:
+	static const int32_t descriptorCount = 5;
+
+	/**
+	 * Rounds a requested ring size up to a power of two between 4 KiB and 1 GiB.
+	 */
+	static uint32_t getRingSize(uint32_t requestedSize);
+
+	/**
+	 * Creates the shared memory and the eventfds and initializes both rings. Used by the client.
+	 *
+	 * @param ringSize The size of each ring in bytes. Must be a value returned by getRingSize().
+	 * @throws Exception Thrown when the shared memory or an eventfd could not be created.
+	 */
+	static std::shared_ptr<SharedMemoryTransport> create(uint32_t ringSize);
+
+	/**
+	 * Maps the rings created by a client. Used by the server. The transport takes ownership of the descriptors, they are also
+	 * closed when an exception is thrown.
+	 *
+	 * @param descriptors The descriptors received from the client in the order returned by descriptors().
+	 * @param ringSize The ring size the client passed to "enableSharedMemoryTransport".
+	 * @throws Exception Thrown when the descriptors don't describe valid rings of the given size.
+	 */
+	static std::shared_ptr<SharedMemoryTransport> attach(const std::vector<int32_t>& descriptors, uint32_t ringSize);
+
+	/**
+	 * Reads from a Unix domain socket like read() and collects file descriptors passed with SCM_RIGHTS. The received descriptors
+	 * are appended to "descriptors" and are owned by the caller.
+	 *
+	 * @return Returns the result of recvmsg().
+	 */
+	static ssize_t receive(int32_t socketDescriptor, char* buffer, size_t size, std::vector<int32_t>& descriptors);
+
+	virtual ~SharedMemoryTransport();
+
+	uint32_t ringSize() { return _ringSize; }
+	std::vector<int32_t> descriptors();
+
+	/**
+	 * The ring this side writes to. Only one thread may write at a time.
+	 */
+	SharedMemoryRing& sendRing() { return *_sendRing; }
+
+	/**
+	 * The ring this side reads from. Only one thread may read at a time.
+	 */
+	SharedMemoryRing& receiveRing() { return *_receiveRing; }
+private:
+	uint32_t _ringSize = 0;
+	int32_t _memoryDescriptor = -1;
+	void* _memory = nullptr;
+	size_t _memorySize = 0;
+	int32_t _eventDescriptors[4] = { -1, -1, -1, -1 };
+	std::unique_ptr<SharedMemoryRing> _sendRing;
+	std::unique_ptr<SharedMemoryRing> _receiveRing;
+
+	SharedMemoryTransport() {}
+	SharedMemoryTransport(const SharedMemoryTransport&);
+	SharedMemoryTransport& operator=(const SharedMemoryTransport&);
+
+	static size_t getMemorySize(uint32_t ringSize);
+	void map(bool server);
+};
+
+}
+}
+#endif
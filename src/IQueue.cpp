@@ -31,29 +31,122 @@
 #include "IQueue.h"
 #include "BaseLib.h"
 
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
 namespace BaseLib
 {
 
+static_assert(sizeof(std::atomic<int32_t>) == sizeof(int32_t), "std::atomic<int32_t> can't be used as futex word.");
+
+static void futexWait(std::atomic<int32_t>* word, int32_t expectedValue, int32_t timeoutMs)
+{
+	struct timespec timeout;
+	timeout.tv_sec = timeoutMs / 1000;
+	timeout.tv_nsec = (timeoutMs % 1000) * 1000000;
+	syscall(SYS_futex, (int32_t*)word, FUTEX_WAIT_PRIVATE, expectedValue, &timeout, nullptr, 0);
+}
+
+static void futexWake(std::atomic<int32_t>* word, int32_t count)
+{
+	syscall(SYS_futex, (int32_t*)word, FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+IQueue::LockFreeRing::LockFreeRing(uint32_t capacity)
+{
+	_capacity = capacity > 0 ? capacity : 1;
+	_cells.reset(new Cell[_capacity]);
+	clear();
+}
+
+void IQueue::LockFreeRing::clear()
+{
+	for(uint32_t i = 0; i < _capacity; i++)
+	{
+		_cells[i].sequence.store(i, std::memory_order_relaxed);
+		_cells[i].entry.reset();
+	}
+	_enqueuePosition.store(0);
+	_dequeuePosition.store(0);
+}
+
+int32_t IQueue::LockFreeRing::size()
+{
+	uint64_t dequeuePosition = _dequeuePosition.load();
+	uint64_t enqueuePosition = _enqueuePosition.load();
+	return enqueuePosition > dequeuePosition ? (int32_t)(enqueuePosition - dequeuePosition) : 0;
+}
+
+bool IQueue::LockFreeRing::push(std::shared_ptr<IQueueEntry>& entry)
+{
+	uint64_t position = _enqueuePosition.load(std::memory_order_relaxed);
+	while(true)
+	{
+		Cell& cell = _cells[position % _capacity];
+		uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+		int64_t difference = (int64_t)sequence - (int64_t)position;
+		if(difference == 0)
+		{
+			if(_enqueuePosition.compare_exchange_weak(position, position + 1))
+			{
+				cell.entry = entry;
+				cell.sequence.store(position + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if(difference < 0) return false; //Full
+		else position = _enqueuePosition.load(std::memory_order_relaxed);
+	}
+}
+
+bool IQueue::LockFreeRing::pop(std::shared_ptr<IQueueEntry>& entry)
+{
+	uint64_t position = _dequeuePosition.load(std::memory_order_relaxed);
+	while(true)
+	{
+		Cell& cell = _cells[position % _capacity];
+		uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+		int64_t difference = (int64_t)sequence - (int64_t)(position + 1);
+		if(difference == 0)
+		{
+			if(_dequeuePosition.compare_exchange_weak(position, position + 1))
+			{
+				entry = std::move(cell.entry);
+				cell.entry.reset();
+				cell.sequence.store(position + _capacity, std::memory_order_release);
+				return true;
+			}
+		}
+		else if(difference < 0) return false; //Empty
+		else position = _dequeuePosition.load(std::memory_order_relaxed);
+	}
+}
+
 IQueue::IQueue(SharedObjects* baseLib, uint32_t queueCount, uint32_t bufferSize) : IQueueBase(baseLib, queueCount)
 {
 	if(bufferSize < 2000000000) _bufferSize = (int32_t)bufferSize;
 
-	_bufferHead.resize(queueCount);
-	_bufferTail.resize(queueCount);
 	_bufferCount.resize(queueCount, 0);
 	_waitWhenFull.resize(queueCount);
-	_buffer.resize(queueCount);
 	_queueMutex.reset(new std::mutex[queueCount]);
 	_processingThread.resize(queueCount);
 	_produceConditionVariable.reset(new std::condition_variable[queueCount]);
 	_processingConditionVariable.reset(new std::condition_variable[queueCount]);
+	_lockFree.resize(queueCount, false);
+	_parkingState.reset(new ParkingState[queueCount]);
+	_lanes.resize(queueCount);
+	_dropExpiredEntries.resize(queueCount, true);
+	_currentLane.resize(queueCount, 0);
+	_laneCredits.resize(queueCount, 0);
+	_maxBatchSize.reset(new std::atomic<uint32_t>[queueCount]);
 
 	for(int32_t i = 0; i < _queueCount; i++)
 	{
-		_bufferHead[i] = 0;
-		_bufferTail[i] = 0;
+		_maxBatchSize[i] = 1;
 		_bufferCount[i] = 0;
 		_stopProcessingThread[i] = true;
+		_lanes[i].push_back(std::make_shared<Lane>());
 	}
 }
 
@@ -62,35 +155,115 @@ IQueue::~IQueue()
 	for(int32_t i = 0; i < _queueCount; i++)
 	{
 		stopQueue(i);
-		_buffer[i].clear();
+		_lanes[i].clear();
 	}
 }
 
 int32_t IQueue::queueSize(int32_t index)
 {
+	if(_lockFree[index])
+	{
+		int32_t size = 0;
+		for(auto& lane : _lanes[index])
+		{
+			if(lane->ring) size += lane->ring->size();
+		}
+		return size;
+	}
 	return _bufferCount[index];
 }
 
+void IQueue::setMaxBatchSize(int32_t index, uint32_t maxBatchSize)
+{
+	if(index < 0 || index >= _queueCount) return;
+	_maxBatchSize[index] = maxBatchSize > 0 ? maxBatchSize : 1;
+}
+
+void IQueue::setLanes(int32_t index, const std::vector<uint32_t>& weights, bool dropExpiredEntries)
+{
+	if(index < 0 || index >= _queueCount || weights.empty()) return;
+	if(!_stopProcessingThread[index])
+	{
+		_bl->out.printError("Error: Lanes of queue " + std::to_string(index) + " can't be changed while the queue is running.");
+		return;
+	}
+	_lanes[index].clear();
+	for(auto weight : weights)
+	{
+		std::shared_ptr<Lane> lane = std::make_shared<Lane>();
+		lane->weight = weight > 0 ? weight : 1;
+		_lanes[index].push_back(lane);
+	}
+	_dropExpiredEntries[index] = dropExpiredEntries;
+}
+
+std::vector<IQueue::LaneStatistics> IQueue::getLaneStatistics(int32_t index)
+{
+	std::vector<LaneStatistics> statistics;
+	if(index < 0 || index >= _queueCount) return statistics;
+	std::lock_guard<std::mutex> queueGuard(_queueMutex[index]);
+	statistics.reserve(_lanes[index].size());
+	for(auto& lane : _lanes[index])
+	{
+		LaneStatistics laneStatistics;
+		laneStatistics.weight = lane->weight;
+		laneStatistics.size = _lockFree[index] ? (lane->ring ? lane->ring->size() : 0) : lane->count;
+		laneStatistics.enqueued = lane->enqueued;
+		laneStatistics.processed = lane->processed;
+		laneStatistics.expired = lane->expired;
+		laneStatistics.rejected = lane->rejected;
+		statistics.push_back(laneStatistics);
+	}
+	return statistics;
+}
+
+void IQueue::processQueueEntries(int32_t index, std::vector<std::shared_ptr<IQueueEntry>>& entries)
+{
+	for(auto& entry : entries)
+	{
+		processQueueEntry(index, entry);
+	}
+}
+
 bool IQueue::queueEmpty(int32_t index)
 {
-	return _bufferCount[index] > 0;
+	return queueSize(index) > 0;
 }
 
-void IQueue::startQueue(int32_t index, bool waitWhenFull, uint32_t processingThreadCount, int32_t threadPriority, int32_t threadPolicy)
+void IQueue::startQueue(int32_t index, bool waitWhenFull, uint32_t processingThreadCount, int32_t threadPriority, int32_t threadPolicy, bool lockFree)
 {
 	if(index < 0 || index >= _queueCount) return;
-	_stopProcessingThread[index] = false;
-	_bufferHead[index] = 0;
-	_bufferTail[index] = 0;
 	_bufferCount[index] = 0;
+	_currentLane[index] = 0;
+	_laneCredits[index] = _lanes[index].front()->weight;
 	_waitWhenFull[index] = waitWhenFull;
+	_lockFree[index] = lockFree;
+	ParkingState& parkingState = _parkingState[index];
+	parkingState.itemsAvailable = 0;
+	parkingState.spaceAvailable = 0;
+	parkingState.consumersWaiting = 0;
+	parkingState.producersWaiting = 0;
+	for(auto& lane : _lanes[index])
+	{
+		lane->head = 0;
+		lane->tail = 0;
+		lane->count = 0;
+		if(lockFree)
+		{
+			if(!lane->ring) lane->ring.reset(new LockFreeRing(_bufferSize));
+			else lane->ring->clear();
+		}
+		else lane->buffer.resize(_bufferSize);
+	}
+	_stopProcessingThread[index] = false;
+	std::string threadName = getThreadName();
 	for(uint32_t i = 0; i < processingThreadCount; i++)
 	{
 		std::shared_ptr<std::thread> thread(new std::thread());
-		_bl->threadManager.start(*thread, true, threadPriority, threadPolicy, &IQueue::process, this, index);
+		if(lockFree) _bl->threadManager.start(threadName, ThreadManager::ThreadCategory::worker, *thread, true, threadPriority, threadPolicy, &IQueue::processLockFree, this, index);
+		else _bl->threadManager.start(threadName, ThreadManager::ThreadCategory::worker, *thread, true, threadPriority, threadPolicy, &IQueue::process, this, index);
 		_processingThread[index].push_back(thread);
 	}
-	_buffer.at(index).resize(_bufferSize);
 }
 
 void IQueue::stopQueue(int32_t index)
@@ -102,13 +275,42 @@ void IQueue::stopQueue(int32_t index)
 	lock.unlock();
 	_processingConditionVariable[index].notify_all();
 	_produceConditionVariable[index].notify_all();
+	if(_lockFree[index])
+	{
+		ParkingState& parkingState = _parkingState[index];
+		parkingState.itemsAvailable++;
+		parkingState.spaceAvailable++;
+		futexWake(&parkingState.itemsAvailable, INT_MAX);
+		futexWake(&parkingState.spaceAvailable, INT_MAX);
+	}
 	for(uint32_t i = 0; i < _processingThread[index].size(); i++)
 	{
 		_bl->threadManager.join(*(_processingThread[index][i]));
 	}
 	_processingThread[index].clear();
-	_buffer[index].clear();
+	for(auto& lane : _lanes[index])
+	{
+		lane->buffer.clear();
+		if(lane->ring)
+		{
+			std::shared_ptr<IQueueEntry> entry;
+			while(lane->ring->pop(entry)) entry.reset();
+		}
+	}
+}
 
+uint32_t IQueue::getLane(int32_t index, std::shared_ptr<IQueueEntry>& entry)
+{
+	uint32_t lane = entry->getPriority();
+	return lane < _lanes[index].size() ? lane : _lanes[index].size() - 1;
+}
+
+bool IQueue::isExpired(int32_t index, uint32_t lane, std::shared_ptr<IQueueEntry>& entry)
+{
+	int64_t deadline = entry->getDeadline();
+	if(deadline == 0 || HelperFunctions::getTime() <= deadline) return false;
+	_lanes[index][lane]->expired++;
+	return _dropExpiredEntries[index];
 }
 
 bool IQueue::enqueue(int32_t index, std::shared_ptr<IQueueEntry>& entry, bool waitWhenFull)
@@ -116,17 +318,25 @@ bool IQueue::enqueue(int32_t index, std::shared_ptr<IQueueEntry>& entry, bool wa
 	try
 	{
 		if(index < 0 || index >= _queueCount || !entry || _stopProcessingThread[index]) return true;
+		if(_lockFree[index]) return enqueueLockFree(index, entry, _waitWhenFull[index] || waitWhenFull);
+		Lane& lane = *_lanes[index][getLane(index, entry)];
 		std::unique_lock<std::mutex> lock(_queueMutex[index]);
 		if(_waitWhenFull[index] || waitWhenFull)
 		{
-			_produceConditionVariable[index].wait(lock, [&]{ return _bufferCount[index] < _bufferSize || _stopProcessingThread[index]; });
+			_produceConditionVariable[index].wait(lock, [&]{ return lane.count < _bufferSize || _stopProcessingThread[index]; });
 			if(_stopProcessingThread[index]) return true;
 		}
-		else if(_bufferCount[index] >= _bufferSize) return false;
+		else if(lane.count >= _bufferSize)
+		{
+			lane.rejected++;
+			return false;
+		}
 
-		_buffer[index][_bufferTail[index]] = entry;
-		_bufferTail[index] = (_bufferTail[index] + 1) % _bufferSize;
+		lane.buffer[lane.tail] = entry;
+		lane.tail = (lane.tail + 1) % _bufferSize;
+		++lane.count;
 		++(_bufferCount[index]);
+		lane.enqueued++;
 
 		lock.unlock();
 		_processingConditionVariable[index].notify_one();
@@ -147,9 +357,33 @@ bool IQueue::enqueue(int32_t index, std::shared_ptr<IQueueEntry>& entry, bool wa
 	return false;
 }
 
+std::shared_ptr<IQueueEntry> IQueue::takeEntry(int32_t index, uint32_t& lane)
+{
+	std::vector<std::shared_ptr<Lane>>& lanes = _lanes[index];
+	lane = _currentLane[index];
+	while(lanes[lane]->count == 0 || _laneCredits[index] == 0)
+	{
+		lane = (lane + 1) % lanes.size();
+		_currentLane[index] = lane;
+		_laneCredits[index] = lanes[lane]->weight;
+	}
+	_laneCredits[index]--;
+
+	Lane& currentLane = *lanes[lane];
+	std::shared_ptr<IQueueEntry> entry = std::move(currentLane.buffer[currentLane.head]);
+	currentLane.buffer[currentLane.head].reset();
+	currentLane.head = (currentLane.head + 1) % _bufferSize;
+	--currentLane.count;
+	--_bufferCount[index];
+	return entry;
+}
+
 void IQueue::process(int32_t index)
 {
 	if(index < 0 || index >= _queueCount) return;
+	std::vector<std::shared_ptr<IQueueEntry>> entries;
+	//Producers might wait for space in a specific lane, so with multiple lanes all of them need to be woken up.
+	bool notifyAll = _lanes[index].size() > 1;
 	while(!_stopProcessingThread[index])
 	{
 		try
@@ -161,18 +395,43 @@ void IQueue::process(int32_t index)
 
 			do
 			{
-				std::shared_ptr<IQueueEntry> entry;
+				uint32_t maxBatchSize = _maxBatchSize[index];
+				uint32_t lane = 0;
+				if(maxBatchSize <= 1)
+				{
+					std::shared_ptr<IQueueEntry> entry = takeEntry(index, lane);
+
+					lock.unlock();
+
+					if(notifyAll) _produceConditionVariable[index].notify_all();
+					else _produceConditionVariable[index].notify_one();
 
-				entry = _buffer[index][_bufferHead[index]];
-				_buffer[index][_bufferHead[index]].reset();
-				_bufferHead[index] = (_bufferHead[index] + 1) % _bufferSize;
-				--_bufferCount[index];
+					if(entry && !isExpired(index, lane, entry))
+					{
+						_lanes[index][lane]->processed++;
+						processQueueEntry(index, entry);
+					}
+				}
+				else
+				{
+					entries.clear();
+					while(_bufferCount[index] > 0 && entries.size() < maxBatchSize)
+					{
+						std::shared_ptr<IQueueEntry> entry = takeEntry(index, lane);
+						if(entry && !isExpired(index, lane, entry))
+						{
+							_lanes[index][lane]->processed++;
+							entries.push_back(std::move(entry));
+						}
+					}
 
-				lock.unlock();
+					lock.unlock();
 
-				_produceConditionVariable[index].notify_one();
+					_produceConditionVariable[index].notify_all();
 
-				if(entry) processQueueEntry(index, entry);
+					if(!entries.empty()) processQueueEntries(index, entries);
+					entries.clear();
+				}
 
 				lock.lock();
 			} while(_bufferCount[index] > 0 && !_stopProcessingThread[index]);
@@ -192,4 +451,123 @@ void IQueue::process(int32_t index)
 	}
 }
 
+bool IQueue::enqueueLockFree(int32_t index, std::shared_ptr<IQueueEntry>& entry, bool waitWhenFull)
+{
+	Lane& lane = *_lanes[index][getLane(index, entry)];
+	LockFreeRing& ring = *lane.ring;
+	ParkingState& parkingState = _parkingState[index];
+	while(!ring.push(entry))
+	{
+		if(!waitWhenFull)
+		{
+			lane.rejected++;
+			return false;
+		}
+		if(_stopProcessingThread[index]) return true;
+
+		int32_t spaceAvailable = parkingState.spaceAvailable.load();
+		parkingState.producersWaiting++;
+		//Check again after announcing the waiting producer. Otherwise a consumer might not see it and never wake us up.
+		if(ring.size() >= (signed)ring.capacity() && !_stopProcessingThread[index]) futexWait(&parkingState.spaceAvailable, spaceAvailable, 1000);
+		parkingState.producersWaiting--;
+	}
+	lane.enqueued++;
+
+	parkingState.itemsAvailable++;
+	if(parkingState.consumersWaiting.load() > 0) futexWake(&parkingState.itemsAvailable, 1);
+	return true;
+}
+
+bool IQueue::popLockFree(int32_t index, std::shared_ptr<IQueueEntry>& entry, uint32_t& lane, uint32_t& currentLane, uint32_t& credits)
+{
+	std::vector<std::shared_ptr<Lane>>& lanes = _lanes[index];
+	//Visiting every lane once more than there are lanes guarantees each lane was tried with fresh credits.
+	for(uint32_t i = 0; i <= lanes.size(); i++)
+	{
+		if(credits > 0 && lanes[currentLane]->ring->pop(entry))
+		{
+			credits--;
+			lane = currentLane;
+			return true;
+		}
+		currentLane = (currentLane + 1) % lanes.size();
+		credits = lanes[currentLane]->weight;
+	}
+	return false;
+}
+
+void IQueue::processLockFree(int32_t index)
+{
+	if(index < 0 || index >= _queueCount) return;
+	ParkingState& parkingState = _parkingState[index];
+	int32_t spinCount = 0;
+	uint32_t currentLane = 0;
+	uint32_t credits = _lanes[index].front()->weight;
+	std::vector<std::shared_ptr<IQueueEntry>> entries;
+	while(!_stopProcessingThread[index])
+	{
+		try
+		{
+			uint32_t maxBatchSize = _maxBatchSize[index];
+			std::shared_ptr<IQueueEntry> entry;
+			uint32_t lane = 0;
+			int32_t popped = 0;
+			entries.clear();
+			while(entries.size() < maxBatchSize && popLockFree(index, entry, lane, currentLane, credits))
+			{
+				popped++;
+				if(entry && !isExpired(index, lane, entry))
+				{
+					_lanes[index][lane]->processed++;
+					entries.push_back(std::move(entry));
+				}
+				entry.reset();
+			}
+			if(popped > 0)
+			{
+				if(parkingState.producersWaiting.load() > 0)
+				{
+					//Only wake as many producers as there are free cells. Waking all of them lets most of them find the ring
+					//full again, which made the ring several times slower than the mutex with multiple producers.
+					parkingState.spaceAvailable++;
+					futexWake(&parkingState.spaceAvailable, popped);
+				}
+				spinCount = 0;
+				if(entries.empty()) continue;
+				if(maxBatchSize <= 1) processQueueEntry(index, entries.front());
+				else processQueueEntries(index, entries);
+				entries.clear();
+				continue;
+			}
+
+			//Spin shortly before parking, as a futex wait and wake cost two system calls.
+			if(spinCount < 100)
+			{
+				spinCount++;
+				std::this_thread::yield();
+				continue;
+			}
+			spinCount = 0;
+
+			int32_t itemsAvailable = parkingState.itemsAvailable.load();
+			parkingState.consumersWaiting++;
+			//Check again after announcing the waiting consumer. Otherwise a producer might not see it and never wake us up.
+			if(queueSize(index) == 0 && !_stopProcessingThread[index]) futexWait(&parkingState.itemsAvailable, itemsAvailable, 1000);
+			parkingState.consumersWaiting--;
+		}
+		catch(const std::exception& ex)
+		{
+			_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+		}
+		catch(const BaseLib::Exception& ex)
+		{
+			_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+		}
+		catch(...)
+		{
+			_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+		}
+	}
+}
+
 }
@@ -44,32 +44,222 @@ class IQueueEntry
 public:
 	IQueueEntry() {};
 	virtual ~IQueueEntry() {};
+
+	/**
+	 * The lane the entry is placed in. Values greater than the last lane index are placed in the last lane.
+	 *
+	 * @see IQueue::setLanes()
+	 */
+	uint32_t getPriority() { return _priority; }
+	void setPriority(uint32_t value) { _priority = value; }
+
+	/**
+	 * The time in milliseconds (as returned by HelperFunctions::getTime()) after which the entry is expired. 0 means no
+	 * deadline.
+	 */
+	int64_t getDeadline() { return _deadline; }
+	void setDeadline(int64_t value) { _deadline = value; }
+private:
+	uint32_t _priority = 0;
+	int64_t _deadline = 0;
 };
 
 class IQueue : public IQueueBase
 {
 public:
+	struct LaneStatistics
+	{
+		uint32_t weight = 1;
+		int32_t size = 0;
+		uint64_t enqueued = 0;
+		uint64_t processed = 0;
+		uint64_t expired = 0;
+		uint64_t rejected = 0;
+	};
+
 	IQueue(SharedObjects* baseLib, uint32_t queueCount, uint32_t bufferSize);
 	virtual ~IQueue();
-	void startQueue(int32_t index, bool waitWhenFull, uint32_t processingThreadCount, int32_t threadPriority, int32_t threadPolicy);
+	/**
+	 * Starts the processing threads of a queue.
+	 *
+	 * @param index The index of the queue.
+	 * @param waitWhenFull When true, enqueue() blocks until there is space in the queue.
+	 * @param processingThreadCount The number of threads calling processQueueEntry().
+	 * @param threadPriority The priority of the processing threads.
+	 * @param threadPolicy The scheduling policy of the processing threads.
+	 * @param lockFree When true, the queue is a bounded lock-free ring (multiple producers, multiple consumers) instead of
+	 * a mutex protected buffer. Idle processing threads are parked on a futex. Only use it for queues with a single
+	 * producer: there it was about 25 % faster than the mutex. With 4 or 16 producers the mutex was 3 to 6 times faster,
+	 * because producers waiting for free space have to be woken through the futex. Measured with benchmarks/IQueue.cpp on
+	 * one CPU, so rerun it on the target system before enabling the mode.
+	 */
+	void startQueue(int32_t index, bool waitWhenFull, uint32_t processingThreadCount, int32_t threadPriority, int32_t threadPolicy, bool lockFree = false);
 	void stopQueue(int32_t index);
 	bool enqueue(int32_t index, std::shared_ptr<IQueueEntry>& entry, bool waitWhenFull = false);
 	virtual void processQueueEntry(int32_t index, std::shared_ptr<IQueueEntry>& entry) = 0;
+
+	/**
+	 * Called instead of processQueueEntry() when the maximum batch size of the queue is greater than 1. Receives all
+	 * entries (up to the maximum batch size) that were ready when the processing thread woke up. The default
+	 * implementation calls processQueueEntry() for every entry.
+	 *
+	 * @param index The index of the queue.
+	 * @param entries The entries in the order they were enqueued. Never empty.
+	 */
+	virtual void processQueueEntries(int32_t index, std::vector<std::shared_ptr<IQueueEntry>>& entries);
+
+	/**
+	 * Sets the maximum number of entries a processing thread removes from the queue at once. The default is 1, which
+	 * calls processQueueEntry() for every entry. Can be changed while the queue is running.
+	 *
+	 * @param index The index of the queue.
+	 * @param maxBatchSize The maximum number of entries passed to processQueueEntries().
+	 */
+	void setMaxBatchSize(int32_t index, uint32_t maxBatchSize);
+
+	/**
+	 * Splits a queue into priority lanes. Entries are placed in the lane matching their priority. Processing threads
+	 * serve the lanes in weighted round robin order: Up to "weight" entries are taken from a lane before the next
+	 * non-empty lane is served. Every lane can hold up to "bufferSize" entries, so a full low priority lane doesn't block
+	 * the others. Must be called before startQueue(). By default every queue has one lane.
+	 *
+	 * @param index The index of the queue.
+	 * @param weights The weight of each lane. Lane 0 is served first. Weights of 0 are treated as 1.
+	 * @param dropExpiredEntries When true, entries whose deadline has passed are dropped instead of processed. Expired
+	 * entries are counted in both cases.
+	 */
+	void setLanes(int32_t index, const std::vector<uint32_t>& weights, bool dropExpiredEntries = true);
+
+	/**
+	 * Returns the statistics of all lanes of a queue.
+	 */
+	std::vector<LaneStatistics> getLaneStatistics(int32_t index);
 	bool queueEmpty(int32_t index);
 	int32_t queueSize(int32_t index);
 private:
 	int32_t _bufferSize = 10000;
-	std::vector<int32_t> _bufferHead;
-	std::vector<int32_t> _bufferTail;
 	std::vector<int32_t> _bufferCount;
 	std::vector<bool> _waitWhenFull;
-	std::vector<std::vector<std::shared_ptr<IQueueEntry>>> _buffer;
+	std::unique_ptr<std::atomic<uint32_t>[]> _maxBatchSize;
 	std::unique_ptr<std::mutex[]> _queueMutex = nullptr;
 	std::vector<std::vector<std::shared_ptr<std::thread>>> _processingThread;
 	std::unique_ptr<std::condition_variable[]> _produceConditionVariable = nullptr;
 	std::unique_ptr<std::condition_variable[]> _processingConditionVariable = nullptr;
 
+	/**
+	 * Bounded multi producer, multi consumer ring as described by Dmitry Vyukov. Every cell has a sequence number telling
+	 * producers and consumers whether it is free or filled for the current lap, so the positions can be claimed with a
+	 * single compare and swap.
+	 */
+	class LockFreeRing
+	{
+	public:
+		LockFreeRing(uint32_t capacity);
+		virtual ~LockFreeRing() {}
+
+		uint32_t capacity() { return _capacity; }
+		int32_t size();
+		bool push(std::shared_ptr<IQueueEntry>& entry);
+		bool pop(std::shared_ptr<IQueueEntry>& entry);
+
+		/**
+		 * Resets the ring. Must only be called when no thread is accessing it.
+		 */
+		void clear();
+	private:
+		struct Cell
+		{
+			std::atomic<uint64_t> sequence;
+			std::shared_ptr<IQueueEntry> entry;
+		};
+
+		uint32_t _capacity = 0;
+		std::unique_ptr<Cell[]> _cells;
+		char _padding1[64];
+		std::atomic<uint64_t> _enqueuePosition;
+		char _padding2[64];
+		std::atomic<uint64_t> _dequeuePosition;
+		char _padding3[64];
+	};
+
+	/**
+	 * Futex words and waiter counts of a lock-free queue.
+	 */
+	struct ParkingState
+	{
+		/**
+		 * Futex word incremented on every push. Idle consumers wait on it.
+		 */
+		std::atomic<int32_t> itemsAvailable{0};
+
+		/**
+		 * Futex word incremented on every pop while producers are waiting for space.
+		 */
+		std::atomic<int32_t> spaceAvailable{0};
+		std::atomic<int32_t> consumersWaiting{0};
+		std::atomic<int32_t> producersWaiting{0};
+	};
+
+	struct Lane
+	{
+		uint32_t weight = 1;
+
+		//{{{ Mutex mode, protected by _queueMutex
+		std::vector<std::shared_ptr<IQueueEntry>> buffer;
+		int32_t head = 0;
+		int32_t tail = 0;
+		int32_t count = 0;
+		//}}}
+
+		/**
+		 * Lock-free mode. The ring is kept when the queue is stopped, so producers racing stopQueue() never access freed
+		 * memory.
+		 */
+		std::unique_ptr<LockFreeRing> ring;
+
+		std::atomic<uint64_t> enqueued{0};
+		std::atomic<uint64_t> processed{0};
+		std::atomic<uint64_t> expired{0};
+		std::atomic<uint64_t> rejected{0};
+	};
+
+	std::vector<bool> _lockFree;
+	std::unique_ptr<ParkingState[]> _parkingState;
+	std::vector<std::vector<std::shared_ptr<Lane>>> _lanes;
+	std::vector<bool> _dropExpiredEntries;
+
+	//{{{ Weighted round robin state of the mutex mode, protected by _queueMutex
+	std::vector<uint32_t> _currentLane;
+	std::vector<uint32_t> _laneCredits;
+	//}}}
+
+	/**
+	 * Returns the lane index for an entry.
+	 */
+	uint32_t getLane(int32_t index, std::shared_ptr<IQueueEntry>& entry);
+
+	/**
+	 * Removes the next entry in weighted round robin order. _queueMutex must be locked and the queue must not be empty.
+	 */
+	std::shared_ptr<IQueueEntry> takeEntry(int32_t index, uint32_t& lane);
+
+	/**
+	 * Removes the next entry of a lock-free queue in weighted round robin order.
+	 *
+	 * @param currentLane The round robin position of the calling thread.
+	 * @param credits The number of entries the calling thread may still take from the current lane.
+	 * @return Returns false when all lanes are empty.
+	 */
+	bool popLockFree(int32_t index, std::shared_ptr<IQueueEntry>& entry, uint32_t& lane, uint32_t& currentLane, uint32_t& credits);
+
+	/**
+	 * Counts expired entries and returns true when the entry should be dropped.
+	 */
+	bool isExpired(int32_t index, uint32_t lane, std::shared_ptr<IQueueEntry>& entry);
+
 	void process(int32_t index);
+	bool enqueueLockFree(int32_t index, std::shared_ptr<IQueueEntry>& entry, bool waitWhenFull);
+	void processLockFree(int32_t index);
 };
 
 }
@@ -31,6 +31,9 @@
 #include "IQueueBase.h"
 #include "BaseLib.h"
 
+#include <cxxabi.h>
+#include <typeinfo>
+
 namespace BaseLib
 {
 
@@ -44,6 +47,21 @@ IQueueBase::IQueueBase(SharedObjects* baseLib, uint32_t queueCount)
 	_droppedEntries = 0;
 }
 
+std::string IQueueBase::getThreadName()
+{
+	std::string name = typeid(*this).name();
+	int32_t status = 0;
+	char* demangledName = abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status);
+	if(demangledName)
+	{
+		if(status == 0) name = demangledName;
+		free(demangledName);
+	}
+	std::string::size_type position = name.rfind("::");
+	if(position != std::string::npos) name = name.substr(position + 2);
+	return name;
+}
+
 void IQueueBase::printQueueFullError(BaseLib::Output& out, std::string message)
 {
 	uint32_t droppedEntries = ++_droppedEntries;
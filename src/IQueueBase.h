@@ -51,6 +51,11 @@ public:
 
 	void printQueueFullError(BaseLib::Output& out, std::string message);
 protected:
+	/**
+	 * Returns the unqualified name of the derived class, which is used to name the processing threads.
+	 */
+	std::string getThreadName();
+
 	SharedObjects* _bl = nullptr;
 	int32_t _queueCount = 2;
 	std::unique_ptr<std::atomic_bool[]> _stopProcessingThread;
@@ -34,19 +34,22 @@
 namespace BaseLib
 {
 
-ITimedQueue::ITimedQueue(SharedObjects* baseLib, uint32_t queueCount) : IQueueBase(baseLib, queueCount)
+ITimedQueue::ITimedQueue(SharedObjects* baseLib, uint32_t queueCount, uint32_t bufferSize) : IQueueBase(baseLib, queueCount)
 {
-	_firstPositionChanged.resize(queueCount);
+	_bufferSize = bufferSize;
 	_bufferMutex.reset(new std::mutex[queueCount]);
+	_timerWheel.resize(queueCount);
 	_buffer.resize(queueCount);
-	_processingThreadMutex.reset(new std::mutex[queueCount]);
+	_currentId.resize(queueCount, 0);
+	_expiredEntries.resize(queueCount);
+	_nextWakeup.resize(queueCount, 0);
 	_processingThread.resize(queueCount);
 	_processingConditionVariable.reset(new std::condition_variable[queueCount]);
 
 	for(int32_t i = 0; i < _queueCount; i++)
 	{
 		_stopProcessingThread[i] = true;
-		_firstPositionChanged[i] = false;
+		_timerWheel[i].reset(new TimerWheel(1, HelperFunctions::getTime()));
 	}
 }
 
@@ -58,20 +61,41 @@ ITimedQueue::~ITimedQueue()
 	}
 }
 
-void ITimedQueue::startQueue(int32_t index, int32_t threadPriority, int32_t threadPolicy)
+void ITimedQueue::startQueue(int32_t index, int32_t threadPriority, int32_t threadPolicy, uint32_t processingThreadCount)
 {
 	if(index < 0 || index >= _queueCount) return;
 	_stopProcessingThread[index] = false;
-	_bl->threadManager.start(_processingThread[index], true, threadPriority, threadPolicy, &ITimedQueue::process, this, index);
+	if(processingThreadCount == 0) processingThreadCount = 1;
+	std::string threadName = getThreadName();
+	for(uint32_t i = 0; i < processingThreadCount; i++)
+	{
+		std::shared_ptr<std::thread> thread(new std::thread());
+		_bl->threadManager.start(threadName, ThreadManager::ThreadCategory::worker, *thread, true, threadPriority, threadPolicy, &ITimedQueue::process, this, index);
+		_processingThread[index].push_back(thread);
+	}
 }
 
 void ITimedQueue::stopQueue(int32_t index)
 {
 	if(index < 0 || index >= _queueCount) return;
 	if(_stopProcessingThread[index]) return;
-	_stopProcessingThread[index] = true;
-	_processingConditionVariable[index].notify_one();
-	_bl->threadManager.join(_processingThread[index]);
+	{
+		std::lock_guard<std::mutex> bufferGuard(_bufferMutex[index]);
+		_stopProcessingThread[index] = true;
+	}
+	_processingConditionVariable[index].notify_all();
+	for(auto& thread : _processingThread[index])
+	{
+		_bl->threadManager.join(*thread);
+	}
+	_processingThread[index].clear();
+}
+
+int32_t ITimedQueue::queueSize(int32_t index)
+{
+	if(index < 0 || index >= _queueCount) return 0;
+	std::lock_guard<std::mutex> bufferGuard(_bufferMutex[index]);
+	return _buffer[index].size();
 }
 
 bool ITimedQueue::enqueue(int32_t index, std::shared_ptr<ITimedQueueEntry>& entry, int64_t& id)
@@ -79,18 +103,24 @@ bool ITimedQueue::enqueue(int32_t index, std::shared_ptr<ITimedQueueEntry>& entr
 	try
 	{
 		if(index < 0 || index >= _queueCount || !entry) return false;
+		bool wakeUp = false;
 		{
 			std::lock_guard<std::mutex> bufferGuard(_bufferMutex[index]);
-			if(_buffer[index].size() >= (unsigned)_bufferSize) return false;
+			if(_buffer[index].size() >= _bufferSize) return false;
 
-			id = entry->getTime();
-			while(_buffer[index].find(id) != _buffer[index].end()) id++;
+			id = ++_currentId[index];
+			_buffer[index].emplace(id, entry);
+			_timerWheel[index]->add(id, entry->getTime());
 
-			if(!_buffer[index].empty() && _buffer[index].begin()->first > id) _firstPositionChanged[index] = true;
-			_buffer[index].insert(std::pair<int64_t, std::shared_ptr<ITimedQueueEntry>>(id, entry));
+			//Only wake up the processing threads, when the entry is due before they wake up anyway.
+			if(_nextWakeup[index] == -1 || entry->getTime() < _nextWakeup[index])
+			{
+				_nextWakeup[index] = entry->getTime();
+				wakeUp = true;
+			}
 		}
 
-		_processingConditionVariable[index].notify_one();
+		if(wakeUp) _processingConditionVariable[index].notify_one();
 		return true;
 	}
 	catch(const std::exception& ex)
@@ -112,8 +142,10 @@ void ITimedQueue::removeQueueEntry(int32_t index, int64_t id)
 {
 	try
 	{
+		if(index < 0 || index >= _queueCount) return;
 		std::lock_guard<std::mutex> bufferGuard(_bufferMutex[index]);
-		_buffer[index].erase(id);
+		//Expired entries are skipped by the processing threads, when they are not in the buffer anymore.
+		if(_buffer[index].erase(id) > 0) _timerWheel[index]->remove(id);
 	}
 	catch(const std::exception& ex)
 	{
@@ -132,38 +164,40 @@ void ITimedQueue::removeQueueEntry(int32_t index, int64_t id)
 void ITimedQueue::process(int32_t index)
 {
 	if(index < 0 || index >= _queueCount) return;
-	int64_t now;
-	int64_t next;
+	std::vector<int64_t> expired;
+	std::unique_lock<std::mutex> lock(_bufferMutex[index]);
 	while(!_stopProcessingThread[index])
 	{
-		std::unique_lock<std::mutex> lock(_processingThreadMutex[index]);
 		try
 		{
-			_bufferMutex[index].lock();
-			now = _bl->hf.getTime();
-			if(_buffer[index].empty() || _buffer[index].begin()->first > now) //Only lock, when there is really no packet to process. This check is necessary, because the check of the while loop condition is outside of the mutex
+			if(_expiredEntries[index].empty())
 			{
-				next = _buffer[index].empty() ? 0 : _buffer[index].begin()->first;
-				_bufferMutex[index].unlock();
-				if(next > 0) _processingConditionVariable[index].wait_until(lock, std::chrono::time_point<std::chrono::high_resolution_clock>(std::chrono::milliseconds(next)), [&]{ std::lock_guard<std::mutex> bufferGuard(_bufferMutex[index]); return _buffer[index].empty() || _buffer[index].begin()->first <= _bl->hf.getTime() || _firstPositionChanged[index] || _stopProcessingThread[index]; });
-				else _processingConditionVariable[index].wait(lock, [&]{ std::lock_guard<std::mutex> bufferGuard(_bufferMutex[index]); return !_buffer[index].empty() || _stopProcessingThread[index]; });
-				if(_firstPositionChanged[index]) _firstPositionChanged[index] = false;
+				expired.clear();
+				_timerWheel[index]->advance(HelperFunctions::getTime(), expired);
+				_expiredEntries[index].insert(_expiredEntries[index].end(), expired.begin(), expired.end());
+				if(_expiredEntries[index].empty())
+				{
+					int64_t next = _timerWheel[index]->nextEventTime();
+					_nextWakeup[index] = next;
+					if(next == -1) _processingConditionVariable[index].wait(lock);
+					else _processingConditionVariable[index].wait_until(lock, std::chrono::system_clock::time_point(std::chrono::milliseconds(next)));
+					continue;
+				}
 			}
-			else _bufferMutex[index].unlock();
-			if(_stopProcessingThread[index]) return;
 
-			now = _bl->hf.getTime();
+			int64_t id = _expiredEntries[index].front();
+			_expiredEntries[index].pop_front();
+			auto entryIterator = _buffer[index].find(id);
+			if(entryIterator == _buffer[index].end()) continue; //Removed
+			std::shared_ptr<ITimedQueueEntry> entry = std::move(entryIterator->second);
+			_buffer[index].erase(entryIterator);
 
-			int64_t id = 0;
-			std::shared_ptr<ITimedQueueEntry> entry;
-			{
-				std::lock_guard<std::mutex> bufferGuard(_bufferMutex[index]);
-				if(_buffer[index].empty() || _buffer[index].begin()->first > now) continue;
-				id = _buffer[index].begin()->first;
-				entry = _buffer[index].begin()->second;
-				_buffer[index].erase(_buffer[index].begin());
-			}
+			//Let another processing thread take the next expired entry while this one is busy.
+			if(!_expiredEntries[index].empty()) _processingConditionVariable[index].notify_one();
+
+			lock.unlock();
 			if(entry) processQueueEntry(index, id, entry);
+			lock.lock();
 		}
 		catch(const std::exception& ex)
 		{
@@ -177,7 +211,7 @@ void ITimedQueue::process(int32_t index)
 		{
 			_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
 		}
-		lock.unlock();
+		if(!lock.owns_lock()) lock.lock();
 	}
 }
 
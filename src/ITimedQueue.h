@@ -32,8 +32,10 @@
 #define ITIMEDQUEUE_H_
 
 #include "IQueueBase.h"
+#include "TimerWheel.h"
 
-#include <map>
+#include <deque>
+#include <unordered_map>
 
 namespace BaseLib
 {
@@ -52,23 +54,62 @@ private:
 	int64_t _time = 0;
 };
 
+/**
+ * Queue calling processQueueEntry() when the time of an entry is reached. Entries are stored in a hierarchical timer wheel
+ * with a resolution of one millisecond, so enqueueing and removing entries is O(1) independent of the number of entries.
+ */
 class ITimedQueue : public IQueueBase
 {
 public:
-	ITimedQueue(SharedObjects* baseLib, uint32_t queueCount);
+	/**
+	 * @param baseLib The base library object.
+	 * @param queueCount The number of queues.
+	 * @param bufferSize The maximum number of entries per queue.
+	 */
+	ITimedQueue(SharedObjects* baseLib, uint32_t queueCount, uint32_t bufferSize = 1000000);
 	virtual ~ITimedQueue();
-	void startQueue(int32_t index, int32_t threadPriority, int32_t threadPolicy);
+
+	/**
+	 * Starts the processing threads of a queue.
+	 *
+	 * @param index The index of the queue.
+	 * @param threadPriority The priority of the processing threads.
+	 * @param threadPolicy The scheduling policy of the processing threads.
+	 * @param processingThreadCount The number of threads calling processQueueEntry(). Entries due at the same time are
+	 * processed in parallel when greater than 1.
+	 */
+	void startQueue(int32_t index, int32_t threadPriority, int32_t threadPolicy, uint32_t processingThreadCount = 1);
 	void stopQueue(int32_t index);
+
+	/**
+	 * Adds an entry to the queue.
+	 *
+	 * @param index The index of the queue.
+	 * @param entry The entry. Its time must be set.
+	 * @param[out] id A unique ID of the entry within the queue, which can be passed to removeQueueEntry().
+	 * @return Returns false when the queue is full.
+	 */
 	bool enqueue(int32_t index, std::shared_ptr<ITimedQueueEntry>& entry, int64_t& id);
 	void removeQueueEntry(int32_t index, int64_t id);
+	int32_t queueSize(int32_t index);
 	virtual void processQueueEntry(int32_t index, int64_t id, std::shared_ptr<ITimedQueueEntry>& entry) = 0;
 private:
-	static const int32_t _bufferSize = 1000;
-	std::vector<bool> _firstPositionChanged;
+	uint32_t _bufferSize = 1000000;
 	std::unique_ptr<std::mutex[]> _bufferMutex = nullptr;
-	std::vector<std::map<int64_t, std::shared_ptr<ITimedQueueEntry>>> _buffer;
-	std::unique_ptr<std::mutex[]> _processingThreadMutex = nullptr;
-	std::vector<std::thread> _processingThread;
+	std::vector<std::unique_ptr<TimerWheel>> _timerWheel;
+	std::vector<std::unordered_map<int64_t, std::shared_ptr<ITimedQueueEntry>>> _buffer;
+	std::vector<int64_t> _currentId;
+
+	/**
+	 * IDs of expired entries not processed yet.
+	 */
+	std::vector<std::deque<int64_t>> _expiredEntries;
+
+	/**
+	 * The time the waiting processing threads wake up at. enqueue() only wakes them up, when the new entry is due earlier.
+	 */
+	std::vector<int64_t> _nextWakeup;
+	std::vector<std::vector<std::shared_ptr<std::thread>>> _processingThread;
 	std::unique_ptr<std::condition_variable[]> _processingConditionVariable = nullptr;
 
 	void process(int32_t index);
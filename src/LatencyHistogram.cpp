@@ -0,0 +1,131 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "LatencyHistogram.h"
+
+namespace BaseLib
+{
+
+LatencyHistogram::LatencyHistogram()
+{
+	_buckets.reset(new std::atomic<uint64_t>[_bucketCount]);
+	for(int32_t i = 0; i < _bucketCount; i++)
+	{
+		_buckets[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+int32_t LatencyHistogram::getBucketIndex(int64_t value)
+{
+	if(value < _subBucketCount) return (int32_t)value;
+	int32_t highestBit = 63 - __builtin_clzll((uint64_t)value);
+	if(highestBit >= _maxValueBits) return _bucketCount - 1;
+	int32_t shift = highestBit - _subBucketBits + 1;
+	//(value >> shift) is between _subBucketHalfCount and _subBucketCount - 1.
+	return _subBucketCount + (highestBit - _subBucketBits) * _subBucketHalfCount + (int32_t)(value >> shift) - _subBucketHalfCount;
+}
+
+int64_t LatencyHistogram::getBucketUpperBound(int32_t index)
+{
+	if(index < _subBucketCount) return index;
+	int32_t highestBit = (index - _subBucketCount) / _subBucketHalfCount + _subBucketBits;
+	int32_t shift = highestBit - _subBucketBits + 1;
+	int64_t subBucket = (index - _subBucketCount) % _subBucketHalfCount + _subBucketHalfCount;
+	return ((subBucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(int64_t value)
+{
+	if(value < 0) value = 0;
+	_buckets[getBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+	_count.fetch_add(1, std::memory_order_relaxed);
+	_sum.fetch_add(value, std::memory_order_relaxed);
+
+	int64_t current = _min.load(std::memory_order_relaxed);
+	while(value < current && !_min.compare_exchange_weak(current, value, std::memory_order_relaxed));
+	current = _max.load(std::memory_order_relaxed);
+	while(value > current && !_max.compare_exchange_weak(current, value, std::memory_order_relaxed));
+}
+
+void LatencyHistogram::reset()
+{
+	for(int32_t i = 0; i < _bucketCount; i++)
+	{
+		_buckets[i].store(0, std::memory_order_relaxed);
+	}
+	_count.store(0, std::memory_order_relaxed);
+	_sum.store(0, std::memory_order_relaxed);
+	_min.store(INT64_MAX, std::memory_order_relaxed);
+	_max.store(0, std::memory_order_relaxed);
+}
+
+int64_t LatencyHistogram::getPercentile(double percentile)
+{
+	return getPercentile(percentile, _count.load(std::memory_order_relaxed));
+}
+
+int64_t LatencyHistogram::getPercentile(double percentile, uint64_t count)
+{
+	if(count == 0) return 0;
+	if(percentile < 0) percentile = 0;
+	else if(percentile > 100) percentile = 100;
+	uint64_t target = (uint64_t)((percentile / 100.0) * count + 0.5);
+	if(target == 0) target = 1;
+	uint64_t total = 0;
+	for(int32_t i = 0; i < _bucketCount; i++)
+	{
+		total += _buckets[i].load(std::memory_order_relaxed);
+		if(total >= target)
+		{
+			//Never report more than the largest recorded value. The last bucket also counts all values that are too large.
+			int64_t upperBound = getBucketUpperBound(i);
+			int64_t max = _max.load(std::memory_order_relaxed);
+			return (upperBound > max || i == _bucketCount - 1) ? max : upperBound;
+		}
+	}
+	return _max.load(std::memory_order_relaxed);
+}
+
+LatencyHistogram::Statistics LatencyHistogram::getStatistics()
+{
+	Statistics statistics;
+	statistics.count = _count.load(std::memory_order_relaxed);
+	if(statistics.count == 0) return statistics;
+	statistics.min = _min.load(std::memory_order_relaxed);
+	statistics.max = _max.load(std::memory_order_relaxed);
+	statistics.mean = (double)_sum.load(std::memory_order_relaxed) / statistics.count;
+	statistics.p50 = getPercentile(50, statistics.count);
+	statistics.p90 = getPercentile(90, statistics.count);
+	statistics.p99 = getPercentile(99, statistics.count);
+	statistics.p999 = getPercentile(99.9, statistics.count);
+	return statistics;
+}
+
+}
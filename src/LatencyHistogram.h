@@ -0,0 +1,127 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef LATENCYHISTOGRAM_H_
+#define LATENCYHISTOGRAM_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace BaseLib
+{
+
+/**
+ * HDR style histogram for latencies. Values below 64 are counted exactly, larger values are counted in 32 linear buckets per
+ * power of two, so the relative error of the reported percentiles is below 3.2 %. Values up to 2^41 - 1 can be recorded,
+ * larger values are counted in the highest bucket.
+ *
+ * record() is lock free and cheap enough to be called for every packet. It can be called from several threads. Reading the
+ * statistics while values are recorded returns a consistent enough but not atomic snapshot.
+ *
+ * Example:
+ *
+ *     BaseLib::LatencyHistogram histogram;
+ *     int64_t startTime = BaseLib::HelperFunctions::getTimeMicroseconds();
+ *     ...
+ *     histogram.record(BaseLib::HelperFunctions::getTimeMicroseconds() - startTime);
+ *     BaseLib::LatencyHistogram::Statistics statistics = histogram.getStatistics();
+ */
+class LatencyHistogram
+{
+public:
+	struct Statistics
+	{
+		uint64_t count = 0;
+		int64_t min = 0;
+		int64_t max = 0;
+		double mean = 0;
+		int64_t p50 = 0;
+		int64_t p90 = 0;
+		int64_t p99 = 0;
+		int64_t p999 = 0;
+	};
+
+	LatencyHistogram();
+	virtual ~LatencyHistogram() {}
+
+	/**
+	 * Counts one value. Negative values are counted as 0.
+	 */
+	void record(int64_t value);
+
+	/**
+	 * Removes all recorded values.
+	 */
+	void reset();
+
+	/**
+	 * Returns the number of recorded values.
+	 */
+	uint64_t count() { return _count.load(std::memory_order_relaxed); }
+
+	/**
+	 * Returns the value below or at which the given percentage of all recorded values lies.
+	 *
+	 * @param percentile The percentile between 0 and 100.
+	 * @return Returns the upper bound of the bucket containing the percentile or 0 when no values were recorded.
+	 */
+	int64_t getPercentile(double percentile);
+
+	/**
+	 * Returns count, minimum, maximum, mean and the 50th, 90th, 99th and 99.9th percentile.
+	 */
+	Statistics getStatistics();
+private:
+	static const int32_t _subBucketBits = 6;
+	static const int32_t _subBucketCount = 1 << _subBucketBits;
+	static const int32_t _subBucketHalfCount = _subBucketCount / 2;
+	static const int32_t _maxValueBits = 41;
+	static const int32_t _bucketCount = _subBucketCount + (_maxValueBits - _subBucketBits) * _subBucketHalfCount;
+
+	std::unique_ptr<std::atomic<uint64_t>[]> _buckets;
+	std::atomic<uint64_t> _count{0};
+	std::atomic<int64_t> _sum{0};
+	std::atomic<int64_t> _min{INT64_MAX};
+	std::atomic<int64_t> _max{0};
+
+	static int32_t getBucketIndex(int64_t value);
+
+	/**
+	 * Returns the largest value counted in a bucket.
+	 */
+	static int64_t getBucketUpperBound(int32_t index);
+
+	int64_t getPercentile(double percentile, uint64_t count);
+};
+
+}
+
+#endif
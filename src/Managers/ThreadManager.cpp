@@ -31,18 +31,41 @@
 #include "../BaseLib.h"
 #include "ThreadManager.h"
 
+#include <dirent.h>
+#include <fstream>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
 namespace BaseLib
 {
 
-bool _stopThreadCountTest = false;
+/**
+ * Reads a file in /proc or /sys. These files report a size of 0, so Io::getFileContent() can't be used.
+ *
+ * @return Returns the lines of the file or an empty vector on error.
+ */
+static std::vector<std::string> readProcFile(const std::string& path)
+{
+	std::vector<std::string> lines;
+	std::ifstream file(path);
+	std::string line;
+	while(std::getline(file, line))
+	{
+		lines.push_back(line);
+	}
+	return lines;
+}
 
-void* threadCountTest(void*)
+/**
+ * Reads a file containing a single number like "pids.max".
+ *
+ * @return Returns the number or -1 when the file doesn't exist or contains no number (e. g. "max").
+ */
+static int64_t readProcNumber(const std::string& path)
 {
-    while(!_stopThreadCountTest)
-    {
-    	std::this_thread::sleep_for(std::chrono::seconds(1));
-    }
-    return 0;
+	std::vector<std::string> lines = readProcFile(path);
+	if(lines.empty() || lines.front().empty() || !isdigit(lines.front().front())) return -1;
+	return std::strtoll(lines.front().c_str(), nullptr, 10);
 }
 
 ThreadManager::ThreadManager()
@@ -51,6 +74,15 @@ ThreadManager::ThreadManager()
 
 ThreadManager::~ThreadManager()
 {
+	std::map<std::string, std::shared_ptr<ThreadPool>> pools;
+	{
+		std::lock_guard<std::mutex> poolsGuard(_poolsMutex);
+		pools.swap(_pools);
+	}
+	for(auto& pool : pools)
+	{
+		pool.second->stop();
+	}
 }
 
 void ThreadManager::init(BaseLib::SharedObjects* baseLib, bool testMaxThreadCount)
@@ -61,25 +93,85 @@ void ThreadManager::init(BaseLib::SharedObjects* baseLib, bool testMaxThreadCoun
 
 void ThreadManager::testMaxThreadCount()
 {
-	std::vector<pthread_t> threads;
-	threads.reserve(1000);
-	while(true)
+	try
 	{
-		pthread_t thread;
-		if(pthread_create(&thread, nullptr, threadCountTest, nullptr) != 0)
+		int64_t limit = std::numeric_limits<int32_t>::max();
+		auto applyLimit = [&](int64_t value, const std::string& source)
+		{
+			if(value <= 0) return;
+			_bl->out.printDebug("Debug: Thread limit from " + source + ": " + std::to_string(value), 5);
+			if(value < limit) limit = value;
+		};
+
+		int64_t ownThreadCount = 1;
+		for(auto& line : readProcFile("/proc/self/status"))
 		{
-			_stopThreadCountTest = true;
-			for(std::vector<pthread_t>::iterator i = threads.begin(); i != threads.end(); ++i)
+			if(line.compare(0, 8, "Threads:") == 0) ownThreadCount = std::strtoll(line.c_str() + 8, nullptr, 10);
+		}
+
+		//The process limit applies to all threads of the user. We can't see the threads of other processes, so this is an upper bound.
+		struct rlimit processLimit;
+		if(getrlimit(RLIMIT_NPROC, &processLimit) == 0 && processLimit.rlim_cur != RLIM_INFINITY) applyLimit(processLimit.rlim_cur, "RLIMIT_NPROC");
+
+		applyLimit(readProcNumber("/proc/sys/kernel/threads-max"), "threads-max");
+
+		//cgroup v2 lines look like "0::/path", cgroup v1 lines like "5:pids:/path".
+		for(auto& line : readProcFile("/proc/self/cgroup"))
+		{
+			std::string path;
+			if(line.compare(0, 3, "0::") == 0) path = "/sys/fs/cgroup" + line.substr(3);
+			else
 			{
-				pthread_join(*i, nullptr);
+				std::vector<std::string> fields = HelperFunctions::splitAll(line, ':');
+				if(fields.size() != 3) continue;
+				std::vector<std::string> controllers = HelperFunctions::splitAll(fields.at(1), ',');
+				if(std::find(controllers.begin(), controllers.end(), "pids") == controllers.end()) continue;
+				path = "/sys/fs/cgroup/pids" + fields.at(2);
 			}
-			_maxThreadCount = _maxThreadCount * 90 / 100;
+			int64_t maxPids = readProcNumber(path + "/pids.max");
+			if(maxPids <= 0) continue;
+			int64_t currentPids = readProcNumber(path + "/pids.current");
+			//Threads of other processes in the cgroup reduce the number of threads we can start.
+			if(currentPids > ownThreadCount) maxPids -= currentPids - ownThreadCount;
+			applyLimit(maxPids, "cgroup " + path);
+		}
+
+		//Every thread reserves its stack in the virtual address space.
+		pthread_attr_t attributes;
+		size_t stackSize = 0;
+		if(pthread_attr_init(&attributes) == 0)
+		{
+			pthread_attr_getstacksize(&attributes, &stackSize);
+			pthread_attr_destroy(&attributes);
+		}
+		if(stackSize > 0)
+		{
+			uint64_t addressSpace = sizeof(void*) == 4 ? 3ull * 1024 * 1024 * 1024 : std::numeric_limits<uint64_t>::max();
+			struct rlimit addressSpaceLimit;
+			if(getrlimit(RLIMIT_AS, &addressSpaceLimit) == 0 && addressSpaceLimit.rlim_cur != RLIM_INFINITY && addressSpaceLimit.rlim_cur < addressSpace) addressSpace = addressSpaceLimit.rlim_cur;
+			if(addressSpace != std::numeric_limits<uint64_t>::max()) applyLimit(addressSpace / stackSize, "virtual memory / stack size");
+		}
+
+		if(limit == std::numeric_limits<int32_t>::max())
+		{
+			_maxThreadCount = 0;
 			return;
 		}
-		threads.push_back(thread);
-		if(threads.size() > threads.capacity() - 10) threads.reserve(threads.size() + 1000);
-		_maxThreadCount++;
+		_maxThreadCount = limit * 90 / 100;
+		_bl->out.printInfo("Info: Maximum thread count is " + std::to_string(_maxThreadCount));
 	}
+	catch(const std::exception& ex)
+    {
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(const Exception& ex)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
 }
 
 uint32_t ThreadManager::getMaxRegisteredThreadCount()
@@ -189,6 +281,165 @@ void ThreadManager::setThreadPriority(pthread_t thread, int32_t priority, int32_
     }
 }
 
+void ThreadManager::setThreadAffinity(pthread_t thread, ThreadCategory category)
+{
+	try
+	{
+		std::vector<int32_t> cpus;
+		switch(category)
+		{
+		case ThreadCategory::packet:
+			cpus = _bl->settings.packetThreadAffinity();
+			break;
+		case ThreadCategory::worker:
+			cpus = _bl->settings.workerThreadAffinity();
+			break;
+		case ThreadCategory::rpcServer:
+			cpus = _bl->settings.rpcServerThreadAffinity();
+			break;
+		case ThreadCategory::event:
+			cpus = _bl->settings.eventThreadAffinity();
+			break;
+		default:
+			break;
+		}
+		if(cpus.empty()) return;
+
+		cpu_set_t cpuSet;
+		CPU_ZERO(&cpuSet);
+		for(auto cpu : cpus)
+		{
+			CPU_SET(cpu, &cpuSet);
+		}
+		int32_t error = pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuSet);
+		if(error != 0) _bl->out.printError("Error: Could not set CPU affinity of thread: " + std::string(strerror(error)));
+	}
+	catch(const std::exception& ex)
+    {
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(const Exception& ex)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+static std::string getThreadCategoryName(ThreadManager::ThreadCategory category)
+{
+	switch(category)
+	{
+	case ThreadManager::ThreadCategory::packet:
+		return "Packet";
+	case ThreadManager::ThreadCategory::worker:
+		return "Worker";
+	case ThreadManager::ThreadCategory::rpcServer:
+		return "RPC server";
+	case ThreadManager::ThreadCategory::event:
+		return "Event";
+	default:
+		return "";
+	}
+}
+
+int32_t ThreadManager::addThreadInfo(std::string name, ThreadCategory category)
+{
+	int32_t threadId = syscall(SYS_gettid);
+	if(name.empty()) name = getThreadCategoryName(category);
+	//Names are limited to 16 bytes including the terminating null byte.
+	if(!name.empty()) pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+
+	{
+		std::lock_guard<std::mutex> threadInfoGuard(_threadInfoMutex);
+		ThreadInfo& threadInfo = _threadInfo[threadId];
+		threadInfo.name = name;
+		threadInfo.category = category;
+		threadInfo.startTime = HelperFunctions::getTime();
+	}
+	return threadId;
+}
+
+void ThreadManager::removeThreadInfo(int32_t threadId)
+{
+	std::lock_guard<std::mutex> threadInfoGuard(_threadInfoMutex);
+	_threadInfo.erase(threadId);
+}
+
+PVariable ThreadManager::getThreadStatistics()
+{
+	PVariable threads(new Variable(VariableType::tArray));
+	try
+	{
+		std::map<int32_t, ThreadInfo> threadInfo;
+		{
+			std::lock_guard<std::mutex> threadInfoGuard(_threadInfoMutex);
+			threadInfo = _threadInfo;
+		}
+		int64_t now = HelperFunctions::getTime();
+
+		DIR* directory = opendir("/proc/self/task");
+		if(!directory) return threads;
+		dirent* entry = nullptr;
+		while((entry = readdir(directory)) != nullptr)
+		{
+			if(!isdigit(entry->d_name[0])) continue;
+			int32_t threadId = std::strtol(entry->d_name, nullptr, 10);
+			std::string path = "/proc/self/task/" + std::string(entry->d_name) + "/";
+
+			PVariable thread(new Variable(VariableType::tStruct));
+			thread->structValue->emplace("ID", std::make_shared<Variable>(threadId));
+
+			std::vector<std::string> lines = readProcFile(path + "comm");
+			thread->structValue->emplace("NAME", std::make_shared<Variable>(lines.empty() ? std::string() : lines.front()));
+
+			auto threadInfoIterator = threadInfo.find(threadId);
+			thread->structValue->emplace("MANAGED", std::make_shared<Variable>(threadInfoIterator != threadInfo.end()));
+			if(threadInfoIterator != threadInfo.end())
+			{
+				thread->structValue->emplace("CATEGORY", std::make_shared<Variable>(getThreadCategoryName(threadInfoIterator->second.category)));
+				thread->structValue->emplace("AGE", std::make_shared<Variable>((int32_t)((now - threadInfoIterator->second.startTime) / 1000)));
+			}
+
+			//schedstat contains the time spent on the CPU in nanoseconds, the time spent waiting for a CPU and the number of time slices.
+			lines = readProcFile(path + "schedstat");
+			if(!lines.empty())
+			{
+				std::vector<std::string> fields = HelperFunctions::splitAll(lines.front(), ' ');
+				if(fields.size() >= 3)
+				{
+					thread->structValue->emplace("CPU_TIME", std::make_shared<Variable>((int64_t)(std::strtoll(fields.at(0).c_str(), nullptr, 10) / 1000)));
+					thread->structValue->emplace("WAKEUPS", std::make_shared<Variable>((int64_t)std::strtoll(fields.at(2).c_str(), nullptr, 10)));
+				}
+			}
+
+			for(auto& line : readProcFile(path + "status"))
+			{
+				if(line.compare(0, 24, "voluntary_ctxt_switches:") == 0) thread->structValue->emplace("VOLUNTARY_CONTEXT_SWITCHES", std::make_shared<Variable>((int64_t)std::strtoll(line.c_str() + 24, nullptr, 10)));
+				else if(line.compare(0, 27, "nonvoluntary_ctxt_switches:") == 0) thread->structValue->emplace("INVOLUNTARY_CONTEXT_SWITCHES", std::make_shared<Variable>((int64_t)std::strtoll(line.c_str() + 27, nullptr, 10)));
+			}
+
+			threads->arrayValue->push_back(thread);
+		}
+		closedir(directory);
+	}
+	catch(const std::exception& ex)
+    {
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(const Exception& ex)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+	return threads;
+}
+
 void ThreadManager::join(std::thread& thread)
 {
 	if(thread.joinable())
@@ -211,4 +462,68 @@ void ThreadManager::unregisterThread()
 	_currentThreadCount--;
 }
 
+// {{{ Thread pools
+std::shared_ptr<ThreadPool> ThreadManager::createPool(std::string name, uint32_t threadCount, uint32_t maxOverflowThreadCount, int32_t priority, int32_t policy, uint32_t queueLimit)
+{
+	std::shared_ptr<ThreadPool> pool;
+	{
+		std::lock_guard<std::mutex> poolsGuard(_poolsMutex);
+		auto poolIterator = _pools.find(name);
+		if(poolIterator != _pools.end()) return poolIterator->second;
+		pool = std::make_shared<ThreadPool>(_bl, name, threadCount, maxOverflowThreadCount, priority, policy, queueLimit);
+		_pools.emplace(name, pool);
+	}
+	pool->start();
+	return pool;
+}
+
+std::shared_ptr<ThreadPool> ThreadManager::getPool(std::string name)
+{
+	std::lock_guard<std::mutex> poolsGuard(_poolsMutex);
+	auto poolIterator = _pools.find(name);
+	if(poolIterator == _pools.end()) return std::shared_ptr<ThreadPool>();
+	return poolIterator->second;
+}
+
+void ThreadManager::removePool(std::string name)
+{
+	std::shared_ptr<ThreadPool> pool;
+	{
+		std::lock_guard<std::mutex> poolsGuard(_poolsMutex);
+		auto poolIterator = _pools.find(name);
+		if(poolIterator == _pools.end()) return;
+		pool = poolIterator->second;
+		_pools.erase(poolIterator);
+	}
+	pool->stop();
+}
+
+bool ThreadManager::submit(std::string poolName, std::function<void()> task)
+{
+	std::shared_ptr<ThreadPool> pool = getPool(poolName);
+	if(!pool) return false;
+	return pool->submit(std::move(task));
+}
+
+std::vector<ThreadPool::Statistics> ThreadManager::getPoolStatistics()
+{
+	std::vector<std::shared_ptr<ThreadPool>> pools;
+	{
+		std::lock_guard<std::mutex> poolsGuard(_poolsMutex);
+		pools.reserve(_pools.size());
+		for(auto& pool : _pools)
+		{
+			pools.push_back(pool.second);
+		}
+	}
+	std::vector<ThreadPool::Statistics> statistics;
+	statistics.reserve(pools.size());
+	for(auto& pool : pools)
+	{
+		statistics.push_back(pool->getStatistics());
+	}
+	return statistics;
+}
+// }}}
+
 }
@@ -33,16 +33,37 @@
 
 #include "../Exception.h"
 #include "../Output/Output.h"
+#include "ThreadPool.h"
+#include <functional>
+#include <map>
 #include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace BaseLib
 {
 
 class SharedObjects;
+class Variable;
+typedef std::shared_ptr<Variable> PVariable;
 
 class ThreadManager
 {
 public:
+	/**
+	 * Categories of threads with a CPU affinity configurable in main.conf.
+	 */
+	enum class ThreadCategory
+	{
+		none,
+		packet, //"packetThreadAffinity": Threads reading and processing packets of physical interfaces
+		worker, //"workerThreadAffinity": Queue and thread pool workers
+		rpcServer, //"rpcServerThreadAffinity": Threads of socket servers
+		event //"eventThreadAffinity": Threads processing events
+	};
+
 	ThreadManager();
 	virtual ~ThreadManager();
 	void init(BaseLib::SharedObjects* baseLib, bool testMaxThreadCount);
@@ -51,25 +72,63 @@ public:
 	static int32_t parseThreadPriority(int32_t priority, int32_t policy);
 	void setThreadPriority(pthread_t thread, int32_t priority, int32_t policy = SCHED_FIFO);
 
+	/**
+	 * Pins a thread to the CPUs configured for its category. Does nothing when no CPUs are configured.
+	 */
+	void setThreadAffinity(pthread_t thread, ThreadCategory category);
+
 	template<typename Function, typename... Args>
 	bool start(std::thread& thread, bool highPriority, Function&& function, Args&&... args)
 	{
-		if(!checkThreadCount(highPriority)) return false;
-		join(thread);
-		thread = std::thread(function, args...);
-		registerThread();
-		return true;
+		return startThread(std::string(), ThreadCategory::none, thread, highPriority, false, 0, 0, std::forward<Function>(function), std::forward<Args>(args)...);
 	}
 
 	template<typename Function, typename... Args>
 	bool start(std::thread& thread, bool highPriority, int32_t priority, int32_t policy, Function&& function, Args&&... args)
 	{
-		if(!checkThreadCount(highPriority)) return false;
-		join(thread);
-		thread = std::thread(function, args...);
-		setThreadPriority(thread.native_handle(), priority, policy);
-		registerThread();
-		return true;
+		return startThread(std::string(), ThreadCategory::none, thread, highPriority, true, priority, policy, std::forward<Function>(function), std::forward<Args>(args)...);
+	}
+
+	/**
+	 * Starts a thread and applies the CPU affinity of its category.
+	 */
+	template<typename Function, typename... Args>
+	bool start(ThreadCategory category, std::thread& thread, bool highPriority, Function&& function, Args&&... args)
+	{
+		return startThread(std::string(), category, thread, highPriority, false, 0, 0, std::forward<Function>(function), std::forward<Args>(args)...);
+	}
+
+	/**
+	 * Starts a thread, sets its priority and applies the CPU affinity of its category.
+	 */
+	template<typename Function, typename... Args>
+	bool start(ThreadCategory category, std::thread& thread, bool highPriority, int32_t priority, int32_t policy, Function&& function, Args&&... args)
+	{
+		return startThread(std::string(), category, thread, highPriority, true, priority, policy, std::forward<Function>(function), std::forward<Args>(args)...);
+	}
+
+	/**
+	 * Starts a thread, names it and applies the CPU affinity of its category.
+	 *
+	 * @param name The name of the thread, usually the subsystem it belongs to. Only the first 15 characters are visible in
+	 * tools like top.
+	 */
+	template<typename Function, typename... Args>
+	bool start(const std::string& name, ThreadCategory category, std::thread& thread, bool highPriority, Function&& function, Args&&... args)
+	{
+		return startThread(name, category, thread, highPriority, false, 0, 0, std::forward<Function>(function), std::forward<Args>(args)...);
+	}
+
+	/**
+	 * Starts a thread, names it, sets its priority and applies the CPU affinity of its category.
+	 *
+	 * @param name The name of the thread, usually the subsystem it belongs to. Only the first 15 characters are visible in
+	 * tools like top.
+	 */
+	template<typename Function, typename... Args>
+	bool start(const std::string& name, ThreadCategory category, std::thread& thread, bool highPriority, int32_t priority, int32_t policy, Function&& function, Args&&... args)
+	{
+		return startThread(name, category, thread, highPriority, true, priority, policy, std::forward<Function>(function), std::forward<Args>(args)...);
 	}
 
 	void join(std::thread& thread);
@@ -80,15 +139,161 @@ public:
 	uint32_t getMaxThreadCount();
 	int32_t getCurrentThreadCount();
 	uint32_t getMaxRegisteredThreadCount();
+
+	/**
+	 * Sets the maximum thread count to 90% of the lowest of RLIMIT_NPROC, /proc/sys/kernel/threads-max, the free pids of
+	 * the cgroup and the virtual address space divided by the default stack size. No limit is set when none of them is
+	 * limited.
+	 */
 	void testMaxThreadCount();
+
+	// {{{ Thread pools
+	/**
+	 * Creates and starts a named thread pool. If a pool with this name already exists, the existing pool is returned.
+	 *
+	 * @param name The name of the pool, e. g. the name of the subsystem using it.
+	 * @param threadCount The number of threads always running.
+	 * @param maxOverflowThreadCount The maximum number of additional threads started when all threads are busy.
+	 * @param priority The priority of the threads.
+	 * @param policy The scheduling policy of the threads. Pass SCHED_FIFO together with a priority for latency critical pools.
+	 * @param queueLimit The maximum number of waiting tasks. 0 means unlimited.
+	 * @return Returns the pool.
+	 */
+	std::shared_ptr<ThreadPool> createPool(std::string name, uint32_t threadCount, uint32_t maxOverflowThreadCount = 0, int32_t priority = 0, int32_t policy = SCHED_OTHER, uint32_t queueLimit = 0);
+
+	/**
+	 * Returns the pool with the specified name or nullptr if it doesn't exist.
+	 */
+	std::shared_ptr<ThreadPool> getPool(std::string name);
+
+	/**
+	 * Stops and removes a pool.
+	 */
+	void removePool(std::string name);
+
+	/**
+	 * Queues a task in the pool with the specified name.
+	 *
+	 * @return Returns false when the pool doesn't exist or can't accept the task.
+	 */
+	bool submit(std::string poolName, std::function<void()> task);
+
+	/**
+	 * Returns the statistics of all pools.
+	 */
+	std::vector<ThreadPool::Statistics> getPoolStatistics();
+	// }}}
+
+	/**
+	 * Returns one struct per thread of the process with the following entries:
+	 *
+	 * - ID: The kernel thread ID.
+	 * - NAME: The thread name.
+	 * - MANAGED: true when the thread was started by ThreadManager.
+	 * - CATEGORY: The thread category (only for managed threads).
+	 * - AGE: The number of seconds since the thread was started (only for managed threads).
+	 * - CPU_TIME: The CPU time used by the thread in microseconds.
+	 * - WAKEUPS: The number of times the thread was scheduled.
+	 * - VOLUNTARY_CONTEXT_SWITCHES and INVOLUNTARY_CONTEXT_SWITCHES
+	 *
+	 * The values are read from /proc/self/task, so they are only available on Linux.
+	 */
+	PVariable getThreadStatistics();
 protected:
+	struct ThreadInfo
+	{
+		std::string name;
+		ThreadCategory category = ThreadCategory::none;
+		int64_t startTime = 0;
+	};
+
 	SharedObjects* _bl = nullptr;
     std::mutex _threadCountMutex;
     uint32_t _maxRegisteredThreadCount = 0;
     uint32_t _maxThreadCount = 0;
     volatile int32_t _currentThreadCount = 0;
+    std::mutex _threadInfoMutex;
+    std::map<int32_t, ThreadInfo> _threadInfo;
+    std::mutex _poolsMutex;
+    std::map<std::string, std::shared_ptr<ThreadPool>> _pools;
 
     bool checkThreadCount(bool highPriority);
+
+    /**
+     * Starts "function" through runThread(). The function and its arguments are passed to std::thread as they are, so the usual
+     * std::thread semantics apply: Arguments are moved or copied into the thread (use std::ref() to pass references) and
+     * move-only arguments are supported.
+     */
+    template<typename Function, typename... Args>
+    bool startThread(const std::string& name, ThreadCategory category, std::thread& thread, bool highPriority, bool setPriority, int32_t priority, int32_t policy, Function&& function, Args&&... args)
+    {
+    	if(!checkThreadCount(highPriority)) return false;
+    	join(thread);
+    	thread = std::thread(&ThreadManager::runThread<typename std::decay<Function>::type, typename std::decay<Args>::type...>, this, name, category, std::forward<Function>(function), std::forward<Args>(args)...);
+    	if(setPriority) setThreadPriority(thread.native_handle(), priority, policy);
+    	setThreadAffinity(thread.native_handle(), category);
+    	registerThread();
+    	return true;
+    }
+
+    /**
+     * Calls a function object or function pointer.
+     */
+    template<typename Function, typename... Args>
+    static auto invoke(Function&& function, Args&&... args) -> decltype(std::forward<Function>(function)(std::forward<Args>(args)...))
+    {
+    	return std::forward<Function>(function)(std::forward<Args>(args)...);
+    }
+
+    /**
+     * Calls a member function on an object or a reference to an object.
+     */
+    template<typename Result, typename Class, typename Object, typename... Args>
+    static auto invoke(Result Class::* function, Object&& object, Args&&... args) -> decltype((std::forward<Object>(object).*function)(std::forward<Args>(args)...))
+    {
+    	return (std::forward<Object>(object).*function)(std::forward<Args>(args)...);
+    }
+
+    /**
+     * Calls a member function on a pointer or smart pointer to an object.
+     */
+    template<typename Result, typename Class, typename Object, typename... Args>
+    static auto invoke(Result Class::* function, Object&& object, Args&&... args) -> decltype(((*std::forward<Object>(object)).*function)(std::forward<Args>(args)...))
+    {
+    	return ((*std::forward<Object>(object)).*function)(std::forward<Args>(args)...);
+    }
+
+    /**
+     * Calls a member function on an object passed with std::ref().
+     */
+    template<typename Result, typename Class, typename Object, typename... Args>
+    static auto invoke(Result Class::* function, std::reference_wrapper<Object> object, Args&&... args) -> decltype((object.get().*function)(std::forward<Args>(args)...))
+    {
+    	return (object.get().*function)(std::forward<Args>(args)...);
+    }
+
+    /**
+     * Entry point of all threads started by ThreadManager. Names the thread and keeps it in the thread registry while running.
+     */
+    template<typename Function, typename... Args>
+    void runThread(std::string name, ThreadCategory category, Function&& function, Args&&... args)
+    {
+    	int32_t threadId = addThreadInfo(name, category);
+    	invoke(std::forward<Function>(function), std::forward<Args>(args)...);
+    	removeThreadInfo(threadId);
+    }
+
+    /**
+     * Names the calling thread and adds it to the thread registry.
+     *
+     * @return Returns the kernel thread ID.
+     */
+    int32_t addThreadInfo(std::string name, ThreadCategory category);
+
+    /**
+     * Removes a thread from the thread registry.
+     */
+    void removeThreadInfo(int32_t threadId);
 private:
 	ThreadManager(const ThreadManager&) = delete;
     ThreadManager& operator=(const ThreadManager&) = delete;
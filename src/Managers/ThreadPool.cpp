@@ -0,0 +1,314 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "ThreadPool.h"
+#include "../BaseLib.h"
+
+namespace BaseLib
+{
+
+ThreadPool::ThreadPool(SharedObjects* baseLib, std::string name, uint32_t threadCount, uint32_t maxOverflowThreadCount, int32_t priority, int32_t policy, uint32_t queueLimit)
+{
+	_bl = baseLib;
+	_name = name;
+	_threadCount = threadCount > 0 ? threadCount : 1;
+	_maxOverflowThreadCount = maxOverflowThreadCount;
+	_priority = priority;
+	_policy = policy;
+	_queueLimit = queueLimit;
+	_lastStatisticsTime = std::chrono::steady_clock::now();
+}
+
+ThreadPool::~ThreadPool()
+{
+	stop();
+}
+
+void ThreadPool::start()
+{
+	try
+	{
+		std::shared_ptr<ThreadPool> pool = shared_from_this();
+		std::lock_guard<std::mutex> queueGuard(_queueMutex);
+		if(!_stopped) return;
+		_stopped = false;
+		for(uint32_t i = 0; i < _threadCount; i++)
+		{
+			_threads.emplace_back();
+			if(!_bl->threadManager.start(_name, ThreadManager::ThreadCategory::worker, _threads.back(), true, _priority, _policy, &ThreadPool::worker, this, pool))
+			{
+				_threads.pop_back();
+				_bl->out.printError("Error: Could not start all threads of thread pool " + _name + ".");
+				break;
+			}
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(const Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+void ThreadPool::stop()
+{
+	try
+	{
+		std::list<std::thread> threads;
+		std::list<std::shared_ptr<OverflowThread>> overflowThreads;
+		{
+			std::lock_guard<std::mutex> queueGuard(_queueMutex);
+			if(_stopped) return;
+			_stopped = true;
+			_queue.clear();
+			threads.swap(_threads);
+			overflowThreads.swap(_overflowThreads);
+		}
+		_queueConditionVariable.notify_all();
+		for(auto& thread : threads)
+		{
+			joinThread(thread);
+		}
+		for(auto& thread : overflowThreads)
+		{
+			joinThread(thread->thread);
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(const Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+void ThreadPool::joinThread(std::thread& thread)
+{
+	//stop() might be called by a task. A thread can't join itself, so the calling thread is detached instead. It exits as soon
+	//as the task returns, because "_stopped" is set. The thread's reference to the pool keeps the pool alive until then, even
+	//when the pool was removed from ThreadManager.
+	if(thread.get_id() == std::this_thread::get_id())
+	{
+		thread.detach();
+		_bl->threadManager.unregisterThread();
+		return;
+	}
+	_bl->threadManager.join(thread);
+}
+
+void ThreadPool::collectOverflowThreads(std::vector<std::shared_ptr<OverflowThread>>& finishedThreads)
+{
+	for(auto i = _overflowThreads.begin(); i != _overflowThreads.end();)
+	{
+		if((*i)->finished)
+		{
+			finishedThreads.push_back(*i);
+			i = _overflowThreads.erase(i);
+		}
+		else ++i;
+	}
+}
+
+bool ThreadPool::submit(std::function<void()> task)
+{
+	try
+	{
+		if(!task) return false;
+		std::vector<std::shared_ptr<OverflowThread>> finishedThreads;
+		{
+			std::lock_guard<std::mutex> queueGuard(_queueMutex);
+			if(_stopped) return false;
+			if(_queueLimit > 0 && _queue.size() >= _queueLimit)
+			{
+				_rejectedTasks++;
+				return false;
+			}
+			_queue.push_back(std::move(task));
+			_submittedTasks++;
+			if(_queue.size() > _maxQueueSize) _maxQueueSize = _queue.size();
+
+			collectOverflowThreads(finishedThreads);
+			//Only start an overflow thread when there are more waiting tasks than idle threads.
+			if(_queue.size() > _idleThreadCount && _overflowThreads.size() < _maxOverflowThreadCount)
+			{
+				std::shared_ptr<OverflowThread> overflowThread = std::make_shared<OverflowThread>();
+				if(_bl->threadManager.start(_name, ThreadManager::ThreadCategory::worker, overflowThread->thread, true, _priority, _policy, &ThreadPool::overflowWorker, this, shared_from_this(), overflowThread))
+				{
+					_overflowThreads.push_back(overflowThread);
+				}
+			}
+		}
+		_queueConditionVariable.notify_one();
+		for(auto& thread : finishedThreads)
+		{
+			_bl->threadManager.join(thread->thread);
+		}
+		return true;
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(const Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return false;
+}
+
+ThreadPool::Statistics ThreadPool::getStatistics()
+{
+	Statistics statistics;
+	statistics.name = _name;
+	std::vector<std::shared_ptr<OverflowThread>> finishedThreads;
+	{
+		std::lock_guard<std::mutex> queueGuard(_queueMutex);
+		collectOverflowThreads(finishedThreads);
+		statistics.threadCount = _threads.size();
+		statistics.overflowThreadCount = _overflowThreads.size();
+		statistics.queueSize = _queue.size();
+		statistics.maxQueueSize = _maxQueueSize;
+	}
+	for(auto& thread : finishedThreads)
+	{
+		_bl->threadManager.join(thread->thread);
+	}
+	statistics.busyThreadCount = _busyThreadCount;
+	statistics.submittedTasks = _submittedTasks;
+	statistics.completedTasks = _completedTasks;
+	statistics.rejectedTasks = _rejectedTasks;
+
+	std::lock_guard<std::mutex> statisticsGuard(_statisticsMutex);
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	int64_t busyTime = _busyTime;
+	int64_t elapsedTime = std::chrono::duration_cast<std::chrono::microseconds>(now - _lastStatisticsTime).count();
+	if(elapsedTime > 0 && _threadCount > 0) statistics.utilization = (double)(busyTime - _lastStatisticsBusyTime) / (double)(elapsedTime * _threadCount);
+	_lastStatisticsBusyTime = busyTime;
+	_lastStatisticsTime = now;
+	return statistics;
+}
+
+void ThreadPool::runTask(std::function<void()>& task)
+{
+	_busyThreadCount++;
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	try
+	{
+		task();
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(const Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	_busyTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+	_completedTasks++;
+	_busyThreadCount--;
+}
+
+void ThreadPool::worker(std::shared_ptr<ThreadPool> pool)
+{
+	std::unique_lock<std::mutex> queueGuard(_queueMutex);
+	while(!_stopped)
+	{
+		if(_queue.empty())
+		{
+			_idleThreadCount++;
+			_queueConditionVariable.wait(queueGuard, [&] { return !_queue.empty() || _stopped; });
+			_idleThreadCount--;
+			continue;
+		}
+		std::function<void()> task = std::move(_queue.front());
+		_queue.pop_front();
+		queueGuard.unlock();
+		runTask(task);
+		task = std::function<void()>();
+		queueGuard.lock();
+	}
+}
+
+void ThreadPool::overflowWorker(std::shared_ptr<ThreadPool> pool, std::shared_ptr<OverflowThread> thread)
+{
+	std::unique_lock<std::mutex> queueGuard(_queueMutex);
+	while(!_stopped)
+	{
+		if(_queue.empty())
+		{
+			_idleThreadCount++;
+			bool hasTask = _queueConditionVariable.wait_for(queueGuard, std::chrono::seconds(10), [&] { return !_queue.empty() || _stopped; });
+			_idleThreadCount--;
+			if(!hasTask) break;
+			continue;
+		}
+		std::function<void()> task = std::move(_queue.front());
+		_queue.pop_front();
+		queueGuard.unlock();
+		runTask(task);
+		task = std::function<void()>();
+		queueGuard.lock();
+	}
+
+	//Join overflow threads that exited before this one, so at most one exited thread is left unjoined when the pool is idle.
+	//Collecting and setting "finished" both happen with _queueMutex locked, so two exiting threads never wait for each other.
+	std::vector<std::shared_ptr<OverflowThread>> finishedThreads;
+	collectOverflowThreads(finishedThreads);
+	thread->finished = true;
+	queueGuard.unlock();
+	for(auto& finishedThread : finishedThreads)
+	{
+		_bl->threadManager.join(finishedThread->thread);
+	}
+}
+
+}
@@ -0,0 +1,179 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace BaseLib
+{
+
+class SharedObjects;
+
+/**
+ * Executor running submitted tasks on a fixed number of threads. When all threads are busy, up to
+ * "maxOverflowThreadCount" additional threads are started, which exit again after being idle for 10 seconds. Pools are
+ * created and owned by ThreadManager. Every thread holds a reference to the pool, so a pool stays alive until stop() was
+ * called and all of its threads left the pool code.
+ *
+ * Example:
+ *
+ *     auto pool = _bl->threadManager.createPool("Peer operations", 4, 16);
+ *     pool->submit([this]() { ... });
+ *
+ * @see ThreadManager::createPool()
+ */
+class ThreadPool : public std::enable_shared_from_this<ThreadPool>
+{
+public:
+	struct Statistics
+	{
+		std::string name;
+		uint32_t threadCount = 0;
+		uint32_t overflowThreadCount = 0;
+		uint32_t busyThreadCount = 0;
+		uint32_t queueSize = 0;
+		uint32_t maxQueueSize = 0;
+		uint64_t submittedTasks = 0;
+		uint64_t completedTasks = 0;
+		uint64_t rejectedTasks = 0;
+
+		/**
+		 * The share of time the fixed threads were busy since the previous call to getStatistics() (0.0 to 1.0). Can exceed
+		 * 1.0 when overflow threads were running.
+		 */
+		double utilization = 0;
+	};
+
+	/**
+	 * @param baseLib The base library object.
+	 * @param name The name of the pool.
+	 * @param threadCount The number of threads always running.
+	 * @param maxOverflowThreadCount The maximum number of additional threads started when all threads are busy.
+	 * @param priority The priority of the threads.
+	 * @param policy The scheduling policy of the threads, e. g. SCHED_FIFO.
+	 * @param queueLimit The maximum number of waiting tasks. 0 means unlimited.
+	 */
+	ThreadPool(SharedObjects* baseLib, std::string name, uint32_t threadCount, uint32_t maxOverflowThreadCount, int32_t priority, int32_t policy, uint32_t queueLimit);
+	virtual ~ThreadPool();
+
+	std::string getName() { return _name; }
+
+	/**
+	 * Starts the fixed threads. The pool needs to be owned by a std::shared_ptr.
+	 */
+	void start();
+
+	/**
+	 * Stops all threads. Tasks not started yet are discarded. Can be called from a task. The calling thread is detached then and
+	 * exits when the task returns. Its reference keeps the pool alive until then.
+	 */
+	void stop();
+
+	/**
+	 * Queues a task.
+	 *
+	 * @return Returns false when the pool is stopped or the queue limit is reached.
+	 */
+	bool submit(std::function<void()> task);
+
+	Statistics getStatistics();
+private:
+	struct OverflowThread
+	{
+		std::thread thread;
+		std::atomic_bool finished{false};
+	};
+
+	SharedObjects* _bl = nullptr;
+	std::string _name;
+	uint32_t _threadCount = 1;
+	uint32_t _maxOverflowThreadCount = 0;
+	int32_t _priority = 0;
+	int32_t _policy = SCHED_OTHER;
+	uint32_t _queueLimit = 0;
+
+	std::mutex _queueMutex;
+	std::condition_variable _queueConditionVariable;
+	std::deque<std::function<void()>> _queue;
+	bool _stopped = true;
+	uint32_t _idleThreadCount = 0;
+	uint32_t _maxQueueSize = 0;
+	std::list<std::thread> _threads;
+	std::list<std::shared_ptr<OverflowThread>> _overflowThreads;
+
+	std::atomic<uint32_t> _busyThreadCount{0};
+	std::atomic<uint64_t> _submittedTasks{0};
+	std::atomic<uint64_t> _completedTasks{0};
+	std::atomic<uint64_t> _rejectedTasks{0};
+	std::atomic<int64_t> _busyTime{0};
+
+	std::mutex _statisticsMutex;
+	int64_t _lastStatisticsBusyTime = 0;
+	std::chrono::steady_clock::time_point _lastStatisticsTime;
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/**
+	 * Joins overflow threads that exited. _queueMutex must be locked.
+	 */
+	void collectOverflowThreads(std::vector<std::shared_ptr<OverflowThread>>& finishedThreads);
+
+	/**
+	 * Joins "thread" or detaches it when it is the calling thread.
+	 */
+	void joinThread(std::thread& thread);
+	void runTask(std::function<void()>& task);
+
+	/**
+	 * @param pool The pool itself, so it is not destroyed while the thread is running.
+	 */
+	void worker(std::shared_ptr<ThreadPool> pool);
+
+	/**
+	 * @param pool The pool itself, so it is not destroyed while the thread is running.
+	 */
+	void overflowWorker(std::shared_ptr<ThreadPool> pool, std::shared_ptr<OverflowThread> thread);
+};
+
+}
+#endif
@@ -0,0 +1,276 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "TlsCredentialManager.h"
+#include "../BaseLib.h"
+
+#include <sys/stat.h>
+
+namespace BaseLib
+{
+
+TlsCredentials::~TlsCredentials()
+{
+	if(x509Cred) gnutls_certificate_free_credentials(x509Cred);
+	if(priorityCache) gnutls_priority_deinit(priorityCache);
+	if(dhParams) gnutls_dh_params_deinit(dhParams);
+}
+
+static int verifyClientCertificate(gnutls_session_t tlsSession)
+{
+	//Called during handshake just after the certificate message has been received.
+
+	uint32_t status = (uint32_t)-1;
+	if(gnutls_certificate_verify_peers3(tlsSession, 0, &status) != GNUTLS_E_SUCCESS) return -1; //Terminate handshake
+	if(status > 0) return -1;
+	return 0;
+}
+
+TlsCredentialManager::TlsCredentialManager()
+{
+}
+
+void TlsCredentialManager::init(BaseLib::SharedObjects* baseLib)
+{
+	_bl = baseLib;
+}
+
+void TlsCredentialManager::dispose()
+{
+	clear();
+}
+
+void TlsCredentialManager::clear()
+{
+	std::lock_guard<std::mutex> credentialsGuard(_credentialsMutex);
+	_credentials.clear();
+}
+
+std::string TlsCredentialManager::getDataHash(const std::string& data)
+{
+	if(data.empty()) return "";
+	std::vector<char> input(data.begin(), data.end());
+	std::vector<char> hash;
+	Security::Hash::sha1(input, hash);
+	return HelperFunctions::getHexString(hash);
+}
+
+std::string TlsCredentialManager::getKey(const CredentialInfo& info)
+{
+	std::string key;
+	key.reserve(512);
+	key.append(info.isServer ? "S" : "C").append(info.requireClientCert ? "1" : "0").append(info.verifyCertificate ? "1" : "0");
+	key.append("|ca:").append(info.caData.empty() ? info.caFile : "#" + getDataHash(info.caData));
+	key.append("|cert:").append(info.certData.empty() ? info.certFile : "#" + getDataHash(info.certData));
+	key.append("|key:").append(info.keyData.empty() ? info.keyFile : "#" + getDataHash(info.keyData));
+	if(info.isServer) key.append("|dh:").append(info.dhParamFile.empty() ? "#" + getDataHash(info.dhParamData) : info.dhParamFile);
+	return key;
+}
+
+TlsCredentialManager::FileState TlsCredentialManager::getFileState(const std::string& path)
+{
+	FileState fileState;
+	fileState.path = path;
+	struct stat attributes;
+	if(stat(path.c_str(), &attributes) == -1) return fileState;
+	fileState.modificationTime = (int64_t)attributes.st_mtim.tv_sec * 1000000000ll + attributes.st_mtim.tv_nsec;
+	fileState.size = attributes.st_size;
+	return fileState;
+}
+
+bool TlsCredentialManager::filesChanged(const std::vector<FileState>& files)
+{
+	for(auto& file : files)
+	{
+		FileState currentState = getFileState(file.path);
+		if(currentState.modificationTime != file.modificationTime || currentState.size != file.size) return true;
+	}
+	return false;
+}
+
+PTlsCredentials TlsCredentialManager::get(const CredentialInfo& info)
+{
+	std::string key = getKey(info);
+
+	std::lock_guard<std::mutex> credentialsGuard(_credentialsMutex);
+	auto credentialsIterator = _credentials.find(key);
+	if(credentialsIterator != _credentials.end())
+	{
+		if(!filesChanged(credentialsIterator->second.files)) return credentialsIterator->second.credentials;
+		if(_bl->debugLevel >= 4) _bl->out.printInfo("Info: TLS certificate files changed. Reloading credentials.");
+		_credentials.erase(credentialsIterator);
+	}
+
+	CacheEntry entry;
+	//Get the file states before loading, so a modification during loading triggers another reload.
+	if(info.caData.empty() && !info.caFile.empty()) entry.files.push_back(getFileState(info.caFile));
+	if(info.certData.empty() && !info.certFile.empty()) entry.files.push_back(getFileState(info.certFile));
+	if(info.keyData.empty() && !info.keyFile.empty()) entry.files.push_back(getFileState(info.keyFile));
+	if(info.isServer && !info.dhParamFile.empty()) entry.files.push_back(getFileState(info.dhParamFile));
+	entry.inlineData = !info.caData.empty() || !info.certData.empty() || !info.keyData.empty() || (info.isServer && !info.dhParamData.empty());
+	entry.credentials = load(info);
+	collectUnused();
+	_credentials.emplace(key, entry);
+	return entry.credentials;
+}
+
+void TlsCredentialManager::collectUnused()
+{
+	//Called with "_credentialsMutex" locked. Entries created from inline PEM data can't be reloaded, so a changed certificate
+	//always results in a new key. Drop them as soon as no socket uses them anymore. File based entries are kept until the
+	//cache grows too large.
+	bool limitReached = _credentials.size() >= _maxEntries;
+	for(auto i = _credentials.begin(); i != _credentials.end();)
+	{
+		if(i->second.credentials.use_count() == 1 && (limitReached || i->second.inlineData)) i = _credentials.erase(i);
+		else ++i;
+	}
+}
+
+PTlsCredentials TlsCredentialManager::load(const CredentialInfo& info)
+{
+	PTlsCredentials credentials = std::make_shared<TlsCredentials>();
+
+	int32_t result = 0;
+	if((result = gnutls_certificate_allocate_credentials(&credentials->x509Cred)) != GNUTLS_E_SUCCESS)
+	{
+		credentials->x509Cred = nullptr;
+		throw SocketSSLException("Could not allocate certificate credentials: " + std::string(gnutls_strerror(result)));
+	}
+
+	if(!info.caData.empty())
+	{
+		gnutls_datum_t caData;
+		caData.data = (unsigned char*)info.caData.c_str();
+		caData.size = info.caData.size();
+		if((result = gnutls_certificate_set_x509_trust_mem(credentials->x509Cred, &caData, GNUTLS_X509_FMT_PEM)) < 0)
+		{
+			throw SocketSSLException("Could not load trusted certificates: " + std::string(gnutls_strerror(result)));
+		}
+	}
+	else if(!info.caFile.empty())
+	{
+		if((result = gnutls_certificate_set_x509_trust_file(credentials->x509Cred, info.caFile.c_str(), GNUTLS_X509_FMT_PEM)) < 0)
+		{
+			throw SocketSSLException("Could not load trusted certificates from \"" + info.caFile + "\": " + std::string(gnutls_strerror(result)));
+		}
+	}
+
+	if(result == 0 && ((info.verifyCertificate && !info.isServer) || (info.requireClientCert && info.isServer)))
+	{
+		throw SocketSSLException("No CA certificates specified.");
+	}
+
+	if(!info.certData.empty() && !info.keyData.empty())
+	{
+		gnutls_datum_t certData;
+		certData.data = (unsigned char*)info.certData.c_str();
+		certData.size = info.certData.size();
+
+		gnutls_datum_t keyData;
+		keyData.data = (unsigned char*)info.keyData.c_str();
+		keyData.size = info.keyData.size();
+
+		if((result = gnutls_certificate_set_x509_key_mem(credentials->x509Cred, &certData, &keyData, GNUTLS_X509_FMT_PEM)) < 0)
+		{
+			if(info.isServer) throw SocketSSLException("Could not load server certificate or key file: " + std::string(gnutls_strerror(result)));
+			else throw SocketSSLException("Could not load client certificate or key: " + std::string(gnutls_strerror(result)));
+		}
+	}
+	else if(!info.certFile.empty() && !info.keyFile.empty())
+	{
+		if((result = gnutls_certificate_set_x509_key_file(credentials->x509Cred, info.certFile.c_str(), info.keyFile.c_str(), GNUTLS_X509_FMT_PEM)) < 0)
+		{
+			if(info.isServer) throw SocketSSLException("Could not load certificate or key file from \"" + info.certFile + "\" or \"" + info.keyFile + "\": " + std::string(gnutls_strerror(result)));
+			else throw SocketSSLException("Could not load client certificate and key from \"" + info.certFile + "\" and \"" + info.keyFile + "\": " + std::string(gnutls_strerror(result)));
+		}
+	}
+	else if(info.isServer)
+	{
+		throw SocketSSLException("SSL is enabled but no certificates are specified.");
+	}
+
+	if(info.isServer)
+	{
+		if(!info.dhParamFile.empty() || !info.dhParamData.empty())
+		{
+			if((result = gnutls_dh_params_init(&credentials->dhParams)) != GNUTLS_E_SUCCESS)
+			{
+				credentials->dhParams = nullptr;
+				throw SocketSSLException("Error: Could not initialize DH parameters: " + std::string(gnutls_strerror(result)));
+			}
+
+			gnutls_datum_t data;
+			std::vector<uint8_t> binaryData;
+			if(!info.dhParamFile.empty())
+			{
+				try
+				{
+					binaryData = Io::getUBinaryFileContent(info.dhParamFile.c_str());
+					binaryData.push_back(0); //gnutls_datum_t.data needs to be null terminated
+				}
+				catch(BaseLib::Exception& ex)
+				{
+					throw SocketSSLException("Error: Could not load DH parameters: " + std::string(ex.what()));
+				}
+				catch(...)
+				{
+					throw SocketSSLException("Error: Could not load DH parameter file \"" + info.dhParamFile + "\".");
+				}
+				data.data = binaryData.data();
+				data.size = binaryData.size();
+			}
+			else
+			{
+				data.data = (unsigned char*)info.dhParamData.c_str();
+				data.size = info.dhParamData.size();
+			}
+
+			if((result = gnutls_dh_params_import_pkcs3(credentials->dhParams, &data, GNUTLS_X509_FMT_PEM)) != GNUTLS_E_SUCCESS)
+			{
+				throw SocketSSLException("Error: Could not import DH parameters: " + std::string(gnutls_strerror(result)));
+			}
+
+			gnutls_certificate_set_dh_params(credentials->x509Cred, credentials->dhParams);
+		}
+
+		if(info.requireClientCert) gnutls_certificate_set_verify_function(credentials->x509Cred, &verifyClientCertificate);
+	}
+
+	if((result = gnutls_priority_init(&credentials->priorityCache, "NORMAL", NULL)) != GNUTLS_E_SUCCESS)
+	{
+		credentials->priorityCache = nullptr;
+		throw SocketSSLException("Error: Could not initialize cipher priorities: " + std::string(gnutls_strerror(result)));
+	}
+
+	return credentials;
+}
+
+}
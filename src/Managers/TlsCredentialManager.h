@@ -0,0 +1,142 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef TLSCREDENTIALMANAGER_H_
+#define TLSCREDENTIALMANAGER_H_
+
+#include <memory>
+#include <string>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <gnutls/gnutls.h>
+
+namespace BaseLib
+{
+
+class SharedObjects;
+
+/**
+ * Holds one set of loaded TLS credentials. The GnuTLS objects are freed when the last reference is released, so sessions
+ * created from an outdated set keep working while new sessions use the reloaded one.
+ */
+class TlsCredentials
+{
+public:
+	TlsCredentials() {}
+	virtual ~TlsCredentials();
+
+	gnutls_certificate_credentials_t x509Cred = nullptr;
+	gnutls_dh_params_t dhParams = nullptr;
+	gnutls_priority_t priorityCache = nullptr;
+private:
+	TlsCredentials(const TlsCredentials&);
+	TlsCredentials& operator=(const TlsCredentials&);
+};
+
+typedef std::shared_ptr<TlsCredentials> PTlsCredentials;
+
+/**
+ * Process wide cache for TLS credentials, DH parameters and cipher priorities. Credentials are keyed by the file paths and a
+ * hash of the PEM data passed in, so all sockets using the same certificates share one set of GnuTLS objects. Files are
+ * checked for modifications on every lookup and reloaded when their size or modification time changed.
+ */
+class TlsCredentialManager
+{
+public:
+	struct CredentialInfo
+	{
+		bool isServer = false;
+		bool requireClientCert = false;
+		bool verifyCertificate = true;
+		std::string caFile;
+		std::string caData;
+		std::string certFile;
+		std::string certData;
+		std::string keyFile;
+		std::string keyData;
+		std::string dhParamFile;
+		std::string dhParamData;
+	};
+
+	TlsCredentialManager();
+	virtual ~TlsCredentialManager() {}
+	void init(BaseLib::SharedObjects* baseLib);
+	void dispose();
+
+	/**
+	 * Returns the credentials for the passed configuration. They are only loaded when they are not cached yet or when one of
+	 * the referenced files changed since they were loaded.
+	 *
+	 * @param info The paths and PEM data to load the credentials from.
+	 * @return The (possibly cached) credentials. Throws SocketSSLException on error.
+	 */
+	virtual PTlsCredentials get(const CredentialInfo& info);
+
+	/**
+	 * Removes all cached credentials. Credentials still in use stay valid until they are released.
+	 */
+	virtual void clear();
+private:
+	struct FileState
+	{
+		std::string path;
+		int64_t modificationTime = -1;
+		int64_t size = -1;
+	};
+
+	struct CacheEntry
+	{
+		bool inlineData = false;
+		std::vector<FileState> files;
+		PTlsCredentials credentials;
+	};
+
+	static const size_t _maxEntries = 100;
+
+	BaseLib::SharedObjects* _bl = nullptr;
+	std::mutex _credentialsMutex;
+	std::map<std::string, CacheEntry> _credentials;
+
+	std::string getKey(const CredentialInfo& info);
+	std::string getDataHash(const std::string& data);
+	FileState getFileState(const std::string& path);
+	bool filesChanged(const std::vector<FileState>& files);
+	PTlsCredentials load(const CredentialInfo& info);
+
+	/**
+	 * Removes entries no socket references anymore. Inline entries are always removed, file based ones only when the cache is full.
+	 */
+	void collectUnused();
+};
+
+}
+#endif
@@ -60,6 +60,7 @@ void Settings::reset()
 	_enableMonitoring = true;
 	_devLog = false;
 	_enableCoreDumps = true;
+	_useIoUring = false;
 	_enableFlows = true;
 	_setDevicePermissions = true;
 	_workingDirectory = _executablePath;
@@ -80,8 +81,13 @@ void Settings::reset()
 	_databaseMaxBackups = 10;
 	_logfilePath = "/var/log/homegear/";
 	_prioritizeThreads = true;
+	_packetThreadAffinity.clear();
+	_workerThreadAffinity.clear();
+	_rpcServerThreadAffinity.clear();
+	_eventThreadAffinity.clear();
 	_secureMemorySize = 65536;
 	_workerThreadWindow = 3000;
+	_eventReplayBufferSize = 10000;
 	_scriptEngineThreadCount = 10;
 	_scriptEngineServerMaxConnections = 10;
 	_scriptEngineMaxThreadsPerScript = 4;
@@ -140,6 +146,40 @@ void Settings::reset()
 	_exportGpios.clear();
 }
 
+std::vector<int32_t> Settings::parseCpuList(std::string value)
+{
+	std::vector<int32_t> cpus;
+	//Math::getNumber() returns 0 for anything that is not a number, so check the bounds first. The length limit prevents overflows.
+	auto isCpuNumber = [](const std::string& number) { return !number.empty() && number.size() < 10 && std::all_of(number.begin(), number.end(), [](char c) { return isdigit(c); }); };
+	std::vector<std::string> elements = HelperFunctions::splitAll(value, ',');
+	for(auto& element : elements)
+	{
+		HelperFunctions::trim(element);
+		if(element.empty()) continue;
+		std::pair<std::string, std::string> range = HelperFunctions::splitFirst(element, '-');
+		HelperFunctions::trim(range.first);
+		HelperFunctions::trim(range.second);
+		bool isRange = element.find('-') != std::string::npos;
+		if(!isCpuNumber(range.first) || (isRange && !isCpuNumber(range.second)))
+		{
+			_bl->out.printWarning("Warning: Invalid CPU list: " + value);
+			continue;
+		}
+		int32_t first = Math::getNumber(range.first);
+		int32_t last = isRange ? Math::getNumber(range.second) : first;
+		if(last < first || last >= CPU_SETSIZE)
+		{
+			_bl->out.printWarning("Warning: Invalid CPU list: " + value);
+			continue;
+		}
+		for(int32_t cpu = first; cpu <= last; cpu++)
+		{
+			cpus.push_back(cpu);
+		}
+	}
+	return cpus;
+}
+
 bool Settings::changed()
 {
 	if(_bl->io.getFileLastModifiedTime(_path) != _lastModified ||
@@ -282,6 +322,11 @@ void Settings::load(std::string filename, std::string executablePath)
 					if(HelperFunctions::toLower(value) == "false") _enableCoreDumps = false;
 					_bl->out.printDebug("Debug: enableCoreDumps set to " + std::to_string(_enableCoreDumps));
 				}
+				else if(name == "useiouring")
+				{
+					_useIoUring = HelperFunctions::toLower(value) == "true";
+					_bl->out.printDebug("Debug: useIoUring set to " + std::to_string(_useIoUring));
+				}
 				else if(name == "enableflows")
 				{
 					_enableFlows = HelperFunctions::toLower(value) == "true";
@@ -404,6 +449,26 @@ void Settings::load(std::string filename, std::string executablePath)
 					if(HelperFunctions::toLower(value) == "false") _prioritizeThreads = false;
 					_bl->out.printDebug("Debug: prioritizeThreads set to " + std::to_string(_prioritizeThreads));
 				}
+				else if(name == "packetthreadaffinity")
+				{
+					_packetThreadAffinity = parseCpuList(value);
+					_bl->out.printDebug("Debug: packetThreadAffinity set to " + value);
+				}
+				else if(name == "workerthreadaffinity")
+				{
+					_workerThreadAffinity = parseCpuList(value);
+					_bl->out.printDebug("Debug: workerThreadAffinity set to " + value);
+				}
+				else if(name == "rpcserverthreadaffinity")
+				{
+					_rpcServerThreadAffinity = parseCpuList(value);
+					_bl->out.printDebug("Debug: rpcServerThreadAffinity set to " + value);
+				}
+				else if(name == "eventthreadaffinity")
+				{
+					_eventThreadAffinity = parseCpuList(value);
+					_bl->out.printDebug("Debug: eventThreadAffinity set to " + value);
+				}
 				else if(name == "securememorysize")
 				{
 					_secureMemorySize = Math::getNumber(value);
@@ -417,6 +482,12 @@ void Settings::load(std::string filename, std::string executablePath)
 					if(_workerThreadWindow > 3600000) _workerThreadWindow = 3600000;
 					_bl->out.printDebug("Debug: workerThreadWindow set to " + std::to_string(_workerThreadWindow));
 				}
+				else if(name == "eventreplaybuffersize")
+				{
+					_eventReplayBufferSize = Math::getNumber(value);
+					if(_eventReplayBufferSize > 1000000) _eventReplayBufferSize = 1000000;
+					_bl->out.printDebug("Debug: eventReplayBufferSize set to " + std::to_string(_eventReplayBufferSize));
+				}
 				else if(name == "scriptenginethreadcount")
 				{
 					_scriptEngineThreadCount = Math::getNumber(value);
@@ -65,6 +65,7 @@ public:
 	bool enableMonitoring() { return _enableMonitoring; };
 	bool devLog() { return _devLog; }
 	bool enableCoreDumps() { return _enableCoreDumps; };
+	bool useIoUring() { return _useIoUring; }
 	bool enableFlows() { return _enableFlows; }
 	bool setDevicePermissions() { return _setDevicePermissions; }
 	std::string workingDirectory() { return _workingDirectory; }
@@ -86,8 +87,13 @@ public:
 	std::string logfilePath() { return _logfilePath; }
 	bool prioritizeThreads() { return _prioritizeThreads; }
 	void setPrioritizeThreads(bool value) { _prioritizeThreads = value; }
+	std::vector<int32_t> packetThreadAffinity() { return _packetThreadAffinity; }
+	std::vector<int32_t> workerThreadAffinity() { return _workerThreadAffinity; }
+	std::vector<int32_t> rpcServerThreadAffinity() { return _rpcServerThreadAffinity; }
+	std::vector<int32_t> eventThreadAffinity() { return _eventThreadAffinity; }
 	uint32_t secureMemorySize() { return _secureMemorySize; }
 	uint32_t workerThreadWindow() { return _workerThreadWindow; }
+	uint32_t eventReplayBufferSize() { return _eventReplayBufferSize; }
 	uint32_t scriptEngineThreadCount() { return _scriptEngineThreadCount; }
 	uint32_t scriptEngineServerMaxConnections() { return _scriptEngineServerMaxConnections; }
 	uint32_t scriptEngineMaxThreadsPerScript() { return _scriptEngineMaxThreadsPerScript; }
@@ -169,6 +175,7 @@ private:
 	bool _enableMonitoring = true;
 	bool _devLog = false;
 	bool _enableCoreDumps = true;
+	bool _useIoUring = false;
 	bool _enableFlows = true;
 	bool _setDevicePermissions = true;
 	std::string _workingDirectory;
@@ -189,8 +196,13 @@ private:
 	uint32_t _databaseMaxBackups = 10;
 	std::string _logfilePath;
 	bool _prioritizeThreads = true;
+	std::vector<int32_t> _packetThreadAffinity;
+	std::vector<int32_t> _workerThreadAffinity;
+	std::vector<int32_t> _rpcServerThreadAffinity;
+	std::vector<int32_t> _eventThreadAffinity;
 	uint32_t _secureMemorySize = 65536;
 	uint32_t _workerThreadWindow = 3000;
+	uint32_t _eventReplayBufferSize = 10000;
 	uint32_t _scriptEngineThreadCount = 10;
 	uint32_t _scriptEngineServerMaxConnections = 20;
 	uint32_t _scriptEngineMaxThreadsPerScript = 4;
@@ -249,6 +261,11 @@ private:
 	std::vector<uint32_t> _exportGpios;
 
 	void reset();
+
+	/**
+	 * Parses a list of CPUs like "0,2-3".
+	 */
+	std::vector<int32_t> parseCpuList(std::string value);
 };
 
 }
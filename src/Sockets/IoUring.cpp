@@ -0,0 +1,403 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "IoUring.h"
+#include "../../config.h"
+
+#include <memory>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstring>
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
+
+namespace BaseLib
+{
+
+std::atomic_int IoUring::_available(-1);
+
+IoUring::IoUring()
+{
+}
+
+IoUring::~IoUring()
+{
+	if(_submissionEntries) munmap(_submissionEntries, _submissionEntriesSize);
+	if(_completionRing && _completionRing != _submissionRing) munmap(_completionRing, _completionRingSize);
+	if(_submissionRing) munmap(_submissionRing, _submissionRingSize);
+	if(_ringDescriptor != -1) ::close(_ringDescriptor);
+}
+
+#ifdef HAVE_LINUX_IO_URING_H
+bool IoUring::isAvailable()
+{
+	int32_t available = _available;
+	if(available != -1) return available == 1;
+	std::unique_ptr<IoUring> ring(new IoUring());
+	available = (ring->init(8) && ring->probe()) ? 1 : 0;
+	_available = available;
+	return available == 1;
+}
+
+IoUring* IoUring::getThreadInstance()
+{
+	thread_local std::unique_ptr<IoUring> ring;
+	thread_local bool initialized = false;
+	if(initialized) return (ring && !ring->_broken) ? ring.get() : nullptr;
+	initialized = true;
+	if(!isAvailable()) return nullptr;
+	ring.reset(new IoUring());
+	if(!ring->init(8)) ring.reset();
+	return ring.get();
+}
+
+bool IoUring::init(uint32_t entries)
+{
+	io_uring_params parameters;
+	memset(&parameters, 0, sizeof(parameters));
+	_ringDescriptor = syscall(__NR_io_uring_setup, entries, &parameters);
+	if(_ringDescriptor < 0)
+	{
+		_ringDescriptor = -1;
+		return false;
+	}
+
+	_submissionRingSize = parameters.sq_off.array + parameters.sq_entries * sizeof(uint32_t);
+	_completionRingSize = parameters.cq_off.cqes + parameters.cq_entries * sizeof(io_uring_cqe);
+	if(parameters.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if(_completionRingSize > _submissionRingSize) _submissionRingSize = _completionRingSize;
+		_completionRingSize = _submissionRingSize;
+	}
+
+	_submissionRing = mmap(nullptr, _submissionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringDescriptor, IORING_OFF_SQ_RING);
+	if(_submissionRing == MAP_FAILED)
+	{
+		_submissionRing = nullptr;
+		return false;
+	}
+	if(parameters.features & IORING_FEAT_SINGLE_MMAP) _completionRing = _submissionRing;
+	else
+	{
+		_completionRing = mmap(nullptr, _completionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringDescriptor, IORING_OFF_CQ_RING);
+		if(_completionRing == MAP_FAILED)
+		{
+			_completionRing = nullptr;
+			return false;
+		}
+	}
+	_submissionEntriesSize = parameters.sq_entries * sizeof(io_uring_sqe);
+	_submissionEntries = mmap(nullptr, _submissionEntriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringDescriptor, IORING_OFF_SQES);
+	if(_submissionEntries == MAP_FAILED)
+	{
+		_submissionEntries = nullptr;
+		return false;
+	}
+
+	char* submissionRing = (char*)_submissionRing;
+	_submissionHead = (uint32_t*)(submissionRing + parameters.sq_off.head);
+	_submissionTail = (uint32_t*)(submissionRing + parameters.sq_off.tail);
+	_submissionMask = *(uint32_t*)(submissionRing + parameters.sq_off.ring_mask);
+	_submissionArray = (uint32_t*)(submissionRing + parameters.sq_off.array);
+
+	char* completionRing = (char*)_completionRing;
+	_completionHead = (uint32_t*)(completionRing + parameters.cq_off.head);
+	_completionTail = (uint32_t*)(completionRing + parameters.cq_off.tail);
+	_completionMask = *(uint32_t*)(completionRing + parameters.cq_off.ring_mask);
+	_completionEntries = completionRing + parameters.cq_off.cqes;
+
+	return true;
+}
+
+bool IoUring::probe()
+{
+	const uint32_t operationCount = 256;
+	std::vector<uint8_t> buffer(sizeof(io_uring_probe) + operationCount * sizeof(io_uring_probe_op), 0);
+	io_uring_probe* probe = (io_uring_probe*)buffer.data();
+	if(syscall(__NR_io_uring_register, _ringDescriptor, IORING_REGISTER_PROBE, probe, operationCount) < 0) return false;
+
+	const uint8_t neededOperations[] = { IORING_OP_POLL_ADD, IORING_OP_LINK_TIMEOUT, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_SEND, IORING_OP_RECVMSG };
+	for(uint8_t operation : neededOperations)
+	{
+		if(operation > probe->last_op || !(probe->ops[operation].flags & IO_URING_OP_SUPPORTED)) return false;
+	}
+	return true;
+}
+
+int32_t IoUring::execute(int32_t fileDescriptor, bool write, uint8_t operation, uint64_t address, uint32_t length, int32_t flags, int64_t timeout)
+{
+	if(_broken) return executeWithoutRing(fileDescriptor, write, operation, address, length, flags, timeout);
+	if(fileDescriptor < 0)
+	{
+		errno = EBADF;
+		return -1;
+	}
+	if(timeout < 0) timeout = 0;
+
+	__kernel_timespec timeoutSpec;
+	timeoutSpec.tv_sec = timeout / 1000000;
+	timeoutSpec.tv_nsec = (timeout % 1000000) * 1000;
+
+	//Chain: poll => linked timeout for the poll => operation => linked timeout for the operation. The operation can block on
+	//file descriptors without O_NONBLOCK (e. g. a pipe that is writable but can't take the whole buffer), so it needs its own
+	//timeout. When a timeout fires, the request it is linked to and the rest of the chain are cancelled.
+	uint32_t tail = *_submissionTail;
+	io_uring_sqe* entries = (io_uring_sqe*)_submissionEntries;
+
+	io_uring_sqe* entry = &entries[tail & _submissionMask];
+	memset(entry, 0, sizeof(io_uring_sqe));
+	entry->opcode = IORING_OP_POLL_ADD;
+	entry->fd = fileDescriptor;
+	entry->poll_events = write ? POLLOUT : POLLIN;
+	entry->flags = IOSQE_IO_LINK;
+	entry->user_data = 1;
+	_submissionArray[tail & _submissionMask] = tail & _submissionMask;
+	tail++;
+
+	entry = &entries[tail & _submissionMask];
+	memset(entry, 0, sizeof(io_uring_sqe));
+	entry->opcode = IORING_OP_LINK_TIMEOUT;
+	entry->fd = -1;
+	entry->addr = (uint64_t)(uintptr_t)&timeoutSpec;
+	entry->len = 1;
+	entry->flags = IOSQE_IO_LINK;
+	entry->user_data = 2;
+	_submissionArray[tail & _submissionMask] = tail & _submissionMask;
+	tail++;
+
+	entry = &entries[tail & _submissionMask];
+	memset(entry, 0, sizeof(io_uring_sqe));
+	entry->opcode = operation;
+	entry->fd = fileDescriptor;
+	entry->addr = address;
+	entry->len = length;
+	entry->off = (uint64_t)-1; //Use (and advance) the current file position
+	entry->msg_flags = flags;
+	entry->flags = IOSQE_IO_LINK;
+	entry->user_data = 3;
+	_submissionArray[tail & _submissionMask] = tail & _submissionMask;
+	tail++;
+
+	entry = &entries[tail & _submissionMask];
+	memset(entry, 0, sizeof(io_uring_sqe));
+	entry->opcode = IORING_OP_LINK_TIMEOUT;
+	entry->fd = -1;
+	entry->addr = (uint64_t)(uintptr_t)&timeoutSpec;
+	entry->len = 1;
+	entry->user_data = 4;
+	_submissionArray[tail & _submissionMask] = tail & _submissionMask;
+	tail++;
+
+	__atomic_store_n(_submissionTail, tail, __ATOMIC_RELEASE);
+
+	int32_t pollResult = 0;
+	int32_t pollTimeoutResult = 0;
+	int32_t operationResult = -ECANCELED;
+	int32_t operationTimeoutResult = 0;
+	bool operationCompleted = false;
+	uint32_t completed = 0;
+	//The linked timeouts complete everything submitted within twice the timeout. When io_uring_enter() keeps failing, give up
+	//after that. The kernel doesn't access the caller's buffer anymore then.
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(2 * timeout) + std::chrono::seconds(1);
+	while(completed < _chainLength)
+	{
+		uint32_t toSubmit = tail - __atomic_load_n(_submissionHead, __ATOMIC_ACQUIRE);
+		int32_t result = syscall(__NR_io_uring_enter, _ringDescriptor, toSubmit, _chainLength - completed, IORING_ENTER_GETEVENTS, nullptr, 0);
+		_systemCallCount++;
+		if(result < 0 && errno != EINTR)
+		{
+			bool retry = (errno == EAGAIN || errno == EBUSY);
+			if(toSubmit == _chainLength && (!retry || std::chrono::steady_clock::now() >= deadline))
+			{
+				//Nothing was submitted, so the entries can be discarded and the caller can fall back to select().
+				__atomic_store_n(_submissionTail, tail - _chainLength, __ATOMIC_RELEASE);
+				_broken = true;
+				return executeWithoutRing(fileDescriptor, write, operation, address, length, flags, timeout);
+			}
+			if(std::chrono::steady_clock::now() >= deadline)
+			{
+				//Entries not submitted yet stay in the ring, so it can't be used anymore.
+				_broken = true;
+				if(!operationCompleted)
+				{
+					errno = EIO;
+					return -1;
+				}
+				break;
+			}
+			//Entries referencing the caller's buffer might be in flight. Completions are posted without io_uring_enter(), so
+			//keep reaping them.
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+
+		uint32_t head = *_completionHead;
+		uint32_t completionTail = __atomic_load_n(_completionTail, __ATOMIC_ACQUIRE);
+		io_uring_cqe* completionEntries = (io_uring_cqe*)_completionEntries;
+		while(head != completionTail)
+		{
+			io_uring_cqe* completionEntry = &completionEntries[head & _completionMask];
+			if(completionEntry->user_data == 1) pollResult = completionEntry->res;
+			else if(completionEntry->user_data == 2) pollTimeoutResult = completionEntry->res;
+			else if(completionEntry->user_data == 3)
+			{
+				operationResult = completionEntry->res;
+				operationCompleted = true;
+			}
+			else if(completionEntry->user_data == 4) operationTimeoutResult = completionEntry->res;
+			completed++;
+			head++;
+		}
+		__atomic_store_n(_completionHead, head, __ATOMIC_RELEASE);
+	}
+
+	if(operationResult >= 0) return operationResult;
+	if(operationTimeoutResult == -ETIME && (operationResult == -ECANCELED || operationResult == -EINTR)) return -2;
+	if(operationResult == -ECANCELED)
+	{
+		if(pollResult < 0 && pollResult != -ECANCELED)
+		{
+			errno = -pollResult;
+			return -1;
+		}
+		if(pollTimeoutResult == -ETIME || pollResult == -ECANCELED) return -2;
+		errno = EAGAIN;
+		return -1;
+	}
+	errno = -operationResult;
+	return -1;
+}
+
+int32_t IoUring::executeWithoutRing(int32_t fileDescriptor, bool write, uint8_t operation, uint64_t address, uint32_t length, int32_t flags, int64_t timeout)
+{
+	pollfd pollInfo;
+	pollInfo.fd = fileDescriptor;
+	pollInfo.events = write ? POLLOUT : POLLIN;
+	pollInfo.revents = 0;
+	int32_t result = 0;
+	do
+	{
+		//Round up, so timeouts below one millisecond don't turn into a non-blocking poll.
+		result = poll(&pollInfo, 1, (timeout + 999) / 1000);
+	} while(result == -1 && errno == EINTR);
+	if(result == 0) return -2;
+	if(result < 0) return -1;
+
+	switch(operation)
+	{
+	case IORING_OP_READ:
+		return ::read(fileDescriptor, (void*)(uintptr_t)address, length);
+	case IORING_OP_WRITE:
+		return ::write(fileDescriptor, (const void*)(uintptr_t)address, length);
+	case IORING_OP_SEND:
+		return ::send(fileDescriptor, (const void*)(uintptr_t)address, length, flags);
+	case IORING_OP_RECVMSG:
+		return ::recvmsg(fileDescriptor, (msghdr*)(uintptr_t)address, flags);
+	}
+	errno = EINVAL;
+	return -1;
+}
+#else
+bool IoUring::isAvailable()
+{
+	return false;
+}
+
+IoUring* IoUring::getThreadInstance()
+{
+	return nullptr;
+}
+
+bool IoUring::init(uint32_t entries)
+{
+	return false;
+}
+
+bool IoUring::probe()
+{
+	return false;
+}
+
+int32_t IoUring::execute(int32_t fileDescriptor, bool write, uint8_t operation, uint64_t address, uint32_t length, int32_t flags, int64_t timeout)
+{
+	errno = ENOSYS;
+	return -1;
+}
+#endif
+
+int32_t IoUring::read(int32_t fileDescriptor, void* buffer, uint32_t size, int64_t timeout)
+{
+#ifdef HAVE_LINUX_IO_URING_H
+	return execute(fileDescriptor, false, IORING_OP_READ, (uint64_t)(uintptr_t)buffer, size, 0, timeout);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+int32_t IoUring::write(int32_t fileDescriptor, const void* buffer, uint32_t size, int64_t timeout)
+{
+#ifdef HAVE_LINUX_IO_URING_H
+	return execute(fileDescriptor, true, IORING_OP_WRITE, (uint64_t)(uintptr_t)buffer, size, 0, timeout);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+int32_t IoUring::send(int32_t fileDescriptor, const void* buffer, uint32_t size, int32_t flags, int64_t timeout)
+{
+#ifdef HAVE_LINUX_IO_URING_H
+	return execute(fileDescriptor, true, IORING_OP_SEND, (uint64_t)(uintptr_t)buffer, size, flags, timeout);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+int32_t IoUring::recvmsg(int32_t fileDescriptor, msghdr* message, int32_t flags, int64_t timeout)
+{
+#ifdef HAVE_LINUX_IO_URING_H
+	return execute(fileDescriptor, false, IORING_OP_RECVMSG, (uint64_t)(uintptr_t)message, 1, flags, timeout);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+}
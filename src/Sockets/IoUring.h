@@ -0,0 +1,150 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef IOURING_H_
+#define IOURING_H_
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+#include <sys/socket.h>
+
+namespace BaseLib
+{
+
+/**
+ * Minimal io_uring wrapper (Linux 5.6 or newer) to wait for a file descriptor and read from or write to it with a single
+ * system call instead of select() followed by read() or write(). A poll request and the actual operation, each with a linked
+ * timeout, are submitted and reaped with one io_uring_enter() call.
+ *
+ * Every thread gets its own ring, so no locking is necessary. When io_uring is not supported by the kernel or blocked
+ * (e. g. by seccomp), getThreadInstance() returns nullptr and callers need to fall back to select().
+ *
+ * Only the number of system calls is reduced. Requests are not batched, because every call waits for its own result, and
+ * no registered buffers are used, because the callers' buffers change with every call and would need to be copied. The
+ * round trip latency is not lower than with select() (see "benchmarks/IoUring.cpp"), so the ring is only used when
+ * "useIoUring" is enabled in main.conf. This mainly helps on systems where system calls are expensive.
+ */
+class IoUring
+{
+public:
+	virtual ~IoUring();
+
+	/**
+	 * Checks once per process if io_uring and all needed operations are supported.
+	 */
+	static bool isAvailable();
+
+	/**
+	 * Returns the ring of the calling thread or nullptr if io_uring is not available.
+	 */
+	static IoUring* getThreadInstance();
+
+	/**
+	 * Waits until "fileDescriptor" is readable and reads up to "size" bytes.
+	 *
+	 * @param fileDescriptor The descriptor to read from.
+	 * @param buffer The buffer to read into.
+	 * @param size The size of the buffer.
+	 * @param timeout The maximum time to wait for data in microseconds.
+	 * @return Returns the number of bytes read, "0" on end of file, "-1" on error (errno is set) or "-2" on timeout.
+	 */
+	int32_t read(int32_t fileDescriptor, void* buffer, uint32_t size, int64_t timeout);
+
+	/**
+	 * Waits until "fileDescriptor" is writable and writes up to "size" bytes.
+	 *
+	 * @return Returns the number of bytes written, "-1" on error (errno is set) or "-2" on timeout.
+	 */
+	int32_t write(int32_t fileDescriptor, const void* buffer, uint32_t size, int64_t timeout);
+
+	/**
+	 * Waits until the socket "fileDescriptor" is writable and sends up to "size" bytes.
+	 *
+	 * @return Returns the number of bytes sent, "-1" on error (errno is set) or "-2" on timeout.
+	 */
+	int32_t send(int32_t fileDescriptor, const void* buffer, uint32_t size, int32_t flags, int64_t timeout);
+
+	/**
+	 * Waits until the socket "fileDescriptor" is readable and receives one message.
+	 *
+	 * @return Returns the number of bytes received, "-1" on error (errno is set) or "-2" on timeout.
+	 */
+	int32_t recvmsg(int32_t fileDescriptor, msghdr* message, int32_t flags, int64_t timeout);
+
+	/**
+	 * Returns the number of io_uring_enter() calls made by this ring.
+	 */
+	uint64_t getSystemCallCount() { return _systemCallCount; }
+private:
+	/**
+	 * Number of submission entries per call: poll, linked timeout, operation, linked timeout.
+	 */
+	static const uint32_t _chainLength = 4;
+
+	static std::atomic_int _available;
+
+	int32_t _ringDescriptor = -1;
+	bool _broken = false;
+	uint64_t _systemCallCount = 0;
+
+	void* _submissionRing = nullptr;
+	size_t _submissionRingSize = 0;
+	void* _completionRing = nullptr;
+	size_t _completionRingSize = 0;
+	void* _submissionEntries = nullptr;
+	size_t _submissionEntriesSize = 0;
+
+	uint32_t* _submissionHead = nullptr;
+	uint32_t* _submissionTail = nullptr;
+	uint32_t _submissionMask = 0;
+	uint32_t* _submissionArray = nullptr;
+	uint32_t* _completionHead = nullptr;
+	uint32_t* _completionTail = nullptr;
+	uint32_t _completionMask = 0;
+	void* _completionEntries = nullptr;
+
+	IoUring();
+	IoUring(const IoUring&);
+	IoUring& operator=(const IoUring&);
+
+	bool init(uint32_t entries);
+	bool probe();
+	int32_t execute(int32_t fileDescriptor, bool write, uint8_t operation, uint64_t address, uint32_t length, int32_t flags, int64_t timeout);
+
+	/**
+	 * Fallback using poll() when the ring stopped working after it was created.
+	 */
+	int32_t executeWithoutRing(int32_t fileDescriptor, bool write, uint8_t operation, uint64_t address, uint32_t length, int32_t flags, int64_t timeout);
+};
+
+}
+#endif
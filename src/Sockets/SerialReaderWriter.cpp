@@ -30,6 +30,7 @@
 
 #include "SerialReaderWriter.h"
 #include "../BaseLib.h"
+#include "IoUring.h"
 
 namespace BaseLib
 {
@@ -183,8 +184,9 @@ void SerialReaderWriter::openDevice(bool parity, bool oddParity, bool events)
 	{
 		_readThreadMutex.lock();
 		_bl->threadManager.join(_readThread);
-		if(_readThreadPriority > -1) _bl->threadManager.start(_readThread, true, _readThreadPriority, SCHED_FIFO, &SerialReaderWriter::readThread, this, parity, oddParity);
-		else _bl->threadManager.start(_readThread, true, &SerialReaderWriter::readThread, this, parity, oddParity);
+		std::string threadName = _device.substr(_device.find_last_of('/') + 1);
+		if(_readThreadPriority > -1) _bl->threadManager.start(threadName, ThreadManager::ThreadCategory::packet, _readThread, true, _readThreadPriority, SCHED_FIFO, &SerialReaderWriter::readThread, this, parity, oddParity);
+		else _bl->threadManager.start(threadName, ThreadManager::ThreadCategory::packet, _readThread, true, &SerialReaderWriter::readThread, this, parity, oddParity);
 		_readThreadMutex.unlock();
 	}
 }
@@ -238,6 +240,7 @@ int32_t SerialReaderWriter::readChar(char& data, uint32_t timeout)
 {
 	int32_t i;
 	fd_set readFileDescriptor;
+	IoUring* ioUring = _bl->settings.useIoUring() ? IoUring::getThreadInstance() : nullptr;
 	while(!_stopReadThread)
 	{
 		if(_fileDescriptor->descriptor == -1)
@@ -245,25 +248,34 @@ int32_t SerialReaderWriter::readChar(char& data, uint32_t timeout)
 			_bl->out.printError("Error: File descriptor is invalid.");
 			return -1;
 		}
-		FD_ZERO(&readFileDescriptor);
-		FD_SET(_fileDescriptor->descriptor, &readFileDescriptor);
-		//Timeout needs to be set every time, so don't put it outside of the while loop
-		timeval timeval;
-		timeval.tv_sec = timeout / 1000000;
-		timeval.tv_usec = timeout % 1000000;
-		i = select(_fileDescriptor->descriptor + 1, &readFileDescriptor, NULL, NULL, &timeval);
-		switch(i)
+		if(ioUring)
 		{
-			case 0: //Timeout
-				return 1;
-			case 1:
-				break;
-			default:
-				//Error
-				_bl->fileDescriptorManager.close(_fileDescriptor);
-				return -1;
+			//Wait and read with one system call
+			i = ioUring->read(_fileDescriptor->descriptor, &data, 1, timeout);
+			if(i == -2) return 1; //Timeout
+		}
+		else
+		{
+			FD_ZERO(&readFileDescriptor);
+			FD_SET(_fileDescriptor->descriptor, &readFileDescriptor);
+			//Timeout needs to be set every time, so don't put it outside of the while loop
+			timeval timeval;
+			timeval.tv_sec = timeout / 1000000;
+			timeval.tv_usec = timeout % 1000000;
+			i = select(_fileDescriptor->descriptor + 1, &readFileDescriptor, NULL, NULL, &timeval);
+			switch(i)
+			{
+				case 0: //Timeout
+					return 1;
+				case 1:
+					break;
+				default:
+					//Error
+					_bl->fileDescriptorManager.close(_fileDescriptor);
+					return -1;
+			}
+			i = read(_fileDescriptor->descriptor, &data, 1);
 		}
-		i = read(_fileDescriptor->descriptor, &data, 1);
 		if(i == -1 || i == 0)
 		{
 			if(i == -1 && errno == EAGAIN) continue;
@@ -281,6 +293,7 @@ int32_t SerialReaderWriter::readLine(std::string& data, uint32_t timeout)
 	int32_t i;
 	char localBuffer[1];
 	fd_set readFileDescriptor;
+	IoUring* ioUring = _bl->settings.useIoUring() ? IoUring::getThreadInstance() : nullptr;
 	while(!_stopReadThread)
 	{
 		if(_fileDescriptor->descriptor == -1)
@@ -288,25 +301,34 @@ int32_t SerialReaderWriter::readLine(std::string& data, uint32_t timeout)
 			_bl->out.printError("Error: File descriptor is invalid.");
 			return -1;
 		}
-		FD_ZERO(&readFileDescriptor);
-		FD_SET(_fileDescriptor->descriptor, &readFileDescriptor);
-		//Timeout needs to be set every time, so don't put it outside of the while loop
-		timeval timeval;
-		timeval.tv_sec = timeout / 1000000;
-		timeval.tv_usec = timeout % 1000000;
-		i = select(_fileDescriptor->descriptor + 1, &readFileDescriptor, NULL, NULL, &timeval);
-		switch(i)
+		if(ioUring)
 		{
-			case 0: //Timeout
-				return 1;
-			case 1:
-				break;
-			default:
-				//Error
-				_bl->fileDescriptorManager.close(_fileDescriptor);
-				return -1;
+			//Wait and read with one system call
+			i = ioUring->read(_fileDescriptor->descriptor, localBuffer, 1, timeout);
+			if(i == -2) return 1; //Timeout
+		}
+		else
+		{
+			FD_ZERO(&readFileDescriptor);
+			FD_SET(_fileDescriptor->descriptor, &readFileDescriptor);
+			//Timeout needs to be set every time, so don't put it outside of the while loop
+			timeval timeval;
+			timeval.tv_sec = timeout / 1000000;
+			timeval.tv_usec = timeout % 1000000;
+			i = select(_fileDescriptor->descriptor + 1, &readFileDescriptor, NULL, NULL, &timeval);
+			switch(i)
+			{
+				case 0: //Timeout
+					return 1;
+				case 1:
+					break;
+				default:
+					//Error
+					_bl->fileDescriptorManager.close(_fileDescriptor);
+					return -1;
+			}
+			i = read(_fileDescriptor->descriptor, localBuffer, 1);
 		}
-		i = read(_fileDescriptor->descriptor, localBuffer, 1);
 		if(i == -1)
 		{
 			if(errno == EAGAIN) continue;
@@ -487,13 +509,14 @@ void SerialReaderWriter::readThread(bool parity, bool oddParity)
 			}
 			if(readLine(data) == 0)
 			{
-				EventHandlers eventHandlers = getEventHandlers();
-				for(EventHandlers::const_iterator i = eventHandlers.begin(); i != eventHandlers.end(); ++i)
+				PEventHandlerList eventHandlers = getEventHandlerList();
+				for(EventHandlerList::const_iterator i = eventHandlers->begin(); i != eventHandlers->end(); ++i)
 				{
-					i->second->lock();
+					(*i)->lock();
 					try
 					{
-						if(i->second->handler()) ((ISerialReaderWriterEventSink*)i->second->handler())->lineReceived(data);
+						IEventSinkBase* handler = (*i)->handler();
+						if(handler) ((ISerialReaderWriterEventSink*)handler)->lineReceived(data);
 					}
 					catch(const std::exception& ex)
 					{
@@ -507,7 +530,7 @@ void SerialReaderWriter::readThread(bool parity, bool oddParity)
 					{
 						_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
 					}
-					i->second->unlock();
+					(*i)->unlock();
 				}
 			}
 			continue;
@@ -36,6 +36,46 @@
 namespace BaseLib
 {
 
+bool SsdpDescriptionCache::get(const std::string& location, std::string& ip, PVariable& info)
+{
+	int64_t time = HelperFunctions::getTime();
+	std::lock_guard<std::mutex> cacheGuard(_cacheMutex);
+	auto cacheIterator = _cache.find(location);
+	if(cacheIterator == _cache.end()) return false;
+	if(cacheIterator->second.expirationTime <= time)
+	{
+		_cache.erase(cacheIterator);
+		return false;
+	}
+	ip = cacheIterator->second.ip;
+	info = cacheIterator->second.info;
+	return true;
+}
+
+void SsdpDescriptionCache::set(const std::string& location, int32_t maxAge, const std::string& ip, const PVariable& info)
+{
+	int64_t time = HelperFunctions::getTime();
+	std::lock_guard<std::mutex> cacheGuard(_cacheMutex);
+	if(_cache.size() > 1000)
+	{
+		for(auto i = _cache.begin(); i != _cache.end();)
+		{
+			if(i->second.expirationTime <= time) i = _cache.erase(i);
+			else ++i;
+		}
+	}
+	CacheEntry& entry = _cache[location];
+	entry.expirationTime = time + (int64_t)maxAge * 1000;
+	entry.ip = ip;
+	entry.info = info;
+}
+
+void SsdpDescriptionCache::clear()
+{
+	std::lock_guard<std::mutex> cacheGuard(_cacheMutex);
+	_cache.clear();
+}
+
 SsdpInfo::SsdpInfo(std::string ip, PVariable info)
 {
 	_ip = ip;
@@ -60,11 +100,14 @@ const PVariable SsdpInfo::info()
 Ssdp::Ssdp(SharedObjects* baseLib)
 {
 	_bl = baseLib;
+	_listening = false;
+	_stopListening = false;
 	getAddress();
 }
 
 Ssdp::~Ssdp()
 {
+	stopListening();
 }
 
 void Ssdp::getAddress()
@@ -190,8 +233,17 @@ void Ssdp::sendSearchBroadcast(std::shared_ptr<FileDescriptor>& serverSocketDesc
 }
 
 void Ssdp::searchDevices(const std::string& stHeader, uint32_t timeout, std::vector<SsdpInfo>& devices)
+{
+	searchDevices(stHeader, timeout, devices, std::function<void(const SsdpInfo&)>());
+}
+
+void Ssdp::searchDevices(const std::string& stHeader, uint32_t timeout, std::vector<SsdpInfo>& devices, std::function<void(const SsdpInfo&)> deviceFoundCallback)
 {
 	std::shared_ptr<FileDescriptor> serverSocketDescriptor;
+	std::shared_ptr<DeviceInfoQueue> queue = std::make_shared<DeviceInfoQueue>();
+	queue->deviceFoundCallback.swap(deviceFoundCallback);
+	std::vector<std::thread> threads;
+	threads.reserve(_maxConcurrentRequests);
 	try
 	{
 		if(stHeader.empty())
@@ -218,6 +270,8 @@ void Ssdp::searchDevices(const std::string& stHeader, uint32_t timeout, std::vec
 		int32_t nfds = 0;
 		Http http;
 		std::set<std::string> locations;
+		std::string location;
+		int32_t maxAge = 0;
 		while(_bl->hf.getTime() - startTime <= (timeout + 500))
 		{
 			try
@@ -251,7 +305,22 @@ void Ssdp::searchDevices(const std::string& stHeader, uint32_t timeout, std::vec
 				if(_bl->debugLevel >= 5)_bl->out.printDebug("Debug: SSDP response received:\n" + std::string(buffer, bytesReceived));
 				http.reset();
 				http.process(buffer, bytesReceived, false);
-				if(http.headerIsFinished()) processPacket(http, stHeader, locations);
+				if(!http.headerIsFinished() || !processPacket(http, stHeader, location, maxAge)) continue;
+				auto usnIterator = http.getHeader().fields.find("usn");
+				if(usnIterator != http.getHeader().fields.end()) updateRegistry(usnIterator->second, stHeader, location, maxAge);
+				if(!locations.insert(location).second) continue;
+
+				//Start fetching the description right away instead of waiting for the search to finish.
+				{
+					std::lock_guard<std::mutex> queueGuard(queue->mutex);
+					queue->locations.emplace_back(location, maxAge);
+				}
+				queue->conditionVariable.notify_one();
+				if(threads.size() < _maxConcurrentRequests && threads.size() < locations.size())
+				{
+					threads.emplace_back();
+					if(!_bl->threadManager.start(threads.back(), false, &Ssdp::deviceInfoThread, this, queue)) threads.pop_back();
+				}
 			}
 			catch(const std::exception& ex)
 			{
@@ -266,7 +335,6 @@ void Ssdp::searchDevices(const std::string& stHeader, uint32_t timeout, std::vec
 				_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
 			}
 		}
-		getDeviceInfo(locations, devices);
 	}
 	catch(const std::exception& ex)
 	{
@@ -281,18 +349,37 @@ void Ssdp::searchDevices(const std::string& stHeader, uint32_t timeout, std::vec
 		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
 	}
 	_bl->fileDescriptorManager.shutdown(serverSocketDescriptor);
+
+	fetchDeviceInfo(queue, threads);
+	std::lock_guard<std::mutex> devicesGuard(queue->devicesMutex);
+	devices.insert(devices.end(), queue->devices.begin(), queue->devices.end());
+}
+
+void Ssdp::fetchDeviceInfo(std::shared_ptr<DeviceInfoQueue> queue, std::vector<std::thread>& threads)
+{
+	{
+		std::lock_guard<std::mutex> queueGuard(queue->mutex);
+		queue->searchFinished = true;
+	}
+	queue->conditionVariable.notify_all();
+	deviceInfoThread(queue); //Help fetching the remaining descriptions. This also covers the case that no thread could be started.
+	for(auto& thread : threads)
+	{
+		_bl->threadManager.join(thread);
+	}
 }
 
-void Ssdp::processPacket(Http& http, const std::string& stHeader, std::set<std::string>& locations)
+bool Ssdp::processPacket(Http& http, const std::string& stHeader, std::string& location, int32_t& maxAge)
 {
 	try
 	{
 		Http::Header& header = http.getHeader();
-		if(header.responseCode != 200 || header.fields.at("st") != stHeader) return;
+		if(header.responseCode != 200 || header.fields.at("st") != stHeader) return false;
 
-		std::string location = header.fields.at("location");
-		if(location.size() < 7) return;
-		locations.insert(location);
+		location = header.fields.at("location");
+		if(location.size() < 7) return false;
+		maxAge = getMaxAge(http);
+		return true;
 	}
 	catch(const std::exception& ex)
 	{
@@ -306,45 +393,344 @@ void Ssdp::processPacket(Http& http, const std::string& stHeader, std::set<std::
 	{
 		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
 	}
+	return false;
 }
 
-void Ssdp::getDeviceInfo(std::set<std::string>& locations, std::vector<SsdpInfo>& devices)
+int32_t Ssdp::getMaxAge(Http& http)
 {
+	auto fieldIterator = http.getHeader().fields.find("cache-control");
+	if(fieldIterator == http.getHeader().fields.end()) return 0;
+	std::string cacheControl = fieldIterator->second;
+	HelperFunctions::toLower(cacheControl);
+	std::string::size_type pos = cacheControl.find("max-age");
+	if(pos == std::string::npos) return 0;
+	pos = cacheControl.find('=', pos);
+	if(pos == std::string::npos) return 0;
+	std::string maxAge = cacheControl.substr(pos + 1);
+	HelperFunctions::trim(maxAge);
+	int32_t result = Math::getNumber(maxAge, false);
+	return result < 0 ? 0 : result;
+}
+
+void Ssdp::clearCache()
+{
+	_bl->ssdpDescriptionCache.clear();
+}
+
+void Ssdp::deviceInfoThread(std::shared_ptr<DeviceInfoQueue> queue)
+{
+	while(true)
+	{
+		std::pair<std::string, int32_t> location;
+		{
+			std::unique_lock<std::mutex> queueGuard(queue->mutex);
+			queue->conditionVariable.wait(queueGuard, [&] { return !queue->locations.empty() || queue->searchFinished; });
+			if(queue->locations.empty()) return;
+			location = std::move(queue->locations.front());
+			queue->locations.pop_front();
+		}
+
+		try
+		{
+			std::string ip;
+			PVariable info;
+			if(getDeviceInfo(location.first, location.second, ip, info)) addDevice(queue, ip, info);
+		}
+		catch(const std::exception& ex)
+		{
+			_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+		}
+		catch(Exception& ex)
+		{
+			_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+		}
+		catch(...)
+		{
+			_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+		}
+	}
+}
+
+void Ssdp::addDevice(std::shared_ptr<DeviceInfoQueue>& queue, const std::string& ip, const PVariable& info)
+{
+	SsdpInfo device(ip, info);
+	{
+		std::lock_guard<std::mutex> devicesGuard(queue->devicesMutex);
+		queue->devices.push_back(device);
+	}
+	//Don't hold "devicesMutex" while calling external code.
+	if(queue->deviceFoundCallback) queue->deviceFoundCallback(device);
+}
+
+bool Ssdp::getDeviceInfo(const std::string& location, int32_t maxAge, std::string& ip, PVariable& info)
+{
+	if(_bl->ssdpDescriptionCache.get(location, ip, info)) return true;
+
+	std::string::size_type posPort = location.find(':', 7);
+	if(posPort == std::string::npos) return false;
+	std::string::size_type posPath = location.find('/', posPort);
+	if(posPath == std::string::npos) return false;
+	ip = location.substr(7, posPort - 7);
+	std::string portString = location.substr(posPort + 1, posPath - posPort - 1);
+	int32_t port = Math::getNumber(portString, false);
+	if(port <= 0 || port > 65535) return false;
+	std::string path = location.substr(posPath);
+
+	HttpClient client(_bl, ip, port, false);
+	std::string xml;
+	client.get(path, xml);
+
+	if(!xml.empty())
+	{
+		xml_document<> doc;
+		doc.parse<parse_no_entity_translation | parse_validate_closing_tags>(&xml.at(0));
+		xml_node<>* node = doc.first_node("root");
+		if(node)
+		{
+			node = node->first_node("device");
+			if(node)
+			{
+				info.reset(new Variable(node));
+			}
+		}
+	}
+
+	if(info && maxAge > 0) _bl->ssdpDescriptionCache.set(location, maxAge, ip, info);
+	return true;
+}
+
+// {{{ Announcement listener
+std::shared_ptr<FileDescriptor> Ssdp::getListenSocketDescriptor()
+{
+	std::shared_ptr<FileDescriptor> listenSocketDescriptor;
 	try
 	{
-		for(std::set<std::string>::iterator i = locations.begin(); i != locations.end(); ++i)
+		if(_address.empty()) getAddress();
+		if(_address.empty()) return listenSocketDescriptor;
+		listenSocketDescriptor = _bl->fileDescriptorManager.add(socket(AF_INET, SOCK_DGRAM, 0));
+		if(listenSocketDescriptor->descriptor == -1)
+		{
+			_bl->out.printError("Error: Could not create socket.");
+			return listenSocketDescriptor;
+		}
+
+		int32_t reuse = 1;
+		if(setsockopt(listenSocketDescriptor->descriptor, SOL_SOCKET, SO_REUSEADDR, (char *)&reuse, sizeof(reuse)) == -1)
+		{
+			_bl->out.printWarning("Warning: Could not set SSDP socket options: " + std::string(strerror(errno)));
+		}
+
+		//Multicast packets are only received when the socket is not bound to a unicast address.
+		struct sockaddr_in localSock;
+		memset((char *) &localSock, 0, sizeof(localSock));
+		localSock.sin_family = AF_INET;
+		localSock.sin_port = htons(1900);
+		localSock.sin_addr.s_addr = htonl(INADDR_ANY);
+
+		if(bind(listenSocketDescriptor->descriptor, (struct sockaddr*)&localSock, sizeof(localSock)) == -1)
+		{
+			_bl->out.printError("Error: Binding to SSDP port 1900 failed: " + std::string(strerror(errno)));
+			_bl->fileDescriptorManager.close(listenSocketDescriptor);
+			return listenSocketDescriptor;
+		}
+
+		struct ip_mreq group;
+		group.imr_multiaddr.s_addr = inet_addr("239.255.255.250");
+		group.imr_interface.s_addr = inet_addr(_address.c_str());
+
+		if(setsockopt(listenSocketDescriptor->descriptor, IPPROTO_IP, IP_ADD_MEMBERSHIP, (char *)&group, sizeof(group)) == -1)
+		{
+			_bl->out.printError("Error: Could not join SSDP multicast group: " + std::string(strerror(errno)));
+			_bl->fileDescriptorManager.close(listenSocketDescriptor);
+			return listenSocketDescriptor;
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return listenSocketDescriptor;
+}
+
+void Ssdp::startListening()
+{
+	stopListening();
+	_stopListening = false;
+	_listening = true;
+	if(!_bl->threadManager.start(_listenThread, true, &Ssdp::listen, this)) _listening = false;
+}
+
+void Ssdp::stopListening()
+{
+	_stopListening = true;
+	_bl->threadManager.join(_listenThread);
+	_listening = false;
+}
+
+void Ssdp::listen()
+{
+	std::shared_ptr<FileDescriptor> listenSocketDescriptor;
+	char buffer[1024];
+	Http http;
+	int64_t lastCleanup = HelperFunctions::getTime();
+	while(!_stopListening)
+	{
+		try
 		{
-			std::string::size_type posPort = (*i).find(':', 7);
-			if(posPort == std::string::npos) return;
-			std::string::size_type posPath = (*i).find('/', posPort);
-			if(posPath == std::string::npos) return;
-			std::string ip = (*i).substr(7, posPort - 7);
-			std::string portString = (*i).substr(posPort + 1, posPath - posPort - 1);
-			int32_t port = Math::getNumber(portString, false);
-			if(port <= 0 || port > 65535) return;
-			std::string path = (*i).substr(posPath);
-
-			HttpClient client(_bl, ip, port, false);
-			std::string xml;
-			client.get(path, xml);
-
-			PVariable infoStruct;
-			if(!xml.empty())
+			if(!listenSocketDescriptor || listenSocketDescriptor->descriptor == -1)
 			{
-				xml_document<> doc;
-				doc.parse<parse_no_entity_translation | parse_validate_closing_tags>(&xml.at(0));
-				xml_node<>* node = doc.first_node("root");
-				if(node)
+				listenSocketDescriptor = getListenSocketDescriptor();
+				if(!listenSocketDescriptor || listenSocketDescriptor->descriptor == -1)
 				{
-					node = node->first_node("device");
-					if(node)
-					{
-						infoStruct.reset(new Variable(node));
-					}
+					for(int32_t i = 0; i < 50 && !_stopListening; i++) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+					continue;
 				}
 			}
-			devices.push_back(SsdpInfo(ip, infoStruct));
+
+			if(HelperFunctions::getTime() - lastCleanup > 1000)
+			{
+				lastCleanup = HelperFunctions::getTime();
+				removeExpiredRegistryEntries();
+			}
+
+			timeval socketTimeout;
+			socketTimeout.tv_sec = 0;
+			socketTimeout.tv_usec = 100000;
+			fd_set readFileDescriptor;
+			FD_ZERO(&readFileDescriptor);
+			auto fileDescriptorGuard = _bl->fileDescriptorManager.getLock();
+			fileDescriptorGuard.lock();
+			int32_t nfds = listenSocketDescriptor->descriptor + 1;
+			if(nfds <= 0)
+			{
+				fileDescriptorGuard.unlock();
+				continue;
+			}
+			FD_SET(listenSocketDescriptor->descriptor, &readFileDescriptor);
+			fileDescriptorGuard.unlock();
+			int32_t result = select(nfds, &readFileDescriptor, NULL, NULL, &socketTimeout);
+			if(result == 0) continue;
+			if(result != 1)
+			{
+				if(result == -1 && errno == EINTR) continue;
+				_bl->out.printError("Error: SSDP listen socket closed.");
+				_bl->fileDescriptorManager.shutdown(listenSocketDescriptor);
+				continue;
+			}
+
+			int32_t bytesReceived = recv(listenSocketDescriptor->descriptor, buffer, sizeof(buffer), 0);
+			if(bytesReceived <= 0) continue;
+			http.reset();
+			http.process(buffer, bytesReceived, false);
+			if(http.headerIsFinished()) processNotification(http);
+		}
+		catch(const std::exception& ex)
+		{
+			_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+		}
+		catch(Exception& ex)
+		{
+			_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+		}
+		catch(...)
+		{
+			_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+		}
+	}
+	_bl->fileDescriptorManager.shutdown(listenSocketDescriptor);
+}
+
+void Ssdp::processNotification(Http& http)
+{
+	Http::Header& header = http.getHeader();
+	if(header.method != "NOTIFY") return;
+
+	auto usnIterator = header.fields.find("usn");
+	auto ntsIterator = header.fields.find("nts");
+	auto ntIterator = header.fields.find("nt");
+	if(usnIterator == header.fields.end() || ntsIterator == header.fields.end() || ntIterator == header.fields.end()) return;
+
+	if(ntsIterator->second == "ssdp:byebye")
+	{
+		if(_bl->debugLevel >= 5) _bl->out.printDebug("Debug: SSDP device " + usnIterator->second + " left.");
+		std::lock_guard<std::mutex> registryGuard(_registryMutex);
+		_registry.erase(usnIterator->second);
+	}
+	else if(ntsIterator->second == "ssdp:alive")
+	{
+		auto locationIterator = header.fields.find("location");
+		if(locationIterator == header.fields.end() || locationIterator->second.size() < 7) return;
+		updateRegistry(usnIterator->second, ntIterator->second, locationIterator->second, getMaxAge(http));
+	}
+}
+
+void Ssdp::updateRegistry(const std::string& usn, const std::string& notificationType, const std::string& location, int32_t maxAge)
+{
+	if(usn.empty()) return;
+	if(maxAge <= 0) maxAge = 1800; //Default recommended by the UPnP device architecture
+	std::lock_guard<std::mutex> registryGuard(_registryMutex);
+	RegistryEntry& entry = _registry[usn];
+	if(_bl->debugLevel >= 5 && entry.location.empty()) _bl->out.printDebug("Debug: New SSDP device " + usn + " at " + location + ".");
+	entry.notificationType = notificationType;
+	entry.location = location;
+	entry.maxAge = maxAge;
+	entry.expirationTime = HelperFunctions::getTime() + (int64_t)maxAge * 1000;
+}
+
+void Ssdp::removeExpiredRegistryEntries()
+{
+	int64_t time = HelperFunctions::getTime();
+	std::lock_guard<std::mutex> registryGuard(_registryMutex);
+	for(auto i = _registry.begin(); i != _registry.end();)
+	{
+		if(i->second.expirationTime <= time) i = _registry.erase(i);
+		else ++i;
+	}
+}
+
+void Ssdp::getDevices(const std::string& stHeader, std::vector<SsdpInfo>& devices)
+{
+	try
+	{
+		std::shared_ptr<DeviceInfoQueue> queue = std::make_shared<DeviceInfoQueue>();
+		{
+			int64_t time = HelperFunctions::getTime();
+			std::set<std::string> locations;
+			std::lock_guard<std::mutex> registryGuard(_registryMutex);
+			for(auto& entry : _registry)
+			{
+				if(entry.second.expirationTime <= time || (stHeader != "ssdp:all" && entry.second.notificationType != stHeader)) continue;
+				if(!locations.insert(entry.second.location).second) continue;
+				int32_t remainingMaxAge = (entry.second.expirationTime - time) / 1000;
+				queue->locations.emplace_back(entry.second.location, remainingMaxAge);
+			}
+		}
+		if(queue->locations.empty()) return;
+
+		std::vector<std::thread> threads;
+		uint32_t threadCount = std::min((uint32_t)queue->locations.size() - 1, _maxConcurrentRequests - 1);
+		threads.reserve(threadCount);
+		for(uint32_t i = 0; i < threadCount; i++)
+		{
+			threads.emplace_back();
+			if(!_bl->threadManager.start(threads.back(), false, &Ssdp::deviceInfoThread, this, queue))
+			{
+				threads.pop_back();
+				break;
+			}
 		}
+		fetchDeviceInfo(queue, threads);
+
+		std::lock_guard<std::mutex> devicesGuard(queue->devicesMutex);
+		devices.insert(devices.end(), queue->devices.begin(), queue->devices.end());
 	}
 	catch(const std::exception& ex)
 	{
@@ -359,5 +745,6 @@ void Ssdp::getDeviceInfo(std::set<std::string>& locations, std::vector<SsdpInfo>
 		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
 	}
 }
+// }}}
 
 }
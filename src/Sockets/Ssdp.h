@@ -38,6 +38,13 @@
 #include <vector>
 #include <memory>
 #include <set>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <thread>
+#include <atomic>
 
 namespace BaseLib
 {
@@ -57,6 +64,44 @@ private:
 	PVariable _info;
 };
 
+/**
+ * Cache for SSDP device descriptions keyed by their location URL. Entries expire after the "max-age" sent by the device. One
+ * instance is owned by SharedObjects and used by all Ssdp objects.
+ */
+class SsdpDescriptionCache
+{
+public:
+	SsdpDescriptionCache() {}
+	virtual ~SsdpDescriptionCache() {}
+
+	/**
+	 * Returns the cached description for "location" when it didn't expire yet.
+	 *
+	 * @return Returns "true" when an entry was found.
+	 */
+	bool get(const std::string& location, std::string& ip, PVariable& info);
+
+	/**
+	 * Stores a description for "maxAge" seconds.
+	 */
+	void set(const std::string& location, int32_t maxAge, const std::string& ip, const PVariable& info);
+
+	/**
+	 * Removes all entries.
+	 */
+	void clear();
+private:
+	struct CacheEntry
+	{
+		int64_t expirationTime = 0;
+		std::string ip;
+		PVariable info;
+	};
+
+	std::mutex _cacheMutex;
+	std::map<std::string, CacheEntry> _cache;
+};
+
 class Ssdp
 {
 public:
@@ -71,15 +116,98 @@ public:
 	 * @param[out] devices The found devices with device information parsed from XML to a Homegear variable struct.
 	 */
 	void searchDevices(const std::string& stHeader, uint32_t timeout, std::vector<SsdpInfo>& devices);
+
+	/**
+	 * Searches for SSDP devices and returns the IPv4 addresses. Device descriptions are fetched in parallel while responses
+	 * are still being received and "deviceFoundCallback" is called as soon as a description is available.
+	 *
+	 * @param[in] stHeader The ST header with the URN to search for (e. g. urn:schemas-upnp-org:device:basic:1)
+	 * @param[in] timeout The time to wait for responses
+	 * @param[out] devices The found devices with device information parsed from XML to a Homegear variable struct.
+	 * @param[in] deviceFoundCallback Called for every device from one of the fetching threads. Can be empty.
+	 */
+	void searchDevices(const std::string& stHeader, uint32_t timeout, std::vector<SsdpInfo>& devices, std::function<void(const SsdpInfo&)> deviceFoundCallback);
+
+	/**
+	 * Sets the maximum number of device descriptions fetched at the same time. The default is 8.
+	 */
+	void setMaxConcurrentRequests(uint32_t value) { _maxConcurrentRequests = value == 0 ? 1 : value; }
+
+	/**
+	 * Removes all device descriptions from the description cache.
+	 */
+	void clearCache();
+
+	/**
+	 * Starts a thread listening for "NOTIFY" announcements on the SSDP multicast group. Announced devices are stored in a
+	 * registry until they send "ssdp:byebye" or their "max-age" expires. Responses to searches started by this object
+	 * are also added to the registry.
+	 */
+	void startListening();
+
+	/**
+	 * Stops the listening thread started by startListening() and waits for it to finish. The registry is kept.
+	 */
+	void stopListening();
+
+	/**
+	 * Returns "true" when the listening thread is running.
+	 */
+	bool isListening() { return _listening; }
+
+	/**
+	 * Returns the devices from the announcement registry without sending a search. Call startListening() first and use
+	 * searchDevices() when the registry is empty or incomplete (e. g. right after start up).
+	 *
+	 * @param[in] stHeader The notification type to return devices for (e. g. urn:schemas-upnp-org:device:basic:1) or "ssdp:all".
+	 * @param[out] devices The known devices with device information parsed from XML to a Homegear variable struct.
+	 */
+	void getDevices(const std::string& stHeader, std::vector<SsdpInfo>& devices);
 private:
+	struct DeviceInfoQueue
+	{
+		std::mutex mutex;
+		std::condition_variable conditionVariable;
+		std::deque<std::pair<std::string, int32_t>> locations;
+		bool searchFinished = false;
+		std::mutex devicesMutex;
+		std::vector<SsdpInfo> devices;
+		std::function<void(const SsdpInfo&)> deviceFoundCallback;
+	};
+
 	BaseLib::SharedObjects* _bl = nullptr;
 	std::string _address;
 	int32_t _port = 1900;
+	uint32_t _maxConcurrentRequests = 8;
+
+	struct RegistryEntry
+	{
+		std::string notificationType;
+		std::string location;
+		int32_t maxAge = 0;
+		int64_t expirationTime = 0;
+	};
+
+	std::atomic_bool _listening;
+	std::atomic_bool _stopListening;
+	std::thread _listenThread;
+	std::mutex _registryMutex;
+	std::map<std::string, RegistryEntry> _registry;
+
+	void listen();
+	void processNotification(Http& http);
+	void updateRegistry(const std::string& usn, const std::string& notificationType, const std::string& location, int32_t maxAge);
+	void removeExpiredRegistryEntries();
+	std::shared_ptr<FileDescriptor> getListenSocketDescriptor();
 
 	void getAddress();
 	void sendSearchBroadcast(std::shared_ptr<FileDescriptor>& serverSocketDescriptor, const std::string& stHeader, uint32_t timeout);
-	void processPacket(Http& http, const std::string& stHeader, std::set<std::string>& locations);
-	void getDeviceInfo(std::set<std::string>& locations, std::vector<SsdpInfo>& devices);
+	bool processPacket(Http& http, const std::string& stHeader, std::string& location, int32_t& maxAge);
+	int32_t getMaxAge(Http& http);
+	void deviceInfoThread(std::shared_ptr<DeviceInfoQueue> queue);
+	void fetchDeviceInfo(std::shared_ptr<DeviceInfoQueue> queue, std::vector<std::thread>& threads);
+	bool getDeviceInfo(const std::string& location, int32_t maxAge, std::string& ip, PVariable& info);
+	void addDevice(std::shared_ptr<DeviceInfoQueue>& queue, const std::string& ip, const PVariable& info);
 	std::shared_ptr<FileDescriptor> getSocketDescriptor();
 };
 
@@ -30,6 +30,7 @@
 
 #include "../BaseLib.h"
 #include "TcpSocket.h"
+#include "IoUring.h"
 
 namespace BaseLib
 {
@@ -112,8 +113,11 @@ TcpSocket::TcpSocket(BaseLib::SharedObjects* baseLib, TcpServerInfo& serverInfo)
 	_requireClientCert = serverInfo.requireClientCert;
 	_caFile = serverInfo.caFile;
 	_caData = serverInfo.caData;
+	_handshakeTimeout = serverInfo.handshakeTimeout;
+	_idleTimeout = serverInfo.idleTimeout;
 	_newConnectionCallback.swap(serverInfo.newConnectionCallback);
 	_packetReceivedCallback.swap(serverInfo.packetReceivedCallback);
+	_clientTimeouts.reset(new TimerWheel(100, HelperFunctions::getTime()));
 }
 
 TcpSocket::~TcpSocket()
@@ -122,9 +126,6 @@ TcpSocket::~TcpSocket()
 	_bl->threadManager.join(_serverThread);
 
 	_bl->fileDescriptorManager.close(_socketDescriptor);
-	if(_x509Cred) gnutls_certificate_free_credentials(_x509Cred);
-	if(_tlsPriorityCache) gnutls_priority_deinit(_tlsPriorityCache);
-	if(_dhParams) gnutls_dh_params_deinit(_dhParams);
 }
 
 std::string TcpSocket::getIpAddress()
@@ -152,7 +153,7 @@ std::string TcpSocket::getIpAddress()
 		_listenPort = port;
 		bindSocket();
 		listenAddress = _ipAddress;
-		_bl->threadManager.start(_serverThread, true, &TcpSocket::serverThread, this);
+		_bl->threadManager.start("TCP " + _listenPort, ThreadManager::ThreadCategory::rpcServer, _serverThread, true, &TcpSocket::serverThread, this);
 	}
 
 	void TcpSocket::stopServer()
@@ -166,35 +167,20 @@ std::string TcpSocket::getIpAddress()
 		_bl->threadManager.join(_serverThread);
 
 		_bl->fileDescriptorManager.close(_socketDescriptor);
-		if(_x509Cred) gnutls_certificate_free_credentials(_x509Cred);
-		if(_tlsPriorityCache) gnutls_priority_deinit(_tlsPriorityCache);
-		if(_dhParams) gnutls_dh_params_deinit(_dhParams);
-		_x509Cred = nullptr;
-		_tlsPriorityCache = nullptr;
-		_dhParams = nullptr;
-	}
-
-	int verifyClientCert(gnutls_session_t tlsSession)
-	{
-		//Called during handshake just after the certificate message has been received.
-
-		uint32_t status = (uint32_t)-1;
-		if(gnutls_certificate_verify_peers3(tlsSession, 0, &status) != GNUTLS_E_SUCCESS) return -1; //Terminate handshake
-		if(status > 0) return -1;
-		return 0;
+		_tlsCredentials.reset();
 	}
 
 	void TcpSocket::initClientSsl(PFileDescriptor fileDescriptor)
 	{
-		if(!_tlsPriorityCache)
+		if(!_tlsCredentials || !_tlsCredentials->priorityCache)
 		{
 			_bl->fileDescriptorManager.shutdown(fileDescriptor);
-			throw SocketSSLException("Error: Could not initiate TLS connection. _tlsPriorityCache is nullptr.");
+			throw SocketSSLException("Error: Could not initiate TLS connection. Cipher priorities are not initialized.");
 		}
-		if(!_x509Cred)
+		if(!_tlsCredentials->x509Cred)
 		{
 			_bl->fileDescriptorManager.shutdown(fileDescriptor);
-			throw SocketSSLException("Error: Could not initiate TLS connection. _x509Cred is nullptr.");
+			throw SocketSSLException("Error: Could not initiate TLS connection. Certificate credentials are not initialized.");
 		}
 		int32_t result = 0;
 		if((result = gnutls_init(&fileDescriptor->tlsSession, GNUTLS_SERVER)) != GNUTLS_E_SUCCESS)
@@ -208,12 +194,12 @@ std::string TcpSocket::getIpAddress()
 			_bl->fileDescriptorManager.shutdown(fileDescriptor);
 			throw SocketSSLException("Error: Client TLS session is nullptr.");
 		}
-		if((result = gnutls_priority_set(fileDescriptor->tlsSession, _tlsPriorityCache)) != GNUTLS_E_SUCCESS)
+		if((result = gnutls_priority_set(fileDescriptor->tlsSession, _tlsCredentials->priorityCache)) != GNUTLS_E_SUCCESS)
 		{
 			_bl->fileDescriptorManager.shutdown(fileDescriptor);
 			throw SocketSSLException("Error: Could not set cipher priority on TLS session: " + std::string(gnutls_strerror(result)));
 		}
-		if((result = gnutls_credentials_set(fileDescriptor->tlsSession, GNUTLS_CRD_CERTIFICATE, _x509Cred)) != GNUTLS_E_SUCCESS)
+		if((result = gnutls_credentials_set(fileDescriptor->tlsSession, GNUTLS_CRD_CERTIFICATE, _tlsCredentials->x509Cred)) != GNUTLS_E_SUCCESS)
 		{
 			_bl->fileDescriptorManager.shutdown(fileDescriptor);
 			throw SocketSSLException("Error: Could not set x509 credentials on TLS session: " + std::string(gnutls_strerror(result)));
@@ -225,6 +211,7 @@ std::string TcpSocket::getIpAddress()
 			throw SocketSSLException("Error setting TLS socket descriptor: Provided socket descriptor is invalid.");
 		}
 		gnutls_transport_set_ptr(fileDescriptor->tlsSession, (gnutls_transport_ptr_t)(uintptr_t)fileDescriptor->descriptor);
+		if(_handshakeTimeout > 0) gnutls_handshake_set_timeout(fileDescriptor->tlsSession, _handshakeTimeout);
 		do
 		{
 			result = gnutls_handshake(fileDescriptor->tlsSession);
@@ -249,21 +236,28 @@ std::string TcpSocket::getIpAddress()
 
 				if(bytesRead > (signed)clientData->buffer.size()) bytesRead = clientData->buffer.size();
 
+				if(!clientData->dataReceived || _idleTimeout > 0)
+				{
+					std::lock_guard<std::mutex> clientsGuard(_clientsMutex);
+					clientData->dataReceived = true;
+					updateClientTimeout(clientData);
+				}
+
 				std::vector<uint8_t> bytesReceived(clientData->buffer.data(), clientData->buffer.data() + bytesRead);
 				if(_packetReceivedCallback) _packetReceivedCallback(clientData->id, bytesReceived);
 			}
 		}
 		catch(const std::exception& ex)
 		{
-			_bl->fileDescriptorManager.close(clientData->fileDescriptor);
+			removeClient(clientData);
 		}
 		catch(BaseLib::Exception& ex)
 		{
-			_bl->fileDescriptorManager.close(clientData->fileDescriptor);
+			removeClient(clientData);
 		}
 		catch(...)
 		{
-			_bl->fileDescriptorManager.close(clientData->fileDescriptor);
+			removeClient(clientData);
 		}
 	}
 
@@ -280,17 +274,68 @@ std::string TcpSocket::getIpAddress()
 			}
 
 			clientData->socket->proofwrite((char*)packet.data(), packet.size());
+
+			if(_idleTimeout > 0 && clientData->dataReceived)
+			{
+				std::lock_guard<std::mutex> clientsGuard(_clientsMutex);
+				updateClientTimeout(clientData);
+			}
 		}
 		catch(const std::exception& ex)
 		{
-			_bl->fileDescriptorManager.close(clientData->fileDescriptor);
+			removeClient(clientData);
 		}
 		catch(BaseLib::Exception& ex)
 		{
-			_bl->fileDescriptorManager.close(clientData->fileDescriptor);
+			removeClient(clientData);
 		}
 		catch(...)
 		{
+			removeClient(clientData);
+		}
+	}
+
+	void TcpSocket::removeClient(PTcpClientData& clientData)
+	{
+		if(!clientData) return;
+		_bl->fileDescriptorManager.close(clientData->fileDescriptor);
+
+		std::lock_guard<std::mutex> clientsGuard(_clientsMutex);
+		auto clientIterator = _clients.find(clientData->id);
+		if(clientIterator != _clients.end() && clientIterator->second == clientData) _clients.erase(clientIterator);
+		if(_clientTimeouts) _clientTimeouts->remove(clientData->id);
+	}
+
+	void TcpSocket::updateClientTimeout(PTcpClientData& clientData)
+	{
+		if(!_clientTimeouts) return;
+		uint32_t timeout = clientData->dataReceived ? _idleTimeout : (_handshakeTimeout > 0 ? _handshakeTimeout : _idleTimeout);
+		if(timeout > 0) _clientTimeouts->add(clientData->id, HelperFunctions::getTime() + timeout);
+		else _clientTimeouts->remove(clientData->id);
+	}
+
+	void TcpSocket::processClientTimeouts()
+	{
+		if(!_clientTimeouts) return;
+		std::vector<PTcpClientData> expiredClients;
+		{
+			std::lock_guard<std::mutex> clientsGuard(_clientsMutex);
+			if(_clientTimeouts->empty()) return;
+			std::vector<int64_t> expiredIds;
+			_clientTimeouts->advance(HelperFunctions::getTime(), expiredIds);
+			expiredClients.reserve(expiredIds.size());
+			for(auto id : expiredIds)
+			{
+				auto clientIterator = _clients.find(id);
+				if(clientIterator == _clients.end()) continue;
+				expiredClients.push_back(clientIterator->second);
+				_clients.erase(clientIterator);
+			}
+		}
+
+		for(auto& clientData : expiredClients)
+		{
+			if(_bl->debugLevel >= 5) _bl->out.printDebug("Debug: Closing connection to client number " + std::to_string(clientData->id) + (clientData->dataReceived ? " (idle timeout)." : " (handshake timeout)."));
 			_bl->fileDescriptorManager.close(clientData->fileDescriptor);
 		}
 	}
@@ -334,6 +379,7 @@ std::string TcpSocket::getIpAddress()
 				}
 
 				result = select(maxfd + 1, &readFileDescriptor, NULL, NULL, &timeout);
+				processClientTimeouts();
 				if(result == 0)
 				{
 					if(HelperFunctions::getTime() - _lastGarbageCollection > 60000 || _clients.size() >= _maxConnections) collectGarbage();
@@ -402,6 +448,7 @@ std::string TcpSocket::getIpAddress()
 							clientData->socket->setWriteTimeout(15000000);
 
 							_clients[currentClientId] = clientData;
+							updateClientTimeout(clientData);
 						}
 
 						if(_newConnectionCallback) _newConnectionCallback(currentClientId, address, port);
@@ -471,6 +518,7 @@ std::string TcpSocket::getIpAddress()
 		for(auto& client : clientsToRemove)
 		{
 			_clients.erase(client);
+			if(_clientTimeouts) _clientTimeouts->remove(client);
 		}
 	}
 // }}}
@@ -545,182 +593,39 @@ PFileDescriptor TcpSocket::bindAndReturnSocket(FileDescriptorManager& fileDescri
 
 void TcpSocket::initSsl()
 {
-	if(_x509Cred) gnutls_certificate_free_credentials(_x509Cred);
-	if(_tlsPriorityCache) gnutls_priority_deinit(_tlsPriorityCache);
-	if(_dhParams) gnutls_dh_params_deinit(_dhParams);
-
-	int32_t result = 0;
-	if((result = gnutls_certificate_allocate_credentials(&_x509Cred)) != GNUTLS_E_SUCCESS)
-	{
-		_x509Cred = nullptr;
-		throw SocketSSLException("Could not allocate certificate credentials: " + std::string(gnutls_strerror(result)));
-	}
+	_tlsCredentials.reset();
 
-	if(!_caData.empty())
-	{
-		gnutls_datum_t caData;
-		caData.data = (unsigned char*)_caData.c_str();
-		caData.size = _caData.size();
-		if((result = gnutls_certificate_set_x509_trust_mem(_x509Cred, &caData, GNUTLS_X509_FMT_PEM)) < 0)
-		{
-			gnutls_certificate_free_credentials(_x509Cred);
-			_x509Cred = nullptr;
-			throw SocketSSLException("Could not load trusted certificates: " + std::string(gnutls_strerror(result)));
-		}
-	}
-	else if(!_caFile.empty())
-	{
-		if((result = gnutls_certificate_set_x509_trust_file(_x509Cred, _caFile.c_str(), GNUTLS_X509_FMT_PEM)) < 0)
-		{
-			gnutls_certificate_free_credentials(_x509Cred);
-			_x509Cred = nullptr;
-			throw SocketSSLException("Could not load trusted certificates from \"" + _caFile + "\": " + std::string(gnutls_strerror(result)));
-		}
-	}
-	else
+	if(_caData.empty() && _caFile.empty())
 	{
 		if(_verifyCertificate && !_isServer) throw SocketSSLException("Certificate verification is enabled, but \"caFile\" and \"caData\" are not specified for the host \"" + _hostname + "\".");
 		else if(_requireClientCert && _isServer) throw SocketSSLException("Client certificate authentication is enabled, but \"caFile\" and \"caData\" are not specified.");
 		else if(!_isServer) _bl->out.printWarning("Warning: \"caFile\" is not specified for the host \"" + _hostname + "\" and certificate verification is disabled. It is highly recommended to enable certificate verification.");
 	}
 
-	if(result == 0 && ((_verifyCertificate && !_isServer) || (_requireClientCert && _isServer)))
-	{
-		gnutls_certificate_free_credentials(_x509Cred);
-		_x509Cred = nullptr;
-		throw SocketSSLException("No CA certificates specified.");
-	}
-
+	TlsCredentialManager::CredentialInfo credentialInfo;
+	credentialInfo.isServer = _isServer;
+	credentialInfo.requireClientCert = _requireClientCert;
+	credentialInfo.verifyCertificate = _verifyCertificate;
+	credentialInfo.caFile = _caFile;
+	credentialInfo.caData = _caData;
 	if(_isServer)
 	{
-		if(!_serverCertData.empty() && !_serverKeyData.empty())
-		{
-			gnutls_datum_t certData;
-			certData.data = (unsigned char*)_serverCertData.c_str();
-			certData.size = _serverCertData.size();
-
-			gnutls_datum_t keyData;
-			keyData.data = (unsigned char*)_serverKeyData.c_str();
-			keyData.size = _serverKeyData.size();
-
-			if((result = gnutls_certificate_set_x509_key_mem(_x509Cred, &certData, &keyData, GNUTLS_X509_FMT_PEM)) < 0)
-			{
-				gnutls_certificate_free_credentials(_x509Cred);
-				_x509Cred = nullptr;
-				throw SocketSSLException("Could not load server certificate or key file: " + std::string(gnutls_strerror(result)));
-			}
-		}
-		else if(!_serverCertFile.empty() && !_serverKeyFile.empty())
-		{
-			if((result = gnutls_certificate_set_x509_key_file(_x509Cred, _serverCertFile.c_str(), _serverKeyFile.c_str(), GNUTLS_X509_FMT_PEM)) < 0)
-			{
-				gnutls_certificate_free_credentials(_x509Cred);
-				_x509Cred = nullptr;
-				throw SocketSSLException("Could not load certificate or key file from \"" + _serverCertFile + "\" or \"" + _serverKeyFile + "\": " + std::string(gnutls_strerror(result)));
-			}
-		}
-		else if(_useSsl)
-		{
-			throw SocketSSLException("SSL is enabled but no certificates are specified.");
-		}
-
-		if(!_dhParamFile.empty() || !_dhParamData.empty())
-		{
-			if((result = gnutls_dh_params_init(&_dhParams)) != GNUTLS_E_SUCCESS)
-			{
-				gnutls_certificate_free_credentials(_x509Cred);
-				_x509Cred = nullptr;
-				_dhParams = nullptr;
-				throw SocketSSLException("Error: Could not initialize DH parameters: " + std::string(gnutls_strerror(result)));
-			}
-
-			gnutls_datum_t data;
-			if(!_dhParamFile.empty())
-			{
-				std::vector<uint8_t> binaryData;
-				try
-				{
-					binaryData = Io::getUBinaryFileContent(_dhParamFile.c_str());
-					binaryData.push_back(0); //gnutls_datum_t.data needs to be null terminated
-				}
-				catch(BaseLib::Exception& ex)
-				{
-					gnutls_certificate_free_credentials(_x509Cred);
-					gnutls_dh_params_deinit(_dhParams);
-					_x509Cred = nullptr;
-					_dhParams = nullptr;
-					throw SocketSSLException("Error: Could not load DH parameters: " + std::string(ex.what()));
-				}
-				catch(...)
-				{
-					gnutls_certificate_free_credentials(_x509Cred);
-					gnutls_dh_params_deinit(_dhParams);
-					_x509Cred = nullptr;
-					_dhParams = nullptr;
-					throw SocketSSLException("Error: Could not load DH parameter file \"" + _dhParamFile + "\".");
-				}
-				data.data = binaryData.data();
-				data.size = binaryData.size();
-			}
-			else
-			{
-				data.data = (unsigned char*)_dhParamData.c_str();
-				data.size = _dhParamData.size();
-			}
-
-			if((result = gnutls_dh_params_import_pkcs3(_dhParams, &data, GNUTLS_X509_FMT_PEM)) != GNUTLS_E_SUCCESS)
-			{
-				gnutls_certificate_free_credentials(_x509Cred);
-				gnutls_dh_params_deinit(_dhParams);
-				_x509Cred = nullptr;
-				_dhParams = nullptr;
-				throw SocketSSLException("Error: Could not import DH parameters: " + std::string(gnutls_strerror(result)));
-			}
-
-			gnutls_certificate_set_dh_params(_x509Cred, _dhParams);
-		}
-
-		if((result = gnutls_priority_init(&_tlsPriorityCache, "NORMAL", NULL)) != GNUTLS_E_SUCCESS)
-		{
-			gnutls_certificate_free_credentials(_x509Cred);
-			gnutls_dh_params_deinit(_dhParams);
-			_x509Cred = nullptr;
-			_dhParams = nullptr;
-			_tlsPriorityCache = nullptr;
-			throw SocketSSLException("Error: Could not initialize cipher priorities: " + std::string(gnutls_strerror(result)));
-		}
-
-		if(_requireClientCert) gnutls_certificate_set_verify_function(_x509Cred, &verifyClientCert);
+		credentialInfo.certFile = _serverCertFile;
+		credentialInfo.certData = _serverCertData;
+		credentialInfo.keyFile = _serverKeyFile;
+		credentialInfo.keyData = _serverKeyData;
+		credentialInfo.dhParamFile = _dhParamFile;
+		credentialInfo.dhParamData = _dhParamData;
 	}
 	else
 	{
-		if(!_clientCertData.empty() && !_clientKeyData.empty())
-		{
-			gnutls_datum_t clientCertData;
-			clientCertData.data = (unsigned char*)_clientCertData.c_str();
-			clientCertData.size = _clientCertData.size();
-
-			gnutls_datum_t clientKeyData;
-			clientKeyData.data = (unsigned char*)_clientKeyData.c_str();
-			clientKeyData.size = _clientKeyData.size();
-
-			if((result = gnutls_certificate_set_x509_key_mem(_x509Cred, &clientCertData, &clientKeyData, GNUTLS_X509_FMT_PEM)) < 0)
-			{
-				gnutls_certificate_free_credentials(_x509Cred);
-				_x509Cred = nullptr;
-				throw SocketSSLException("Could not load client certificate or key: " + std::string(gnutls_strerror(result)));
-			}
-		}
-		else if(!_clientCertFile.empty() && !_clientKeyFile.empty())
-		{
-			if((result = gnutls_certificate_set_x509_key_file(_x509Cred, _clientCertFile.c_str(), _clientKeyFile.c_str(), GNUTLS_X509_FMT_PEM)) < 0)
-			{
-				gnutls_certificate_free_credentials(_x509Cred);
-				_x509Cred = nullptr;
-				throw SocketSSLException("Could not load client certificate and key from \"" + _clientCertFile + "\" and \"" + _clientKeyFile + "\": " + std::string(gnutls_strerror(result)));
-			}
-		}
+		credentialInfo.certFile = _clientCertFile;
+		credentialInfo.certData = _clientCertData;
+		credentialInfo.keyFile = _clientKeyFile;
+		credentialInfo.keyData = _clientKeyData;
 	}
+
+	_tlsCredentials = _bl->tlsCredentialManager.get(credentialInfo);
 }
 
 void TcpSocket::open()
@@ -787,6 +692,38 @@ int32_t TcpSocket::proofread(char* buffer, int32_t bufferSize, bool& moreData)
 		}
 	}
 
+	IoUring* ioUring = (_bl->settings.useIoUring() && !_socketDescriptor->tlsSession) ? IoUring::getThreadInstance() : nullptr;
+	if(ioUring)
+	{
+		//Wait and read with one system call
+		auto fileDescriptorGuard = _bl->fileDescriptorManager.getLock();
+		fileDescriptorGuard.lock();
+		int32_t descriptor = _socketDescriptor->descriptor;
+		fileDescriptorGuard.unlock();
+		if(descriptor < 0)
+		{
+			_readMutex.unlock();
+			throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (1).");
+		}
+		do
+		{
+			bytesRead = ioUring->read(descriptor, buffer, bufferSize, _readTimeout);
+		} while(bytesRead == -1 && (errno == EAGAIN || errno == EINTR));
+		if(bytesRead == -2)
+		{
+			_readMutex.unlock();
+			throw SocketTimeOutException("Reading from socket timed out.");
+		}
+		if(bytesRead <= 0)
+		{
+			_readMutex.unlock();
+			if(bytesRead == -1) throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (3): " + strerror(errno));
+			else throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (3).");
+		}
+		_readMutex.unlock();
+		return bytesRead;
+	}
+
 	timeval timeout;
 	int32_t seconds = _readTimeout / 1000000;
 	timeout.tv_sec = seconds;
@@ -856,79 +793,8 @@ int32_t TcpSocket::proofwrite(const std::shared_ptr<std::vector<char>> data)
 
 int32_t TcpSocket::proofwrite(const std::vector<char>& data)
 {
-	if(!_socketDescriptor) throw SocketOperationException("Socket descriptor is nullptr.");
-	_writeMutex.lock();
-	if(!connected())
-	{
-		_writeMutex.unlock();
-		autoConnect();
-		_writeMutex.lock();
-	}
-	if(data.empty())
-	{
-		_writeMutex.unlock();
-		return 0;
-	}
-	if(data.size() > 104857600)
-	{
-		_writeMutex.unlock();
-		throw SocketDataLimitException("Data size is larger than 100 MiB.");
-	}
-
-	int32_t totalBytesWritten = 0;
-	while (totalBytesWritten < (signed)data.size())
-	{
-		timeval timeout;
-		int32_t seconds = _writeTimeout / 1000000;
-		timeout.tv_sec = seconds;
-		timeout.tv_usec = _writeTimeout - (1000000 * seconds);
-		fd_set writeFileDescriptor;
-		FD_ZERO(&writeFileDescriptor);
-		auto fileDescriptorGuard = _bl->fileDescriptorManager.getLock();
-		fileDescriptorGuard.lock();
-		int32_t nfds = _socketDescriptor->descriptor + 1;
-		if(nfds <= 0)
-		{
-			fileDescriptorGuard.unlock();
-			_writeMutex.unlock();
-			throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (4).");
-		}
-		FD_SET(_socketDescriptor->descriptor, &writeFileDescriptor);
-		fileDescriptorGuard.unlock();
-		int32_t readyFds = select(nfds, NULL, &writeFileDescriptor, NULL, &timeout);
-		if(readyFds == 0)
-		{
-			_writeMutex.unlock();
-			throw SocketTimeOutException("Writing to socket timed out.");
-		}
-		if(readyFds != 1)
-		{
-			_writeMutex.unlock();
-			throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (5).");
-		}
-
-		int32_t bytesWritten = _socketDescriptor->tlsSession ? gnutls_record_send(_socketDescriptor->tlsSession, &data.at(totalBytesWritten), data.size() - totalBytesWritten) : send(_socketDescriptor->descriptor, &data.at(totalBytesWritten), data.size() - totalBytesWritten, MSG_NOSIGNAL);
-		if(bytesWritten <= 0)
-		{
-			if(bytesWritten == -1 && (errno == EINTR || errno == EAGAIN)) continue;
-			_writeMutex.unlock();
-			close();
-			_writeMutex.lock();
-			if(_socketDescriptor->tlsSession)
-			{
-				_writeMutex.unlock();
-				throw SocketOperationException(gnutls_strerror(bytesWritten));
-			}
-			else
-			{
-				_writeMutex.unlock();
-				throw SocketOperationException(strerror(errno));
-			}
-		}
-		totalBytesWritten += bytesWritten;
-	}
-	_writeMutex.unlock();
-	return totalBytesWritten;
+	if(data.size() > 104857600) throw SocketDataLimitException("Data size is larger than 100 MiB.");
+	return proofwrite(data.data(), data.size());
 }
 
 int32_t TcpSocket::proofwrite(const char* buffer, int32_t bytesToWrite)
@@ -952,117 +818,62 @@ int32_t TcpSocket::proofwrite(const char* buffer, int32_t bytesToWrite)
 		throw SocketDataLimitException("Data size is larger than 100 MiB.");
 	}
 
+	IoUring* ioUring = (_bl->settings.useIoUring() && !_socketDescriptor->tlsSession) ? IoUring::getThreadInstance() : nullptr;
 	int32_t totalBytesWritten = 0;
 	while (totalBytesWritten < bytesToWrite)
 	{
-		timeval timeout;
-		int32_t seconds = _writeTimeout / 1000000;
-		timeout.tv_sec = seconds;
-		timeout.tv_usec = _writeTimeout - (1000000 * seconds);
-		fd_set writeFileDescriptor;
-		FD_ZERO(&writeFileDescriptor);
-		auto fileDescriptorGuard = _bl->fileDescriptorManager.getLock();
-		fileDescriptorGuard.lock();
-		int32_t nfds = _socketDescriptor->descriptor + 1;
-		if(nfds <= 0)
+		int32_t bytesWritten = 0;
+		if(ioUring)
 		{
+			auto fileDescriptorGuard = _bl->fileDescriptorManager.getLock();
+			fileDescriptorGuard.lock();
+			int32_t descriptor = _socketDescriptor->descriptor;
 			fileDescriptorGuard.unlock();
-			_writeMutex.unlock();
-			throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (4).");
-		}
-		FD_SET(_socketDescriptor->descriptor, &writeFileDescriptor);
-		fileDescriptorGuard.unlock();
-		int32_t readyFds = select(nfds, NULL, &writeFileDescriptor, NULL, &timeout);
-		if(readyFds == 0)
-		{
-			_writeMutex.unlock();
-			throw SocketTimeOutException("Writing to socket timed out.");
-		}
-		if(readyFds != 1)
-		{
-			_writeMutex.unlock();
-			throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (5).");
-		}
-
-		int32_t bytesWritten = _socketDescriptor->tlsSession ? gnutls_record_send(_socketDescriptor->tlsSession, buffer + totalBytesWritten, bytesToWrite - totalBytesWritten) : send(_socketDescriptor->descriptor, buffer + totalBytesWritten, bytesToWrite - totalBytesWritten, MSG_NOSIGNAL);
-		if(bytesWritten <= 0)
-		{
-			if(bytesWritten == -1 && (errno == EINTR || errno == EAGAIN)) continue;
-			_writeMutex.unlock();
-			close();
-			_writeMutex.lock();
-			if(_socketDescriptor->tlsSession)
+			if(descriptor < 0)
 			{
 				_writeMutex.unlock();
-				throw SocketOperationException(gnutls_strerror(bytesWritten));
+				throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (4).");
 			}
-			else
+			bytesWritten = ioUring->send(descriptor, buffer + totalBytesWritten, bytesToWrite - totalBytesWritten, MSG_NOSIGNAL, _writeTimeout);
+			if(bytesWritten == -2)
 			{
 				_writeMutex.unlock();
-				throw SocketOperationException(strerror(errno));
+				throw SocketTimeOutException("Writing to socket timed out.");
 			}
 		}
-		totalBytesWritten += bytesWritten;
-	}
-	_writeMutex.unlock();
-	return totalBytesWritten;
-}
-
-int32_t TcpSocket::proofwrite(const std::string& data)
-{
-	if(!_socketDescriptor) throw SocketOperationException("Socket descriptor is nullptr.");
-	_writeMutex.lock();
-	if(!connected())
-	{
-		_writeMutex.unlock();
-		autoConnect();
-		_writeMutex.lock();
-	}
-	if(data.empty())
-	{
-		_writeMutex.unlock();
-		return 0;
-	}
-	if(data.size() > 104857600)
-	{
-		_writeMutex.unlock();
-		throw SocketDataLimitException("Data size is larger than 100 MiB.");
-	}
-
-	int32_t totalBytesWritten = 0;
-	while (totalBytesWritten < (signed)data.size())
-	{
-		timeval timeout;
-		int32_t seconds = _writeTimeout / 1000000;
-		timeout.tv_sec = seconds;
-		timeout.tv_usec = _writeTimeout - (1000000 * seconds);
-		fd_set writeFileDescriptor;
-		FD_ZERO(&writeFileDescriptor);
-		auto fileDescriptorGuard = _bl->fileDescriptorManager.getLock();
-		fileDescriptorGuard.lock();
-		int32_t nfds = _socketDescriptor->descriptor + 1;
-		if(nfds <= 0)
+		else
 		{
+			timeval timeout;
+			int32_t seconds = _writeTimeout / 1000000;
+			timeout.tv_sec = seconds;
+			timeout.tv_usec = _writeTimeout - (1000000 * seconds);
+			fd_set writeFileDescriptor;
+			FD_ZERO(&writeFileDescriptor);
+			auto fileDescriptorGuard = _bl->fileDescriptorManager.getLock();
+			fileDescriptorGuard.lock();
+			int32_t nfds = _socketDescriptor->descriptor + 1;
+			if(nfds <= 0)
+			{
+				fileDescriptorGuard.unlock();
+				_writeMutex.unlock();
+				throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (4).");
+			}
+			FD_SET(_socketDescriptor->descriptor, &writeFileDescriptor);
 			fileDescriptorGuard.unlock();
-			_writeMutex.unlock();
-			throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (6).");
-		}
-		FD_SET(_socketDescriptor->descriptor, &writeFileDescriptor);
-		fileDescriptorGuard.unlock();
-		int32_t readyFds = select(nfds, NULL, &writeFileDescriptor, NULL, &timeout);
-		if(readyFds == 0)
-		{
-			_writeMutex.unlock();
-			throw SocketTimeOutException("Writing to socket timed out.");
-		}
-		if(readyFds != 1)
-		{
-			_writeMutex.unlock();
-			throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (7).");
-		}
+			int32_t readyFds = select(nfds, NULL, &writeFileDescriptor, NULL, &timeout);
+			if(readyFds == 0)
+			{
+				_writeMutex.unlock();
+				throw SocketTimeOutException("Writing to socket timed out.");
+			}
+			if(readyFds != 1)
+			{
+				_writeMutex.unlock();
+				throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (5).");
+			}
 
-		int32_t bytesToSend = data.size() - totalBytesWritten;
-		int32_t bytesWritten = _socketDescriptor->tlsSession ? gnutls_record_send(_socketDescriptor->tlsSession, &data.at(totalBytesWritten), bytesToSend) : send(_socketDescriptor->descriptor, &data.at(totalBytesWritten), bytesToSend, MSG_NOSIGNAL);
+			bytesWritten = _socketDescriptor->tlsSession ? gnutls_record_send(_socketDescriptor->tlsSession, buffer + totalBytesWritten, bytesToWrite - totalBytesWritten) : send(_socketDescriptor->descriptor, buffer + totalBytesWritten, bytesToWrite - totalBytesWritten, MSG_NOSIGNAL);
+		}
 		if(bytesWritten <= 0)
 		{
 			if(bytesWritten == -1 && (errno == EINTR || errno == EAGAIN)) continue;
@@ -1086,6 +897,12 @@ int32_t TcpSocket::proofwrite(const std::string& data)
 	return totalBytesWritten;
 }
 
+int32_t TcpSocket::proofwrite(const std::string& data)
+{
+	if(data.size() > 104857600) throw SocketDataLimitException("Data size is larger than 100 MiB.");
+	return proofwrite(data.data(), data.size());
+}
+
 bool TcpSocket::connected()
 {
 	if(!_socketDescriptor || _socketDescriptor->descriptor < 0) return false;
@@ -1133,7 +950,7 @@ void TcpSocket::getSocketDescriptor()
 void TcpSocket::getSsl()
 {
 	if(!_socketDescriptor || _socketDescriptor->descriptor < 0) throw SocketSSLException("Could not connect to server using SSL. File descriptor is invalid.");
-	if(!_x509Cred)
+	if(!_tlsCredentials || !_tlsCredentials->x509Cred)
 	{
 		_bl->fileDescriptorManager.shutdown(_socketDescriptor);
 		throw SocketSSLException("Could not connect to server using SSL. Certificate credentials are not initialized. Look for previous error messages.");
@@ -1151,12 +968,12 @@ void TcpSocket::getSsl()
 		throw SocketSSLException("Could not initialize TLS session: " + std::string(gnutls_strerror(result)));
 	}
 	if(!_socketDescriptor->tlsSession) throw SocketSSLException("Could not initialize TLS session.");
-	if((result = gnutls_priority_set_direct(_socketDescriptor->tlsSession, "NORMAL", NULL)) != GNUTLS_E_SUCCESS)
+	if((result = gnutls_priority_set(_socketDescriptor->tlsSession, _tlsCredentials->priorityCache)) != GNUTLS_E_SUCCESS)
 	{
 		_bl->fileDescriptorManager.shutdown(_socketDescriptor);
 		throw SocketSSLException("Could not set cipher priorities: " + std::string(gnutls_strerror(result)));
 	}
-	if((result = gnutls_credentials_set(_socketDescriptor->tlsSession, GNUTLS_CRD_CERTIFICATE, _x509Cred)) != GNUTLS_E_SUCCESS)
+	if((result = gnutls_credentials_set(_socketDescriptor->tlsSession, GNUTLS_CRD_CERTIFICATE, _tlsCredentials->x509Cred)) != GNUTLS_E_SUCCESS)
 	{
 		_bl->fileDescriptorManager.shutdown(_socketDescriptor);
 		throw SocketSSLException("Could not set trusted certificates: " + std::string(gnutls_strerror(result)));
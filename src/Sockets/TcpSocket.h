@@ -33,6 +33,8 @@
 
 #include "SocketExceptions.h"
 #include "../Managers/FileDescriptorManager.h"
+#include "../Managers/TlsCredentialManager.h"
+#include "../TimerWheel.h"
 
 #include <thread>
 #include <iostream>
@@ -153,6 +155,8 @@ public:
 		bool requireClientCert = false;
 		std::string caFile; //For client certificate verification
 		std::string caData; //For client certificate verification
+		uint32_t handshakeTimeout = 0; //Milliseconds a client has to complete the TLS handshake and to send its first data. "0" disables the timeout.
+		uint32_t idleTimeout = 0; //Milliseconds without any traffic after which a client is disconnected. "0" disables the timeout.
 		std::function<void(int32_t clientId, std::string address, uint16_t port)> newConnectionCallback;
 		std::function<void(int32_t clientId, TcpPacket& packet)> packetReceivedCallback;
 	};
@@ -321,9 +325,11 @@ protected:
 		PFileDescriptor fileDescriptor;
 		std::vector<uint8_t> buffer;
 		std::shared_ptr<TcpSocket> socket;
+		std::atomic_bool dataReceived;
 
 		TcpClientData()
 		{
+			dataReceived = false;
 			buffer.resize(1024);
 		}
 	};
@@ -357,28 +363,27 @@ protected:
 		std::string _dhParamFile;
 		std::string _dhParamData;
 		bool _requireClientCert = false;
+		uint32_t _handshakeTimeout = 0;
+		uint32_t _idleTimeout = 0;
 		std::function<void(int32_t clientId, std::string address, uint16_t port)> _newConnectionCallback;
 		std::function<void(int32_t clientId, TcpPacket& packet)> _packetReceivedCallback;
 
 		std::string _listenAddress;
 		std::string _listenPort;
 
-		gnutls_dh_params_t _dhParams = nullptr;
-		gnutls_priority_t _tlsPriorityCache = nullptr;
-
 		std::atomic_bool _stopServer;
 		std::thread _serverThread;
-
 		int64_t _lastGarbageCollection = 0;
 
 		int32_t _currentClientId = 0;
 		std::mutex _clientsMutex;
 		std::map<int32_t, PTcpClientData> _clients;
+		std::unique_ptr<TimerWheel> _clientTimeouts; //Protected by _clientsMutex
 	// }}}
 
 	PFileDescriptor _socketDescriptor;
 	bool _useSsl = false;
-	gnutls_certificate_credentials_t _x509Cred = nullptr;
+	PTlsCredentials _tlsCredentials;
 
 	void getSocketDescriptor();
 	void getConnection();
@@ -393,6 +398,21 @@ protected:
 		void collectGarbage();
 		void initClientSsl(PFileDescriptor fileDescriptor);
 		void readClient(PTcpClientData clientData);
+
+		/**
+		 * Closes the connection to a client and removes it immediately. _clientsMutex must not be locked.
+		 */
+		void removeClient(PTcpClientData& clientData);
+
+		/**
+		 * (Re)schedules the handshake or idle timeout of a client. _clientsMutex needs to be locked.
+		 */
+		void updateClientTimeout(PTcpClientData& clientData);
+
+		/**
+		 * Disconnects all clients whose handshake or idle timeout expired.
+		 */
+		void processClientTimeouts();
 	// }}}
 };
 
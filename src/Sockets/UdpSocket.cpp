@@ -30,6 +30,7 @@
 
 #include "../BaseLib.h"
 #include "UdpSocket.h"
+#include "IoUring.h"
 
 namespace BaseLib
 {
@@ -93,41 +94,77 @@ int32_t UdpSocket::proofread(char* buffer, int32_t bufferSize, std::string& send
 		if(!isOpen()) throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (8).");
 		_readMutex.lock();
 	}
-	timeval timeout;
-	int32_t seconds = _readTimeout / 1000000;
-	timeout.tv_sec = seconds;
-	timeout.tv_usec = _readTimeout - (1000000 * seconds);
-	fd_set readFileDescriptor;
-	FD_ZERO(&readFileDescriptor);
-	auto fileDescriptorGuard = _bl->fileDescriptorManager.getLock();
-	fileDescriptorGuard.lock();
-	int32_t nfds = _socketDescriptor->descriptor + 1;
-	if(nfds <= 0)
+	struct sockaddr clientInfo;
+	memset(&clientInfo, 0, sizeof(sockaddr));
+	int32_t bytesRead = 0;
+	IoUring* ioUring = _bl->settings.useIoUring() ? IoUring::getThreadInstance() : nullptr;
+	if(ioUring)
 	{
+		//Wait and receive with one system call
+		auto fileDescriptorGuard = _bl->fileDescriptorManager.getLock();
+		fileDescriptorGuard.lock();
+		int32_t descriptor = _socketDescriptor->descriptor;
 		fileDescriptorGuard.unlock();
-		_readMutex.unlock();
-		throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (1).");
-	}
-	FD_SET(_socketDescriptor->descriptor, &readFileDescriptor);
-	fileDescriptorGuard.unlock();
-	int32_t bytesRead = select(nfds, &readFileDescriptor, NULL, NULL, &timeout);
-	if(bytesRead == 0)
-	{
-		_readMutex.unlock();
-		throw SocketTimeOutException("Reading from socket timed out.");
+		if(descriptor < 0)
+		{
+			_readMutex.unlock();
+			throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (1).");
+		}
+		iovec ioVector;
+		ioVector.iov_base = buffer;
+		ioVector.iov_len = bufferSize;
+		msghdr message;
+		memset(&message, 0, sizeof(msghdr));
+		message.msg_name = &clientInfo;
+		message.msg_namelen = sizeof(sockaddr);
+		message.msg_iov = &ioVector;
+		message.msg_iovlen = 1;
+		do
+		{
+			bytesRead = ioUring->recvmsg(descriptor, &message, 0, _readTimeout);
+		} while(bytesRead == -1 && (errno == EAGAIN || errno == EINTR));
+		if(bytesRead == -2)
+		{
+			_readMutex.unlock();
+			throw SocketTimeOutException("Reading from socket timed out.");
+		}
 	}
-	if(bytesRead != 1)
+	else
 	{
-		_readMutex.unlock();
-		throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (2).");
+		timeval timeout;
+		int32_t seconds = _readTimeout / 1000000;
+		timeout.tv_sec = seconds;
+		timeout.tv_usec = _readTimeout - (1000000 * seconds);
+		fd_set readFileDescriptor;
+		FD_ZERO(&readFileDescriptor);
+		auto fileDescriptorGuard = _bl->fileDescriptorManager.getLock();
+		fileDescriptorGuard.lock();
+		int32_t nfds = _socketDescriptor->descriptor + 1;
+		if(nfds <= 0)
+		{
+			fileDescriptorGuard.unlock();
+			_readMutex.unlock();
+			throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (1).");
+		}
+		FD_SET(_socketDescriptor->descriptor, &readFileDescriptor);
+		fileDescriptorGuard.unlock();
+		bytesRead = select(nfds, &readFileDescriptor, NULL, NULL, &timeout);
+		if(bytesRead == 0)
+		{
+			_readMutex.unlock();
+			throw SocketTimeOutException("Reading from socket timed out.");
+		}
+		if(bytesRead != 1)
+		{
+			_readMutex.unlock();
+			throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (2).");
+		}
+		uint32_t addressLength = sizeof(sockaddr);
+		do
+		{
+			bytesRead = recvfrom(_socketDescriptor->descriptor, buffer, bufferSize, 0, &clientInfo, &addressLength);
+		} while(bytesRead < 0 && (errno == EAGAIN || errno == EINTR));
 	}
-	struct sockaddr clientInfo;
-	memset(&clientInfo, 0, sizeof(sockaddr));
-	uint32_t addressLength = sizeof(sockaddr);
-	do
-	{
-		bytesRead = recvfrom(_socketDescriptor->descriptor, buffer, bufferSize, 0, &clientInfo, &addressLength);
-	} while(bytesRead < 0 && (errno == EAGAIN || errno == EINTR));
 	if(bytesRead <= 0)
 	{
 		_readMutex.unlock();
@@ -149,6 +186,158 @@ int32_t UdpSocket::proofread(char* buffer, int32_t bufferSize, std::string& send
 	return bytesRead;
 }
 
+bool UdpSocket::waitForSocket(bool write, int64_t timeout)
+{
+	timeval timeoutStruct;
+	int32_t seconds = timeout / 1000000;
+	timeoutStruct.tv_sec = seconds;
+	timeoutStruct.tv_usec = timeout - (1000000 * seconds);
+	fd_set fileDescriptorSet;
+	FD_ZERO(&fileDescriptorSet);
+	auto fileDescriptorGuard = _bl->fileDescriptorManager.getLock();
+	fileDescriptorGuard.lock();
+	int32_t nfds = _socketDescriptor->descriptor + 1;
+	if(nfds <= 0)
+	{
+		fileDescriptorGuard.unlock();
+		throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (1).");
+	}
+	FD_SET(_socketDescriptor->descriptor, &fileDescriptorSet);
+	fileDescriptorGuard.unlock();
+	int32_t readyFds = 0;
+	do
+	{
+		readyFds = write ? select(nfds, NULL, &fileDescriptorSet, NULL, &timeoutStruct) : select(nfds, &fileDescriptorSet, NULL, NULL, &timeoutStruct);
+	} while(readyFds == -1 && errno == EINTR);
+	if(readyFds == 0) return false;
+	if(readyFds != 1) throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (2).");
+	return true;
+}
+
+int32_t UdpSocket::proofreadBatch(std::vector<UdpPacket>& packets, int32_t maxPackets, int32_t maxPacketSize, int64_t timeout)
+{
+	if(!_socketDescriptor) throw SocketOperationException("Socket descriptor is nullptr.");
+	if(maxPackets <= 0 || maxPacketSize <= 0) throw SocketOperationException("maxPackets and maxPacketSize need to be larger than 0.");
+	if(timeout < 0) timeout = _readTimeout;
+	std::unique_lock<std::mutex> readGuard(_readMutex);
+	if(_autoConnect && !isOpen())
+	{
+		readGuard.unlock();
+		autoConnect();
+		if(!isOpen()) throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (8).");
+		readGuard.lock();
+	}
+
+	if(!waitForSocket(false, timeout)) throw SocketTimeOutException("Reading from socket timed out.");
+
+	packets.resize(maxPackets);
+	std::vector<mmsghdr> messages(maxPackets);
+	std::vector<iovec> ioVectors(maxPackets);
+	std::vector<sockaddr_storage> addresses(maxPackets);
+	memset(messages.data(), 0, sizeof(mmsghdr) * messages.size());
+	for(int32_t i = 0; i < maxPackets; i++)
+	{
+		packets[i].data.resize(maxPacketSize);
+		ioVectors[i].iov_base = packets[i].data.data();
+		ioVectors[i].iov_len = maxPacketSize;
+		messages[i].msg_hdr.msg_iov = &ioVectors[i];
+		messages[i].msg_hdr.msg_iovlen = 1;
+		messages[i].msg_hdr.msg_name = &addresses[i];
+		messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+	}
+
+	int32_t packetCount = 0;
+	do
+	{
+		packetCount = recvmmsg(_socketDescriptor->descriptor, messages.data(), maxPackets, MSG_DONTWAIT, nullptr);
+	} while(packetCount < 0 && errno == EINTR);
+	if(packetCount <= 0)
+	{
+		//Keep "packets" untouched, so the buffers can be reused on the next call.
+		if(packetCount == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) throw SocketTimeOutException("Reading from socket timed out.");
+		throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (3).");
+	}
+	readGuard.unlock();
+
+	packets.resize(packetCount);
+	char ipStringBuffer[INET6_ADDRSTRLEN];
+	for(int32_t i = 0; i < packetCount; i++)
+	{
+		packets[i].data.resize(messages[i].msg_len);
+		if(addresses[i].ss_family == AF_INET)
+		{
+			struct sockaddr_in *s = (struct sockaddr_in*)&addresses[i];
+			inet_ntop(AF_INET, &s->sin_addr, ipStringBuffer, sizeof(ipStringBuffer));
+			packets[i].senderPort = ntohs(s->sin_port);
+		}
+		else
+		{ // AF_INET6
+			struct sockaddr_in6 *s = (struct sockaddr_in6*)&addresses[i];
+			inet_ntop(AF_INET6, &s->sin6_addr, ipStringBuffer, sizeof(ipStringBuffer));
+			packets[i].senderPort = ntohs(s->sin6_port);
+		}
+		packets[i].senderIp = std::string(&ipStringBuffer[0]);
+	}
+	return packetCount;
+}
+
+int32_t UdpSocket::proofwriteBatch(const std::vector<std::vector<char>>& packets, int64_t timeout)
+{
+	if(!_socketDescriptor) throw SocketOperationException("Socket descriptor is nullptr.");
+	if(timeout < 0) timeout = _writeTimeout;
+	std::unique_lock<std::mutex> writeGuard(_writeMutex);
+	if(!isOpen())
+	{
+		writeGuard.unlock();
+		autoConnect();
+		if(!isOpen()) throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (8).");
+		writeGuard.lock();
+	}
+	if(packets.empty()) return 0;
+
+	std::vector<mmsghdr> messages(packets.size());
+	std::vector<iovec> ioVectors(packets.size());
+	memset(messages.data(), 0, sizeof(mmsghdr) * messages.size());
+	for(uint32_t i = 0; i < packets.size(); i++)
+	{
+		if(packets[i].size() > 65507) throw SocketDataLimitException("Datagram size is larger than 65507 bytes.");
+		ioVectors[i].iov_base = (void*)packets[i].data();
+		ioVectors[i].iov_len = packets[i].size();
+		messages[i].msg_hdr.msg_iov = &ioVectors[i];
+		messages[i].msg_hdr.msg_iovlen = 1;
+		messages[i].msg_hdr.msg_name = _serverInfo->ai_addr;
+		messages[i].msg_hdr.msg_namelen = _serverInfo->ai_addrlen;
+	}
+
+	int64_t endTime = HelperFunctions::getTimeMicroseconds() + timeout;
+	uint32_t packetsSent = 0;
+	while(packetsSent < packets.size())
+	{
+		int32_t result = sendmmsg(_socketDescriptor->descriptor, messages.data() + packetsSent, packets.size() - packetsSent, MSG_NOSIGNAL);
+		if(result <= 0)
+		{
+			if(result == -1 && errno == EINTR) continue;
+			if(result == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			{
+				int64_t remainingTime = endTime - HelperFunctions::getTimeMicroseconds();
+				if(remainingTime <= 0 || !waitForSocket(true, remainingTime))
+				{
+					if(packetsSent > 0) return packetsSent;
+					throw SocketTimeOutException("Writing to socket timed out.");
+				}
+				continue;
+			}
+			//Report what was sent. The error is thrown by the next call when it persists.
+			if(packetsSent > 0) return packetsSent;
+			writeGuard.unlock();
+			close();
+			throw SocketOperationException(strerror(errno));
+		}
+		packetsSent += result;
+	}
+	return packetsSent;
+}
+
 int32_t UdpSocket::proofwrite(const std::shared_ptr<std::vector<char>> data)
 {
 	if(!data || data->empty()) return 0;
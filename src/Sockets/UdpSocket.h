@@ -42,11 +42,19 @@ class SharedObjects;
 class UdpSocket
 {
 public:
+	struct UdpPacket
+	{
+		std::vector<char> data;
+		std::string senderIp;
+		int32_t senderPort = -1;
+	};
+
 	UdpSocket(BaseLib::SharedObjects* baseLib);
 	UdpSocket(BaseLib::SharedObjects* baseLib, std::string hostname, std::string port);
 	virtual ~UdpSocket();
 
 	void setReadTimeout(int64_t timeout) { _readTimeout = timeout; }
+	void setWriteTimeout(int64_t timeout) { _writeTimeout = timeout; }
 	void setAutoConnect(bool autoConnect) { _autoConnect = autoConnect; }
 	void setHostname(std::string hostname) { close(); _hostname = hostname; }
 	void setPort(std::string port) { close(); _port = port; }
@@ -69,6 +77,35 @@ public:
 	 */
 	int32_t proofread(char* buffer, int32_t bufferSize, std::string& senderIp);
 
+	/**
+	 * Reads up to "maxPackets" datagrams with a single system call (recvmmsg). Waits until the first datagram is available
+	 * and then returns all datagrams queued on the socket at that moment. Pass the same vector in repeatedly to reuse the
+	 * allocated buffers.
+	 *
+	 * @param[out] packets The received datagrams. The vector is resized to the number of datagrams read.
+	 * @param[in] maxPackets The maximum number of datagrams to read.
+	 * @param[in] maxPacketSize The maximum size of one datagram. Longer datagrams are truncated.
+	 * @param[in] timeout The time in microseconds to wait for the first datagram. Set to -1 to use the read timeout.
+	 * @return Returns the number of datagrams read. Never returns 0 or a negative number.
+	 * @throws SocketTimeOutException Thrown on timeout.
+	 * @throws SocketClosedException Thrown when socket was closed.
+	 * @throws SocketOperationException Thrown when socket is nullptr.
+	 */
+	int32_t proofreadBatch(std::vector<UdpPacket>& packets, int32_t maxPackets, int32_t maxPacketSize = 2048, int64_t timeout = -1);
+
+	/**
+	 * Sends multiple datagrams with as few system calls as possible (sendmmsg).
+	 *
+	 * @param[in] packets The datagrams to send.
+	 * @param[in] timeout The time in microseconds to wait for all datagrams to be sent. Set to -1 to use the write timeout.
+	 * @return Returns the number of datagrams sent. This is less than "packets.size()" when sending timed out or failed after
+	 * some datagrams were sent. Only the remaining datagrams should be sent again then.
+	 * @throws SocketTimeOutException Thrown when no datagram could be sent within the timeout.
+	 * @throws SocketClosedException Thrown when socket was closed.
+	 * @throws SocketOperationException Thrown when no datagram could be sent because of an error.
+	 */
+	int32_t proofwriteBatch(const std::vector<std::vector<char>>& packets, int64_t timeout = -1);
+
 	int32_t proofwrite(const std::shared_ptr<std::vector<char>> data);
 	int32_t proofwrite(const std::vector<char>& data);
 	int32_t proofwrite(const std::string& data);
@@ -78,6 +115,7 @@ public:
 protected:
 	BaseLib::SharedObjects* _bl = nullptr;
 	int64_t _readTimeout = 15000000;
+	int64_t _writeTimeout = 15000000;
 	bool _autoConnect = true;
 	std::string _hostname;
 	std::string _clientIp;
@@ -93,6 +131,7 @@ protected:
 	void getSocketDescriptor();
 	void getConnection();
 	void autoConnect();
+	bool waitForSocket(bool write, int64_t timeout);
 };
 
 typedef std::shared_ptr<BaseLib::UdpSocket> PUdpSocket;
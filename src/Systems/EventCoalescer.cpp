@@ -0,0 +1,397 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "EventCoalescer.h"
+#include "../BaseLib.h"
+
+#include <cmath>
+
+namespace BaseLib
+{
+namespace Systems
+{
+
+EventCoalescerQueue::EventCoalescerQueue(SharedObjects* baseLib) : ITimedQueue(baseLib, 1)
+{
+}
+
+EventCoalescerQueue::~EventCoalescerQueue()
+{
+	//Stop the thread while processQueueEntry() is still callable.
+	stopQueue(0);
+}
+
+bool EventCoalescerQueue::schedule(int64_t time, std::weak_ptr<EventCoalescer> coalescer, bool rpcEvent, int32_t channel, const std::string& variable, int64_t& id)
+{
+	{
+		std::lock_guard<std::mutex> startGuard(_startMutex);
+		if(!_started)
+		{
+			_started = true;
+			startQueue(0, 0, SCHED_OTHER);
+		}
+	}
+	std::shared_ptr<ITimedQueueEntry> entry = std::make_shared<FlushEntry>(time, coalescer, rpcEvent, channel, variable);
+	return enqueue(0, entry, id);
+}
+
+void EventCoalescerQueue::processQueueEntry(int32_t index, int64_t id, std::shared_ptr<ITimedQueueEntry>& entry)
+{
+	try
+	{
+		std::shared_ptr<FlushEntry> flushEntry = std::dynamic_pointer_cast<FlushEntry>(entry);
+		if(!flushEntry) return;
+		std::shared_ptr<EventCoalescer> coalescer = flushEntry->coalescer.lock();
+		if(coalescer) coalescer->processFlush(id, flushEntry->rpcEvent, flushEntry->channel, flushEntry->variable);
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(const Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+EventCoalescer::EventCoalescer(SharedObjects* baseLib, FlushCallback callback)
+{
+	_bl = baseLib;
+	_callback = callback;
+}
+
+EventCoalescer::~EventCoalescer()
+{
+	drop();
+}
+
+void EventCoalescer::stopLocked(std::vector<std::tuple<bool, int32_t, std::string, std::string, PVariable>>* pendingValues)
+{
+	_stopped = true;
+	int64_t time = HelperFunctions::getTime();
+	for(int32_t i = 0; i < 2; i++)
+	{
+		for(auto& channel : _states[i])
+		{
+			for(auto& state : channel.second)
+			{
+				PVariable value = takePendingValue(state.second, time);
+				if(value && pendingValues) pendingValues->emplace_back(i == 1, channel.first, state.second.deviceAddress, state.first, value);
+			}
+		}
+		_states[i].clear();
+	}
+}
+
+void EventCoalescer::stop()
+{
+	try
+	{
+		std::lock_guard<std::mutex> callbackGuard(_callbackMutex);
+		std::vector<std::tuple<bool, int32_t, std::string, std::string, PVariable>> pendingValues;
+		{
+			std::lock_guard<std::mutex> stateGuard(_stateMutex);
+			if(_stopped) return;
+			stopLocked(&pendingValues);
+		}
+		for(auto& pendingValue : pendingValues)
+		{
+			flush(std::get<0>(pendingValue), std::get<1>(pendingValue), std::get<2>(pendingValue), std::get<3>(pendingValue), std::get<4>(pendingValue));
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(const Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+void EventCoalescer::drop()
+{
+	try
+	{
+		std::lock_guard<std::mutex> callbackGuard(_callbackMutex);
+		std::lock_guard<std::mutex> stateGuard(_stateMutex);
+		if(_stopped) return;
+		stopLocked(nullptr);
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(const Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+void EventCoalescer::setPolicy(int32_t channel, const std::string& variable, Policy policy)
+{
+	std::lock_guard<std::mutex> stateGuard(_stateMutex);
+	_policies[channel][variable] = policy;
+}
+
+void EventCoalescer::removePolicy(int32_t channel, const std::string& variable)
+{
+	try
+	{
+		std::vector<std::tuple<bool, std::string, PVariable>> pendingValues;
+		{
+			std::lock_guard<std::mutex> stateGuard(_stateMutex);
+			auto channelIterator = _policies.find(channel);
+			if(channelIterator == _policies.end()) return;
+			channelIterator->second.erase(variable);
+			if(channelIterator->second.empty()) _policies.erase(channelIterator);
+
+			int64_t time = HelperFunctions::getTime();
+			for(int32_t i = 0; i < 2; i++)
+			{
+				auto stateChannelIterator = _states[i].find(channel);
+				if(stateChannelIterator == _states[i].end()) continue;
+				auto stateIterator = stateChannelIterator->second.find(variable);
+				if(stateIterator == stateChannelIterator->second.end()) continue;
+				PVariable value = takePendingValue(stateIterator->second, time);
+				if(value) pendingValues.emplace_back(i == 1, stateIterator->second.deviceAddress, value);
+				stateChannelIterator->second.erase(stateIterator);
+			}
+		}
+		for(auto& pendingValue : pendingValues)
+		{
+			flush(std::get<0>(pendingValue), channel, std::get<1>(pendingValue), variable, std::get<2>(pendingValue));
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(const Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+bool EventCoalescer::isNumeric(const PVariable& value)
+{
+	return value && (value->type == VariableType::tInteger || value->type == VariableType::tInteger64 || value->type == VariableType::tFloat);
+}
+
+double EventCoalescer::toDouble(const PVariable& value)
+{
+	if(value->type == VariableType::tFloat) return value->floatValue;
+	return (double)value->integerValue64;
+}
+
+bool EventCoalescer::accept(bool rpcEvent, int32_t channel, const std::string& variable, const Policy& policy, ParameterState& state, const PVariable& value, const std::string& deviceAddress, int64_t time)
+{
+	if(policy.deadband > 0 && state.lastValue && isNumeric(value) && isNumeric(state.lastValue) && std::fabs(toDouble(value) - toDouble(state.lastValue)) < policy.deadband)
+	{
+		//The value returned to within the deadband of the last value passed on, so a held back value is obsolete.
+		state.pendingValue.reset();
+		cancelFlush(state);
+		return false;
+	}
+
+	if(time - state.lastSent >= (int64_t)policy.window)
+	{
+		passOn(state, value, deviceAddress, time);
+		return true;
+	}
+
+	state.pendingValue = value;
+	state.deviceAddress = deviceAddress;
+	if(!state.flushScheduled)
+	{
+		int64_t id = 0;
+		if(_bl->eventCoalescerQueue.schedule(state.lastSent + policy.window, shared_from_this(), rpcEvent, channel, variable, id))
+		{
+			state.flushScheduled = true;
+			state.flushId = id;
+		}
+		else
+		{
+			//Never hold back a value without a flush being scheduled.
+			passOn(state, value, deviceAddress, time);
+			return true;
+		}
+	}
+	return false;
+}
+
+void EventCoalescer::passOn(ParameterState& state, const PVariable& value, const std::string& deviceAddress, int64_t time)
+{
+	state.lastSent = time;
+	state.lastValue = value;
+	state.deviceAddress = deviceAddress;
+	state.pendingValue.reset();
+	//A flush scheduled for the previous window would pass on the next value before this window ends.
+	cancelFlush(state);
+}
+
+void EventCoalescer::cancelFlush(ParameterState& state)
+{
+	if(!state.flushScheduled) return;
+	state.flushScheduled = false;
+	_bl->eventCoalescerQueue.removeQueueEntry(0, state.flushId);
+}
+
+PVariable EventCoalescer::takePendingValue(ParameterState& state, int64_t time)
+{
+	cancelFlush(state);
+	if(!state.pendingValue) return PVariable();
+	PVariable value = std::move(state.pendingValue);
+	state.pendingValue.reset();
+	state.lastSent = time;
+	state.lastValue = value;
+	return value;
+}
+
+bool EventCoalescer::filter(bool rpcEvent, int32_t channel, const std::string& deviceAddress, std::shared_ptr<std::vector<std::string>>& variables, std::shared_ptr<std::vector<PVariable>>& values)
+{
+	try
+	{
+		if(!variables || !values || variables->size() != values->size()) return true;
+
+		std::lock_guard<std::mutex> stateGuard(_stateMutex);
+		if(_stopped) return true;
+		auto policyChannelIterator = _policies.find(channel);
+		if(policyChannelIterator == _policies.end()) return true;
+
+		int64_t time = HelperFunctions::getTime();
+		std::shared_ptr<std::vector<std::string>> filteredVariables;
+		std::shared_ptr<std::vector<PVariable>> filteredValues;
+		for(uint32_t i = 0; i < variables->size(); i++)
+		{
+			auto policyIterator = policyChannelIterator->second.find(variables->at(i));
+			bool passOn = true;
+			if(policyIterator != policyChannelIterator->second.end())
+			{
+				ParameterState& state = _states[rpcEvent ? 1 : 0][channel][variables->at(i)];
+				passOn = accept(rpcEvent, channel, variables->at(i), policyIterator->second, state, values->at(i), deviceAddress, time);
+			}
+
+			if(!passOn && !filteredVariables)
+			{
+				//First value held back: Copy all values passed on so far.
+				filteredVariables = std::make_shared<std::vector<std::string>>(variables->begin(), variables->begin() + i);
+				filteredValues = std::make_shared<std::vector<PVariable>>(values->begin(), values->begin() + i);
+			}
+			else if(passOn && filteredVariables)
+			{
+				filteredVariables->push_back(variables->at(i));
+				filteredValues->push_back(values->at(i));
+			}
+		}
+
+		if(!filteredVariables) return true;
+		variables = filteredVariables;
+		values = filteredValues;
+		return !variables->empty();
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(const Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return true;
+}
+
+void EventCoalescer::flush(bool rpcEvent, int32_t channel, const std::string& deviceAddress, const std::string& variable, PVariable value)
+{
+	if(!_callback) return;
+	std::shared_ptr<std::vector<std::string>> variables = std::make_shared<std::vector<std::string>>();
+	variables->push_back(variable);
+	std::shared_ptr<std::vector<PVariable>> values = std::make_shared<std::vector<PVariable>>();
+	values->push_back(value);
+	_callback(rpcEvent, channel, deviceAddress, variables, values);
+}
+
+void EventCoalescer::processFlush(int64_t id, bool rpcEvent, int32_t channel, const std::string& variable)
+{
+	try
+	{
+		std::lock_guard<std::mutex> callbackGuard(_callbackMutex);
+		PVariable value;
+		std::string deviceAddress;
+		{
+			std::lock_guard<std::mutex> stateGuard(_stateMutex);
+			if(_stopped) return;
+			auto channelIterator = _states[rpcEvent ? 1 : 0].find(channel);
+			if(channelIterator == _states[rpcEvent ? 1 : 0].end()) return;
+			auto stateIterator = channelIterator->second.find(variable);
+			if(stateIterator == channelIterator->second.end()) return;
+			//The entry was cancelled after the queue took it.
+			if(!stateIterator->second.flushScheduled || stateIterator->second.flushId != id) return;
+			value = takePendingValue(stateIterator->second, HelperFunctions::getTime());
+			deviceAddress = stateIterator->second.deviceAddress;
+		}
+		if(value) flush(rpcEvent, channel, deviceAddress, variable, value);
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(const Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+}
+}
@@ -0,0 +1,232 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef EVENTCOALESCER_H_
+#define EVENTCOALESCER_H_
+
+#include "../ITimedQueue.h"
+#include "../Variable.h"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace BaseLib
+{
+
+class SharedObjects;
+
+namespace Systems
+{
+
+class EventCoalescer;
+
+/**
+ * Timer queue passing on the values held back by all EventCoalescer objects. There is only one instance, which is stored in
+ * SharedObjects. The processing thread is started when the first value is held back.
+ */
+class EventCoalescerQueue : public ITimedQueue
+{
+public:
+	EventCoalescerQueue(SharedObjects* baseLib);
+	virtual ~EventCoalescerQueue();
+
+	/**
+	 * Schedules passing on the value held back for a parameter.
+	 *
+	 * @param[out] id The ID of the queue entry, which can be passed to removeQueueEntry().
+	 * @return Returns false when the queue is full.
+	 */
+	bool schedule(int64_t time, std::weak_ptr<EventCoalescer> coalescer, bool rpcEvent, int32_t channel, const std::string& variable, int64_t& id);
+protected:
+	class FlushEntry : public ITimedQueueEntry
+	{
+	public:
+		FlushEntry(int64_t time, std::weak_ptr<EventCoalescer> coalescer, bool rpcEvent, int32_t channel, const std::string& variable) : ITimedQueueEntry(time), coalescer(coalescer), rpcEvent(rpcEvent), channel(channel), variable(variable) {}
+
+		std::weak_ptr<EventCoalescer> coalescer;
+		bool rpcEvent = false;
+		int32_t channel = -1;
+		std::string variable;
+	};
+
+	std::mutex _startMutex;
+	bool _started = false;
+
+	virtual void processQueueEntry(int32_t index, int64_t id, std::shared_ptr<ITimedQueueEntry>& entry);
+};
+
+/**
+ * Limits the event rate of single parameters of a peer. For every parameter with a policy, at most one event is passed on
+ * per window. Values arriving within the window replace each other and the latest one is passed on when the window ends.
+ * Numeric values changing less than the deadband compared to the last value passed on are dropped.
+ *
+ * Events are identified by their type (event or RPC event), channel and variable name, so both event types are coalesced
+ * independently with the same policy.
+ *
+ * Must be owned by a std::shared_ptr. Values held back are passed on by the shared EventCoalescerQueue.
+ */
+class EventCoalescer : public std::enable_shared_from_this<EventCoalescer>
+{
+public:
+	struct Policy
+	{
+		/**
+		 * The minimum time between two events of the parameter in milliseconds. 0 disables coalescing.
+		 */
+		uint32_t window = 0;
+
+		/**
+		 * Changes of numeric values smaller than this value are dropped. 0 disables the deadband.
+		 */
+		double deadband = 0;
+	};
+
+	/**
+	 * Called from the thread of EventCoalescerQueue to pass on values held back at the end of their window.
+	 *
+	 * @param rpcEvent true for RPC events, false for events.
+	 * @param channel The channel of the values.
+	 * @param deviceAddress The device address passed with the RPC event.
+	 */
+	typedef std::function<void(bool rpcEvent, int32_t channel, const std::string& deviceAddress, std::shared_ptr<std::vector<std::string>> variables, std::shared_ptr<std::vector<PVariable>> values)> FlushCallback;
+
+	EventCoalescer(SharedObjects* baseLib, FlushCallback callback);
+	virtual ~EventCoalescer();
+
+	/**
+	 * Sets or replaces the policy of a parameter.
+	 */
+	void setPolicy(int32_t channel, const std::string& variable, Policy policy);
+
+	/**
+	 * Removes the policy of a parameter. A value held back is passed on immediately.
+	 */
+	void removePolicy(int32_t channel, const std::string& variable);
+
+	/**
+	 * Removes all values held back by the policies. variables and values are replaced by new vectors when values are held
+	 * back or dropped, the original vectors are never modified.
+	 *
+	 * @return Returns false when no values are left to pass on.
+	 */
+	bool filter(bool rpcEvent, int32_t channel, const std::string& deviceAddress, std::shared_ptr<std::vector<std::string>>& variables, std::shared_ptr<std::vector<PVariable>>& values);
+
+	/**
+	 * Passes on all values held back immediately. Afterwards all values are passed through and the callback is not called
+	 * anymore. Must not be called from the callback.
+	 */
+	void stop();
+
+	/**
+	 * Drops all values held back. Afterwards all values are passed through and the callback is not called anymore. When the
+	 * callback is running, drop() waits for it to finish, so the object the callback refers to can be destroyed afterwards.
+	 * Must not be called from the callback.
+	 */
+	void drop();
+
+	/**
+	 * Called by EventCoalescerQueue when the window of a parameter ends.
+	 *
+	 * @param id The ID of the queue entry.
+	 */
+	void processFlush(int64_t id, bool rpcEvent, int32_t channel, const std::string& variable);
+protected:
+	struct ParameterState
+	{
+		int64_t lastSent = 0;
+		PVariable lastValue;
+		PVariable pendingValue;
+		std::string deviceAddress;
+		bool flushScheduled = false;
+
+		/**
+		 * The ID of the queue entry when flushScheduled is true.
+		 */
+		int64_t flushId = 0;
+	};
+
+	SharedObjects* _bl = nullptr;
+	FlushCallback _callback;
+
+	/**
+	 * Locked while the callback is called by processFlush() or stop(), so drop() can wait for it.
+	 */
+	std::mutex _callbackMutex;
+	std::mutex _stateMutex;
+	bool _stopped = false;
+	std::unordered_map<int32_t, std::unordered_map<std::string, Policy>> _policies;
+
+	/**
+	 * Index 0 for events, index 1 for RPC events.
+	 */
+	std::unordered_map<int32_t, std::unordered_map<std::string, ParameterState>> _states[2];
+
+	static bool isNumeric(const PVariable& value);
+	static double toDouble(const PVariable& value);
+
+	/**
+	 * Returns true when the value should be passed on now. _stateMutex needs to be locked.
+	 */
+	bool accept(bool rpcEvent, int32_t channel, const std::string& variable, const Policy& policy, ParameterState& state, const PVariable& value, const std::string& deviceAddress, int64_t time);
+
+	/**
+	 * Records a value as passed on and cancels a scheduled flush. _stateMutex needs to be locked.
+	 */
+	void passOn(ParameterState& state, const PVariable& value, const std::string& deviceAddress, int64_t time);
+
+	/**
+	 * Removes the queue entry of a scheduled flush. _stateMutex needs to be locked.
+	 */
+	void cancelFlush(ParameterState& state);
+
+	/**
+	 * Takes the pending value of a parameter and cancels a scheduled flush. _stateMutex needs to be locked.
+	 */
+	PVariable takePendingValue(ParameterState& state, int64_t time);
+
+	/**
+	 * Sets _stopped and cancels all scheduled flushes. _stateMutex needs to be locked.
+	 *
+	 * @param pendingValues When not nullptr, all values held back are moved into the vector.
+	 */
+	void stopLocked(std::vector<std::tuple<bool, int32_t, std::string, std::string, PVariable>>* pendingValues);
+
+	void flush(bool rpcEvent, int32_t channel, const std::string& deviceAddress, const std::string& variable, PVariable value);
+};
+
+}
+}
+
+#endif
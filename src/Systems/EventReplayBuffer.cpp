@@ -0,0 +1,187 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "EventReplayBuffer.h"
+#include "../BaseLib.h"
+
+namespace BaseLib
+{
+namespace Systems
+{
+
+EventReplayBuffer::EventReplayBuffer()
+{
+	_epoch = HelperFunctions::getHexString(HelperFunctions::getRandomBytes(8));
+}
+
+void EventReplayBuffer::init(SharedObjects* baseLib)
+{
+	_bl = baseLib;
+}
+
+uint64_t EventReplayBuffer::add(bool rpcEvent, int32_t familyId, uint64_t peerId, int32_t channel, const std::string& deviceAddress, const std::shared_ptr<std::vector<std::string>>& variables, const std::shared_ptr<std::vector<PVariable>>& values, std::function<void(uint64_t)> deliver)
+{
+	std::shared_ptr<Event> event = std::make_shared<Event>();
+	event->epoch = _epoch;
+	event->time = HelperFunctions::getTime();
+	event->rpcEvent = rpcEvent;
+	event->familyId = familyId;
+	event->peerId = peerId;
+	event->channel = channel;
+	event->deviceAddress = deviceAddress;
+	event->variables = variables;
+	event->values = values;
+
+	std::unique_lock<std::mutex> bufferGuard(_bufferMutex);
+	if(!_bufferInitialized)
+	{
+		_bufferInitialized = true;
+		if(_bl) _buffer.resize(_bl->settings.eventReplayBufferSize());
+	}
+	//Assigned while _bufferMutex is locked, so events are stored in the order of their sequence numbers.
+	event->sequenceNumber = _sequenceNumber + 1;
+	if(!_buffer.empty())
+	{
+		_buffer[event->sequenceNumber % _buffer.size()] = event;
+		if(_bufferCount < _buffer.size()) _bufferCount++;
+	}
+	_sequenceNumber = event->sequenceNumber;
+	uint64_t sequenceNumber = event->sequenceNumber;
+
+	//Queued together with assigning the sequence number, so the queue has no gaps. When another thread is delivering, it
+	//also delivers this event after the ones before it.
+	_deliveries.emplace_back(sequenceNumber, std::move(deliver));
+	if(_delivering) return sequenceNumber;
+	_delivering = true;
+	while(!_deliveries.empty())
+	{
+		std::pair<uint64_t, std::function<void(uint64_t)>> delivery = std::move(_deliveries.front());
+		_deliveries.pop_front();
+		bufferGuard.unlock();
+		try
+		{
+			if(delivery.second) delivery.second(delivery.first);
+		}
+		catch(const std::exception& ex)
+		{
+			if(_bl) _bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+		}
+		catch(const Exception& ex)
+		{
+			if(_bl) _bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+		}
+		catch(...)
+		{
+			if(_bl) _bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+		}
+		bufferGuard.lock();
+	}
+	_delivering = false;
+	return sequenceNumber;
+}
+
+bool EventReplayBuffer::getEventsSince(const std::string& epoch, uint64_t sequenceNumber, std::vector<PEvent>& events)
+{
+	events.clear();
+	//The sequence number belongs to another process, so it says nothing about the events the client missed.
+	if(epoch != _epoch) return false;
+	std::lock_guard<std::mutex> bufferGuard(_bufferMutex);
+	uint64_t lastSequenceNumber = _sequenceNumber;
+	if(sequenceNumber >= lastSequenceNumber) return sequenceNumber == lastSequenceNumber;
+	uint64_t oldestSequenceNumber = lastSequenceNumber - _bufferCount + 1;
+	if(_bufferCount == 0 || sequenceNumber + 1 < oldestSequenceNumber) return false;
+
+	events.reserve(lastSequenceNumber - sequenceNumber);
+	for(uint64_t i = sequenceNumber + 1; i <= lastSequenceNumber; i++)
+	{
+		events.push_back(_buffer[i % _buffer.size()]);
+	}
+	return true;
+}
+
+PVariable EventReplayBuffer::getEventsSinceVariable(const std::string& epoch, uint64_t sequenceNumber)
+{
+	try
+	{
+		std::vector<PEvent> events;
+		bool complete = getEventsSince(epoch, sequenceNumber, events);
+
+		PVariable result = std::make_shared<Variable>(VariableType::tStruct);
+		result->structValue->emplace("EPOCH", std::make_shared<Variable>(_epoch));
+		result->structValue->emplace("SEQUENCE_NUMBER", std::make_shared<Variable>((int64_t)(events.empty() ? _sequenceNumber.load() : events.back()->sequenceNumber)));
+		result->structValue->emplace("COMPLETE", std::make_shared<Variable>(complete));
+		PVariable eventArray = std::make_shared<Variable>(VariableType::tArray);
+		eventArray->arrayValue->reserve(events.size());
+		for(auto& event : events)
+		{
+			PVariable eventStruct = std::make_shared<Variable>(VariableType::tStruct);
+			eventStruct->structValue->emplace("EPOCH", std::make_shared<Variable>(event->epoch));
+			eventStruct->structValue->emplace("SEQUENCE_NUMBER", std::make_shared<Variable>((int64_t)event->sequenceNumber));
+			eventStruct->structValue->emplace("TIME", std::make_shared<Variable>(event->time));
+			eventStruct->structValue->emplace("TYPE", std::make_shared<Variable>(std::string(event->rpcEvent ? "rpcEvent" : "event")));
+			eventStruct->structValue->emplace("FAMILY_ID", std::make_shared<Variable>(event->familyId));
+			eventStruct->structValue->emplace("PEER_ID", std::make_shared<Variable>((int64_t)event->peerId));
+			eventStruct->structValue->emplace("CHANNEL", std::make_shared<Variable>(event->channel));
+			if(event->rpcEvent) eventStruct->structValue->emplace("DEVICE_ADDRESS", std::make_shared<Variable>(event->deviceAddress));
+			PVariable variables = std::make_shared<Variable>(VariableType::tArray);
+			PVariable values = std::make_shared<Variable>(VariableType::tArray);
+			if(event->variables && event->values)
+			{
+				variables->arrayValue->reserve(event->variables->size());
+				for(auto& variable : *event->variables)
+				{
+					variables->arrayValue->push_back(std::make_shared<Variable>(variable));
+				}
+				*values->arrayValue = *event->values;
+			}
+			eventStruct->structValue->emplace("VARIABLES", variables);
+			eventStruct->structValue->emplace("VALUES", values);
+			eventArray->arrayValue->push_back(eventStruct);
+		}
+		result->structValue->emplace("EVENTS", eventArray);
+		return result;
+	}
+	catch(const std::exception& ex)
+	{
+		if(_bl) _bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(const Exception& ex)
+	{
+		if(_bl) _bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		if(_bl) _bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return Variable::createError(-32500, "Unknown application error.");
+}
+
+}
+}
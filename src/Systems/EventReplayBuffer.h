@@ -0,0 +1,164 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef EVENTREPLAYBUFFER_H_
+#define EVENTREPLAYBUFFER_H_
+
+#include "../Variable.h"
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace BaseLib
+{
+
+class SharedObjects;
+
+namespace Systems
+{
+
+/**
+ * Assigns a process wide, monotonically increasing sequence number to every event raised by a central and keeps the most
+ * recent events in memory. A client reconnecting after a connection loss can fetch all events it missed by passing the
+ * last sequence number it received. Only when the events it missed are not in the buffer anymore, it needs to reread the
+ * full state (e. g. with getAllValues).
+ *
+ * Sequence numbers start at 1 again when the process is restarted. So every process gets a random epoch ID, which clients
+ * need to store with the sequence number. Events from another epoch are never returned.
+ *
+ * Events are delivered in the order of their sequence numbers: add() queues the delivery function while the number is
+ * assigned, and the queue is processed by one thread at a time. So a client receiving event n has received all events
+ * before n that were delivered to it, and the last sequence number it received is the one to resume from. The delivery
+ * can happen on the thread of another event or after add() returned, e. g. when an event is raised while another one is
+ * delivered. An event can be in the buffer before it is delivered, so a client resuming from a sequence number might
+ * receive events twice and needs to ignore events with a sequence number it already received.
+ *
+ * The size of the buffer is set with "eventReplayBufferSize" in main.conf.
+ */
+class EventReplayBuffer
+{
+public:
+	struct Event
+	{
+		std::string epoch;
+		uint64_t sequenceNumber = 0;
+		int64_t time = 0;
+		bool rpcEvent = false;
+		int32_t familyId = -1;
+		uint64_t peerId = 0;
+		int32_t channel = -1;
+		std::string deviceAddress;
+		std::shared_ptr<std::vector<std::string>> variables;
+		std::shared_ptr<std::vector<PVariable>> values;
+	};
+	typedef std::shared_ptr<const Event> PEvent;
+
+	EventReplayBuffer();
+	virtual ~EventReplayBuffer() {}
+	void init(SharedObjects* baseLib);
+
+	/**
+	 * Assigns the next sequence number to an event, stores it in the buffer and delivers it. variables and values must not
+	 * be changed afterwards.
+	 *
+	 * @param deliver Called with the sequence number in the order of the sequence numbers. Must not throw.
+	 * @return Returns the sequence number of the event.
+	 */
+	uint64_t add(bool rpcEvent, int32_t familyId, uint64_t peerId, int32_t channel, const std::string& deviceAddress, const std::shared_ptr<std::vector<std::string>>& variables, const std::shared_ptr<std::vector<PVariable>>& values, std::function<void(uint64_t)> deliver);
+
+	/**
+	 * Returns the random ID of this process. The sequence numbers are only unique within it.
+	 */
+	std::string getEpoch() { return _epoch; }
+
+	/**
+	 * Returns the sequence number of the last event or 0 when no event was raised yet.
+	 */
+	uint64_t getSequenceNumber() { return _sequenceNumber; }
+
+	/**
+	 * Returns all events after the given sequence number.
+	 *
+	 * @param epoch The epoch ID the client received with the sequence number.
+	 * @param sequenceNumber The last sequence number the client received.
+	 * @param[out] events The events after sequenceNumber in order.
+	 * @return Returns false when events after sequenceNumber are not in the buffer anymore or when epoch is not the epoch of
+	 * this process. In this case the client needs to reread the full state and events is empty.
+	 */
+	bool getEventsSince(const std::string& epoch, uint64_t sequenceNumber, std::vector<PEvent>& events);
+
+	/**
+	 * Returns the events after the given sequence number as a struct with the following entries:
+	 *
+	 * - EPOCH: The epoch ID of this process.
+	 * - SEQUENCE_NUMBER: The sequence number of the last event.
+	 * - COMPLETE: false when events were lost or the epoch changed and the full state needs to be reread.
+	 * - EVENTS: Array of structs with EPOCH, SEQUENCE_NUMBER, TIME, TYPE ("event" or "rpcEvent"), FAMILY_ID, PEER_ID, CHANNEL,
+	 *   DEVICE_ADDRESS (RPC events only), VARIABLES and VALUES.
+	 */
+	PVariable getEventsSinceVariable(const std::string& epoch, uint64_t sequenceNumber);
+private:
+	SharedObjects* _bl = nullptr;
+	std::string _epoch;
+	std::mutex _bufferMutex;
+	std::atomic<uint64_t> _sequenceNumber{0};
+
+	/**
+	 * The event with sequence number n is stored at index n % _buffer.size(). Allocated when the first event is added, so
+	 * the settings are loaded.
+	 */
+	std::vector<PEvent> _buffer;
+	bool _bufferInitialized = false;
+
+	/**
+	 * The number of events stored in _buffer.
+	 */
+	uint64_t _bufferCount = 0;
+
+	/**
+	 * Deliveries not started yet in the order of their sequence numbers. Protected by _bufferMutex.
+	 */
+	std::deque<std::pair<uint64_t, std::function<void(uint64_t)>>> _deliveries;
+
+	/**
+	 * true while a thread processes _deliveries. Protected by _bufferMutex.
+	 */
+	bool _delivering = false;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,210 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "EventSubscriptions.h"
+#include "../BaseLib.h"
+
+namespace BaseLib
+{
+namespace Systems
+{
+
+size_t EventSubscriptions::KeyHash::operator()(const Key& key) const
+{
+	size_t hash = std::hash<std::string>()(key.variable);
+	hash ^= std::hash<uint64_t>()(key.peerId) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+	hash ^= std::hash<int32_t>()(key.channel) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+	return hash;
+}
+
+EventSubscriptions::EventSubscriptions(SharedObjects* baseLib)
+{
+	_bl = baseLib;
+	_indexes = std::make_shared<const std::vector<Index>>(2);
+}
+
+int64_t EventSubscriptions::subscribe(EventType type, uint64_t peerId, int32_t channel, const std::string& variable, Callback callback)
+{
+	PSubscription subscription = std::make_shared<Subscription>();
+	subscription->type = type;
+	subscription->key.peerId = peerId;
+	subscription->key.channel = channel;
+	subscription->key.variable = variable;
+	subscription->callback = callback;
+
+	std::lock_guard<std::mutex> subscriptionsGuard(_subscriptionsMutex);
+	subscription->id = _currentId++;
+	_subscriptions.emplace(subscription->id, subscription);
+	publishIndexes();
+	return subscription->id;
+}
+
+void EventSubscriptions::unsubscribe(int64_t id)
+{
+	PSubscription subscription;
+	{
+		std::lock_guard<std::mutex> subscriptionsGuard(_subscriptionsMutex);
+		auto subscriptionIterator = _subscriptions.find(id);
+		if(subscriptionIterator == _subscriptions.end()) return;
+		subscription = subscriptionIterator->second;
+		_subscriptions.erase(subscriptionIterator);
+		publishIndexes();
+	}
+
+	//Dispatchers still using the old index either incremented the use count before active was reset (and are waited for
+	//here) or see that the subscription is not active anymore.
+	subscription->active = false;
+	while(subscription->useCount != 0)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+size_t EventSubscriptions::size()
+{
+	std::lock_guard<std::mutex> subscriptionsGuard(_subscriptionsMutex);
+	return _subscriptions.size();
+}
+
+void EventSubscriptions::publishIndexes()
+{
+	std::shared_ptr<std::vector<Index>> indexes = std::make_shared<std::vector<Index>>(2);
+	for(auto& subscription : _subscriptions)
+	{
+		Index& index = indexes->at((int32_t)subscription.second->type);
+		index.subscriptions[subscription.second->key].push_back(subscription.second);
+		uint8_t combination = 0;
+		if(subscription.second->key.peerId == anyPeer) combination |= 1;
+		if(subscription.second->key.channel == anyChannel) combination |= 2;
+		if(subscription.second->key.variable.empty()) combination |= 4;
+		index.usedCombinations |= (1 << combination);
+	}
+	std::atomic_store(&_indexes, PIndexes(indexes));
+}
+
+void EventSubscriptions::dispatch(EventType type, uint64_t peerId, int32_t channel, const std::string& deviceAddress, const std::shared_ptr<std::vector<std::string>>& variables, const std::shared_ptr<std::vector<PVariable>>& values)
+{
+	try
+	{
+		if(!variables || !values || variables->size() != values->size()) return;
+		PIndexes indexes = std::atomic_load(&_indexes);
+		const Index& index = indexes->at((int32_t)type);
+		if(index.usedCombinations == 0) return;
+
+		//Subscriptions matching the event and the indexes of the matching variables. There are only a few per event, so
+		//searching linearly is faster than a map.
+		std::vector<std::pair<Subscription*, std::vector<uint32_t>>> matches;
+		Key key;
+		for(uint32_t i = 0; i < variables->size(); i++)
+		{
+			for(uint8_t combination = 0; combination < 8; combination++)
+			{
+				if(!(index.usedCombinations & (1 << combination))) continue;
+				key.peerId = (combination & 1) ? anyPeer : peerId;
+				key.channel = (combination & 2) ? anyChannel : channel;
+				if(combination & 4) key.variable.clear();
+				else key.variable = variables->at(i);
+
+				auto subscriptionsIterator = index.subscriptions.find(key);
+				if(subscriptionsIterator == index.subscriptions.end()) continue;
+				for(auto& subscription : subscriptionsIterator->second)
+				{
+					auto matchIterator = matches.begin();
+					for(; matchIterator != matches.end(); ++matchIterator)
+					{
+						if(matchIterator->first == subscription.get()) break;
+					}
+					if(matchIterator == matches.end())
+					{
+						matches.emplace_back(subscription.get(), std::vector<uint32_t>());
+						matchIterator = matches.end() - 1;
+					}
+					//A variable can match more than one wildcard combination of the same subscription only when they are
+					//equal, so checking the last index is enough.
+					if(matchIterator->second.empty() || matchIterator->second.back() != i) matchIterator->second.push_back(i);
+				}
+			}
+		}
+
+		for(auto& match : matches)
+		{
+			Subscription* subscription = match.first;
+			subscription->useCount++;
+			try
+			{
+				if(subscription->active)
+				{
+					if(match.second.size() == variables->size()) subscription->callback(peerId, channel, deviceAddress, variables, values);
+					else
+					{
+						std::shared_ptr<std::vector<std::string>> matchingVariables = std::make_shared<std::vector<std::string>>();
+						std::shared_ptr<std::vector<PVariable>> matchingValues = std::make_shared<std::vector<PVariable>>();
+						matchingVariables->reserve(match.second.size());
+						matchingValues->reserve(match.second.size());
+						for(auto variableIndex : match.second)
+						{
+							matchingVariables->push_back(variables->at(variableIndex));
+							matchingValues->push_back(values->at(variableIndex));
+						}
+						subscription->callback(peerId, channel, deviceAddress, matchingVariables, matchingValues);
+					}
+				}
+			}
+			catch(const std::exception& ex)
+			{
+				_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+			}
+			catch(const Exception& ex)
+			{
+				_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+			}
+			catch(...)
+			{
+				_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+			}
+			subscription->useCount--;
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(const Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+}
+}
@@ -0,0 +1,186 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef EVENTSUBSCRIPTIONS_H_
+#define EVENTSUBSCRIPTIONS_H_
+
+#include "../Variable.h"
+
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace BaseLib
+{
+
+class SharedObjects;
+
+namespace Systems
+{
+
+/**
+ * Registry of consumers interested in events of specific peers, channels or variables. Each subscription can use a wildcard
+ * for the peer, the channel and the variable. Subscriptions are stored in hash indexes, so dispatching an event only costs
+ * one lookup per variable and used combination of wildcards. Events nobody subscribed to cost one atomic load.
+ *
+ * The indexes are immutable and replaced on every change, so dispatching never locks a mutex. Subscribing and unsubscribing
+ * is comparatively expensive and should not be done per event.
+ *
+ * Example:
+ *
+ *     int64_t id = central->getEventSubscriptions().subscribe(EventSubscriptions::EventType::event, peerId, EventSubscriptions::anyChannel, "STATE", callback);
+ *     ...
+ *     central->getEventSubscriptions().unsubscribe(id);
+ */
+class EventSubscriptions
+{
+public:
+	enum class EventType
+	{
+		event = 0,
+		rpcEvent = 1
+	};
+
+	/**
+	 * Wildcard matching all peers.
+	 */
+	static const uint64_t anyPeer = 0;
+
+	/**
+	 * Wildcard matching all channels. -1 can't be used, because it is the channel of device variables.
+	 */
+	static const int32_t anyChannel = std::numeric_limits<int32_t>::min();
+
+	/**
+	 * Called for every event matching a subscription. Only the variables matching the subscription are passed. The
+	 * callback is called by the thread raising the event and must not block.
+	 *
+	 * @param deviceAddress The device address of RPC events. Empty for events.
+	 */
+	typedef std::function<void(uint64_t peerId, int32_t channel, const std::string& deviceAddress, std::shared_ptr<std::vector<std::string>> variables, std::shared_ptr<std::vector<PVariable>> values)> Callback;
+
+	EventSubscriptions(SharedObjects* baseLib);
+	virtual ~EventSubscriptions() {}
+
+	/**
+	 * Adds a subscription.
+	 *
+	 * @param type The type of events to subscribe to.
+	 * @param peerId The ID of the peer or anyPeer.
+	 * @param channel The channel or anyChannel.
+	 * @param variable The name of the variable or an empty string for all variables.
+	 * @param callback The method to call for matching events.
+	 * @return Returns the ID of the subscription, which is needed to unsubscribe.
+	 */
+	int64_t subscribe(EventType type, uint64_t peerId, int32_t channel, const std::string& variable, Callback callback);
+
+	/**
+	 * Removes a subscription. When the method returns, the callback is not running and will not be called anymore. Must
+	 * not be called from within the callback.
+	 */
+	void unsubscribe(int64_t id);
+
+	/**
+	 * Returns the number of subscriptions.
+	 */
+	size_t size();
+
+	/**
+	 * Calls the callbacks of all subscriptions matching the event.
+	 */
+	void dispatch(EventType type, uint64_t peerId, int32_t channel, const std::string& deviceAddress, const std::shared_ptr<std::vector<std::string>>& variables, const std::shared_ptr<std::vector<PVariable>>& values);
+private:
+	struct Key
+	{
+		uint64_t peerId = 0;
+		int32_t channel = 0;
+		std::string variable;
+
+		bool operator==(const Key& other) const { return peerId == other.peerId && channel == other.channel && variable == other.variable; }
+	};
+
+	struct KeyHash
+	{
+		size_t operator()(const Key& key) const;
+	};
+
+	struct Subscription
+	{
+		int64_t id = 0;
+		EventType type = EventType::event;
+		Key key;
+		Callback callback;
+		std::atomic<int32_t> useCount{0};
+		std::atomic_bool active{true};
+	};
+	typedef std::shared_ptr<Subscription> PSubscription;
+
+	struct Index
+	{
+		std::unordered_map<Key, std::vector<PSubscription>, KeyHash> subscriptions;
+
+		/**
+		 * Bit 0 set: Subscriptions with a peer wildcard exist, bit 1: with channel wildcard, bit 2: with variable wildcard.
+		 * Bit (1 << combination) of usedCombinations is set, when subscriptions with this combination of wildcards exist.
+		 */
+		uint8_t usedCombinations = 0;
+	};
+
+	/**
+	 * One index per event type.
+	 */
+	typedef std::shared_ptr<const std::vector<Index>> PIndexes;
+
+	SharedObjects* _bl = nullptr;
+	std::mutex _subscriptionsMutex;
+	int64_t _currentId = 1;
+	std::map<int64_t, PSubscription> _subscriptions;
+
+	/**
+	 * Only accessed through std::atomic_load and std::atomic_store.
+	 */
+	PIndexes _indexes;
+
+	/**
+	 * Rebuilds the indexes from _subscriptions. _subscriptionsMutex needs to be locked.
+	 */
+	void publishIndexes();
+};
+
+}
+}
+
+#endif
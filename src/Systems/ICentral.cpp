@@ -36,7 +36,7 @@ namespace BaseLib
 namespace Systems
 {
 
-ICentral::ICentral(int32_t deviceFamily, BaseLib::SharedObjects* baseLib, ICentralEventSink* eventHandler)
+ICentral::ICentral(int32_t deviceFamily, BaseLib::SharedObjects* baseLib, ICentralEventSink* eventHandler) : _eventSubscriptions(baseLib)
 {
 	_bl = baseLib;
 	_deviceFamily = deviceFamily;
@@ -78,7 +78,11 @@ void ICentral::dispose(bool wait)
 
 	void ICentral::raiseRPCEvent(uint64_t id, int32_t channel, std::string deviceAddress, std::shared_ptr<std::vector<std::string>> valueKeys, std::shared_ptr<std::vector<PVariable>> values)
 	{
-		if(_eventHandler) ((ICentralEventSink*)_eventHandler)->onRPCEvent(id, channel, deviceAddress, valueKeys, values);
+		_bl->eventReplayBuffer.add(true, _deviceFamily, id, channel, deviceAddress, valueKeys, values, [this, id, channel, deviceAddress, valueKeys, values](uint64_t sequenceNumber)
+		{
+			if(_eventHandler) ((ICentralEventSink*)_eventHandler)->onSequencedRPCEvent(sequenceNumber, id, channel, deviceAddress, valueKeys, values);
+			_eventSubscriptions.dispatch(EventSubscriptions::EventType::rpcEvent, id, channel, deviceAddress, valueKeys, values);
+		});
 	}
 
 	void ICentral::raiseRPCUpdateDevice(uint64_t id, int32_t channel, std::string address, int32_t hint)
@@ -98,7 +102,11 @@ void ICentral::dispose(bool wait)
 
 	void ICentral::raiseEvent(uint64_t peerId, int32_t channel, std::shared_ptr<std::vector<std::string>> variables, std::shared_ptr<std::vector<PVariable>> values)
 	{
-		if(_eventHandler) ((ICentralEventSink*)_eventHandler)->onEvent(peerId, channel, variables, values);
+		_bl->eventReplayBuffer.add(false, _deviceFamily, peerId, channel, "", variables, values, [this, peerId, channel, variables, values](uint64_t sequenceNumber)
+		{
+			if(_eventHandler) ((ICentralEventSink*)_eventHandler)->onSequencedEvent(sequenceNumber, peerId, channel, variables, values);
+			_eventSubscriptions.dispatch(EventSubscriptions::EventType::event, peerId, channel, "", variables, values);
+		});
 	}
 
 	void ICentral::raiseRunScript(ScriptEngine::PScriptInfo& scriptInfo, bool wait)
@@ -1559,22 +1567,12 @@ PVariable ICentral::listDevices(PRpcClientInfo clientInfo, bool channels, std::m
 	try
 	{
 		PVariable array(new Variable(VariableType::tArray));
-
-		std::vector<std::shared_ptr<Peer>> peers = getPeers();
-
-		for(std::shared_ptr<Peer> peer : peers)
+		PVariable result = streamDevices(clientInfo, channels, fields, knownDevices, [&](const std::shared_ptr<std::vector<PVariable>>& descriptions)
 		{
-			if(knownDevices && knownDevices->find(peer->getID()) != knownDevices->end()) continue;
-			//listDevices really needs a lot of resources, so wait a little bit after each device
-			std::this_thread::sleep_for(std::chrono::milliseconds(3));
-			std::shared_ptr<std::vector<PVariable>> descriptions = peer->getDeviceDescriptions(clientInfo, channels, fields);
-			if(!descriptions) continue;
-			for(PVariable description : *descriptions)
-			{
-				array->arrayValue->push_back(description);
-			}
-		}
-
+			array->arrayValue->insert(array->arrayValue->end(), descriptions->begin(), descriptions->end());
+			return true;
+		});
+		if(result->errorStruct) return result;
 		return array;
 	}
 	catch(const std::exception& ex)
@@ -1597,23 +1595,85 @@ PVariable ICentral::listTeams(BaseLib::PRpcClientInfo clientInfo)
 	try
 	{
 		PVariable array(new Variable(VariableType::tArray));
+		PVariable result = streamTeams(clientInfo, [&](const std::shared_ptr<std::vector<PVariable>>& descriptions)
+		{
+			array->arrayValue->insert(array->arrayValue->end(), descriptions->begin(), descriptions->end());
+			return true;
+		});
+		if(result->errorStruct) return result;
+		return array;
+	}
+	catch(const std::exception& ex)
+    {
+        _bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(BaseLib::Exception& ex)
+    {
+        _bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        _bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return Variable::createError(-32500, "Unknown application error.");
+}
+
+void ICentral::yieldIfBudgetExhausted(int64_t& budgetStart)
+{
+	int64_t time = HelperFunctions::getTimeMicroseconds();
+	if(time - budgetStart < _descriptionYieldBudget && time >= budgetStart) return;
+	std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	budgetStart = HelperFunctions::getTimeMicroseconds();
+}
 
+PVariable ICentral::streamDevices(PRpcClientInfo clientInfo, bool channels, std::map<std::string, bool> fields, std::shared_ptr<std::set<uint64_t>> knownDevices, DescriptionCallback callback)
+{
+	try
+	{
+		//Creating descriptions needs a lot of resources. Instead of waiting after each device, give up the CPU regularly.
+		//Unchanged descriptions come from the peers' caches and are cheap.
+		int64_t budgetStart = HelperFunctions::getTimeMicroseconds();
 		std::vector<std::shared_ptr<Peer>> peers = getPeers();
+		for(std::shared_ptr<Peer>& peer : peers)
+		{
+			if(knownDevices && knownDevices->find(peer->getID()) != knownDevices->end()) continue;
+			std::shared_ptr<std::vector<PVariable>> descriptions = peer->getCachedDeviceDescriptions(clientInfo, channels, fields);
+			if(descriptions && !descriptions->empty() && !callback(descriptions)) break;
+			yieldIfBudgetExhausted(budgetStart);
+		}
+		return PVariable(new Variable(VariableType::tVoid));
+	}
+	catch(const std::exception& ex)
+    {
+        _bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(BaseLib::Exception& ex)
+    {
+        _bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+        _bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return Variable::createError(-32500, "Unknown application error.");
+}
 
-		for(auto peer : peers)
+PVariable ICentral::streamTeams(PRpcClientInfo clientInfo, DescriptionCallback callback)
+{
+	try
+	{
+		int64_t budgetStart = HelperFunctions::getTimeMicroseconds();
+		std::map<std::string, bool> fields;
+		std::vector<std::shared_ptr<Peer>> peers = getPeers();
+		for(std::shared_ptr<Peer>& peer : peers)
 		{
-			//listTeams really needs a lot of ressources, so wait a little bit after each device
-			std::this_thread::sleep_for(std::chrono::milliseconds(3));
 			std::string serialNumber = peer->getSerialNumber();
 			if(serialNumber.empty() || serialNumber.at(0) != '*') continue;
-			auto descriptions = peer->getDeviceDescriptions(clientInfo, true, std::map<std::string, bool>());
-			if(!descriptions) continue;
-			for(auto description : *descriptions)
-			{
-				array->arrayValue->push_back(description);
-			}
+			std::shared_ptr<std::vector<PVariable>> descriptions = peer->getCachedDeviceDescriptions(clientInfo, true, fields);
+			if(descriptions && !descriptions->empty() && !callback(descriptions)) break;
+			yieldIfBudgetExhausted(budgetStart);
 		}
-		return array;
+		return PVariable(new Variable(VariableType::tVoid));
 	}
 	catch(const std::exception& ex)
     {
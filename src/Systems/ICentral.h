@@ -37,7 +37,9 @@
 #include "../Sockets/RpcClientInfo.h"
 #include "IPhysicalInterface.h"
 #include "Peer.h"
+#include "EventSubscriptions.h"
 
+#include <functional>
 #include <set>
 
 using namespace BaseLib::DeviceDescription;
@@ -65,6 +67,19 @@ public:
 		virtual void onRPCDeleteDevices(PVariable deviceAddresses, PVariable deviceInfo) = 0;
 		virtual void onEvent(uint64_t peerId, int32_t channel, std::shared_ptr<std::vector<std::string>> variables, std::shared_ptr<std::vector<std::shared_ptr<BaseLib::Variable>>> values) = 0;
 		virtual void onRunScript(ScriptEngine::PScriptInfo& scriptInfo, bool wait) = 0;
+
+		/**
+		 * Like onRPCEvent(), but also passes the sequence number assigned by SharedObjects::eventReplayBuffer. Override
+		 * to pass the sequence number on to clients together with EventReplayBuffer::getEpoch(). Calls onRPCEvent() by
+		 * default.
+		 */
+		virtual void onSequencedRPCEvent(uint64_t sequenceNumber, uint64_t id, int32_t channel, std::string deviceAddress, std::shared_ptr<std::vector<std::string>> valueKeys, std::shared_ptr<std::vector<PVariable>> values) { onRPCEvent(id, channel, deviceAddress, valueKeys, values); }
+
+		/**
+		 * Like onEvent(), but also passes the sequence number assigned by SharedObjects::eventReplayBuffer. Override to pass
+		 * the sequence number on to clients together with EventReplayBuffer::getEpoch(). Calls onEvent() by default.
+		 */
+		virtual void onSequencedEvent(uint64_t sequenceNumber, uint64_t peerId, int32_t channel, std::shared_ptr<std::vector<std::string>> variables, std::shared_ptr<std::vector<PVariable>> values) { onEvent(peerId, channel, variables, values); }
 	};
 	//End event handling
 
@@ -92,6 +107,12 @@ public:
 	virtual uint64_t getId() { return _deviceId; }
     virtual std::string getSerialNumber() { return _serialNumber; }
 	virtual std::string handleCliCommand(std::string command) { return ""; }
+
+	/**
+	 * Returns the registry to subscribe to events of this central's peers. Matching subscriptions are called for every
+	 * event and RPC event after the event handler.
+	 */
+	EventSubscriptions& getEventSubscriptions() { return _eventSubscriptions; }
 	std::vector<std::shared_ptr<Peer>> getPeers();
 	std::shared_ptr<Peer> getPeer(int32_t address);
     std::shared_ptr<Peer> getPeer(uint64_t id);
@@ -147,6 +168,29 @@ public:
 	virtual PVariable listDevices(PRpcClientInfo clientInfo, bool channels, std::map<std::string, bool> fields);
 	virtual PVariable listDevices(PRpcClientInfo clientInfo, bool channels, std::map<std::string, bool> fields, std::shared_ptr<std::set<uint64_t>> knownDevices);
 	virtual PVariable listTeams(BaseLib::PRpcClientInfo clientInfo);
+
+	/**
+	 * Called by streamDevices() and streamTeams() with the descriptions of one device. The descriptions are a copy of the
+	 * peer's description cache, so they can be modified.
+	 *
+	 * @return Return false to stop.
+	 */
+	typedef std::function<bool(const std::shared_ptr<std::vector<PVariable>>& descriptions)> DescriptionCallback;
+
+	/**
+	 * Like listDevices(), but passes the descriptions to the callback device by device, so they can be encoded and sent
+	 * before all descriptions are created.
+	 *
+	 * @return Returns an empty Variable on success or an error struct.
+	 */
+	virtual PVariable streamDevices(PRpcClientInfo clientInfo, bool channels, std::map<std::string, bool> fields, std::shared_ptr<std::set<uint64_t>> knownDevices, DescriptionCallback callback);
+
+	/**
+	 * Like listTeams(), but passes the descriptions to the callback device by device.
+	 *
+	 * @return Returns an empty Variable on success or an error struct.
+	 */
+	virtual PVariable streamTeams(PRpcClientInfo clientInfo, DescriptionCallback callback);
 	virtual PVariable putParamset(PRpcClientInfo clientInfo, std::string serialNumber, int32_t channel, ParameterGroup::Type::Enum type, std::string remoteSerialNumber, int32_t remoteChannel, PVariable paramset) { return Variable::createError(-32601, "Method not implemented for this central."); }
 	virtual PVariable putParamset(PRpcClientInfo clientInfo, uint64_t peerId, int32_t channel, ParameterGroup::Type::Enum type, uint64_t remoteId, int32_t remoteChannel, PVariable paramset) { return Variable::createError(-32601, "Method not implemented for this central."); }
 	virtual PVariable reportValueUsage(PRpcClientInfo clientInfo, std::string serialNumber);
@@ -188,11 +232,23 @@ protected:
     std::atomic_bool _initialized;
     std::atomic_bool _disposing;
 
+    /**
+     * Maximum time in microseconds streamDevices() and streamTeams() run before giving up the CPU for one millisecond.
+     */
+    static const int64_t _descriptionYieldBudget = 20000;
+
+    /**
+     * Sleeps for one millisecond when more than _descriptionYieldBudget microseconds passed since budgetStart and resets
+     * budgetStart.
+     */
+    void yieldIfBudgetExhausted(int64_t& budgetStart);
+
 	std::shared_ptr<Peer> _currentPeer;
     std::unordered_map<int32_t, std::shared_ptr<Peer>> _peers;
     std::unordered_map<std::string, std::shared_ptr<Peer>> _peersBySerial;
     std::map<uint64_t, std::shared_ptr<Peer>> _peersById;
     std::mutex _peersMutex;
+    EventSubscriptions _eventSubscriptions;
 
 	//Event handling
     std::map<std::string, PEventHandler> _physicalInterfaceEventhandlers;
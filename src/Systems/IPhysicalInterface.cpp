@@ -50,9 +50,6 @@ IPhysicalInterface::IPhysicalInterface(BaseLib::SharedObjects* baseLib, int32_t
 	_stopPacketProcessingThread = false;
 	_stopCallbackThread = false;
 	_stopped = false;
-
-	_lifetick1.first = 0;
-	_lifetick1.second = true;
 }
 
 IPhysicalInterface::IPhysicalInterface(BaseLib::SharedObjects* baseLib, int32_t familyId, std::shared_ptr<PhysicalInterfaceSettings> settings) : IPhysicalInterface(baseLib, familyId)
@@ -61,11 +58,16 @@ IPhysicalInterface::IPhysicalInterface(BaseLib::SharedObjects* baseLib, int32_t
 }
 
 IPhysicalInterface::~IPhysicalInterface()
+{
+	stopPacketProcessingThread();
+}
+
+void IPhysicalInterface::stopPacketProcessingThread()
 {
 	_stopPacketProcessingThread = true;
-	_packetProcessingPacketAvailable = true;
-	std::unique_lock<std::mutex> lock(_packetProcessingThreadMutex);
-	lock.unlock();
+	{
+		std::lock_guard<std::mutex> processingGuard(_packetProcessingThreadMutex);
+	}
 	_packetProcessingConditionVariable.notify_one();
 	_bl->threadManager.join(_packetProcessingThread);
 }
@@ -74,14 +76,12 @@ bool IPhysicalInterface::lifetick()
 {
 	try
 	{
-		_lifetick1Mutex.lock();
-		if(!_lifetick1.second && BaseLib::HelperFunctions::getTime() - _lifetick1.first > 60000)
+		int64_t lifetick = _lifetick1;
+		if(lifetick != 0 && BaseLib::HelperFunctions::getTime() - lifetick > 60000)
 		{
 			_bl->out.printCritical("Critical: Physical interface's (" + _settings->id + ") lifetick was not updated for more than 60 seconds.");
-			_lifetick1Mutex.unlock();
 			return false;
 		}
-		_lifetick1Mutex.unlock();
 		return true;
 	}
 	catch(const std::exception& ex)
@@ -96,7 +96,6 @@ bool IPhysicalInterface::lifetick()
     {
     	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
     }
-    _lifetick1Mutex.unlock();
     return false;
 }
 
@@ -104,17 +103,18 @@ void IPhysicalInterface::startListening()
 {
 	try
 	{
-		_stopPacketProcessingThread = true;
-		_packetProcessingPacketAvailable = true;
-		std::unique_lock<std::mutex> lock(_packetProcessingThreadMutex);
-		lock.unlock();
-		_packetProcessingConditionVariable.notify_one();
-		_bl->threadManager.join(_packetProcessingThread);
+		stopPacketProcessingThread();
 		_stopPacketProcessingThread = false;
-		_packetProcessingPacketAvailable = false;
-		_packetBufferHead = 0;
-		_packetBufferTail = 0;
-		_bl->threadManager.start(_packetProcessingThread, true, 45, SCHED_FIFO, &IPhysicalInterface::processPackets, this);
+		{
+			std::lock_guard<std::mutex> producerGuard(_packetBufferProducerMutex);
+			for(int32_t i = 0; i < _packetBufferSize; i++)
+			{
+				_packetBuffer[i].reset();
+			}
+			_packetBufferHead = 0;
+			_packetBufferTail = 0;
+		}
+		_bl->threadManager.start(_settings->id, ThreadManager::ThreadCategory::packet, _packetProcessingThread, true, 45, SCHED_FIFO, &IPhysicalInterface::processPackets, this);
 	}
     catch(const std::exception& ex)
     {
@@ -134,12 +134,7 @@ void IPhysicalInterface::stopListening()
 {
 	try
 	{
-		_stopPacketProcessingThread = true;
-		_packetProcessingPacketAvailable = true;
-		std::unique_lock<std::mutex> lock(_packetProcessingThreadMutex);
-		lock.unlock();
-		_packetProcessingConditionVariable.notify_one();
-		_bl->threadManager.join(_packetProcessingThread);
+		stopPacketProcessingThread();
 	}
     catch(const std::exception& ex)
     {
@@ -169,57 +164,55 @@ void IPhysicalInterface::processPackets()
 {
 	while(!_stopPacketProcessingThread)
 	{
-		std::unique_lock<std::mutex> lock(_packetProcessingThreadMutex);
 		try
 		{
-			if(_packetBufferHead == _packetBufferTail)
+			int32_t tail = _packetBufferTail.load(std::memory_order_relaxed);
+			if(tail == _packetBufferHead.load(std::memory_order_acquire))
 			{
-				_packetProcessingConditionVariable.wait(lock, [&]{ return _packetProcessingPacketAvailable; });
+				std::unique_lock<std::mutex> lock(_packetProcessingThreadMutex);
+				_packetProcessingThreadWaiting = true;
+				//The check after setting _packetProcessingThreadWaiting makes sure, we either see the new packet or raisePacketReceived sees that we are waiting.
+				_packetProcessingConditionVariable.wait(lock, [&]{ return tail != _packetBufferHead || _stopPacketProcessingThread; });
+				_packetProcessingThreadWaiting = false;
+				continue;
 			}
-			if(_stopPacketProcessingThread) return;
-
-			//We need to copy all elements. In packetReceived so much can happen, that _homeMaticDevicesMutex might deadlock
-			EventHandlers eventHandlers = getEventHandlers();
-
-			while(_packetBufferHead != _packetBufferTail)
-			{
-				_lifetick1Mutex.lock();
-				_lifetick1.second = false;
-				_lifetick1.first = BaseLib::HelperFunctions::getTime();
-				_lifetick1Mutex.unlock();
-
-				int64_t processingTime = HelperFunctions::getTime();
-				_lastPacketReceived = processingTime;
 
-				std::shared_ptr<Packet> packet = _packetBuffer[_packetBufferTail];
-				_packetBuffer[_packetBufferTail].reset();
-				_packetBufferTail++;
-				if(_packetBufferTail >= _packetBufferSize) _packetBufferTail = 0;
-				if(_packetBufferHead == _packetBufferTail) _packetProcessingPacketAvailable = false; //Set here, because otherwise it might be set to "true" in raisePacketReceived and then set to false again after the while loop
+			int64_t processingTime = HelperFunctions::getTime();
+			_lifetick1.store(processingTime, std::memory_order_relaxed);
+			_lastPacketReceived = processingTime;
 
-				lock.unlock();
+			std::shared_ptr<Packet> packet = std::move(_packetBuffer[tail]);
+			_packetBuffer[tail].reset();
+			int64_t queueTime = _packetBufferTimes[tail];
+			_packetBufferTail.store(tail + 1 >= _packetBufferSize ? 0 : tail + 1, std::memory_order_release);
 
-				if(packet)
+			int64_t handlerStartTime = HelperFunctions::getTimeMicroseconds();
+			_queueWaitHistogram.record(handlerStartTime - queueTime);
+			if(packet)
+			{
+				//The list is immutable, so no lock is held while the handlers are called. In packetReceived so much can happen,
+				//that _homeMaticDevicesMutex might deadlock otherwise.
+				PEventHandlerList eventHandlers = getEventHandlerList();
+				for(EventHandlerList::const_iterator i = eventHandlers->begin(); i != eventHandlers->end(); ++i)
 				{
-					for(EventHandlers::iterator i = eventHandlers.begin(); i != eventHandlers.end(); ++i)
-					{
-						i->second->lock();
-						if(_bl->debugLevel >= 5) _bl->out.printDebug("Debug (" + _settings->id + "): Packet " + packet->hexString() + " is now passed to the EventHandler.");
-						if(i->second->handler()) ((IPhysicalInterfaceEventSink*)i->second->handler())->onPacketReceived(_settings->id, packet);
-						i->second->unlock();
-					}
+					(*i)->lock();
+					if(_bl->debugLevel >= 5) _bl->out.printDebug("Debug (" + _settings->id + "): Packet " + packet->hexString() + " is now passed to the EventHandler.");
+					IEventSinkBase* handler = (*i)->handler();
+					if(handler) ((IPhysicalInterfaceEventSink*)handler)->onPacketReceived(_settings->id, packet);
+					(*i)->unlock();
 				}
-				else _bl->out.printWarning("Warning (" + _settings->id + "): Packet was nullptr.");
-				processingTime = HelperFunctions::getTime() - processingTime;
-				if(_bl->settings.devLog() || _bl->debugLevel >= 5) _bl->out.printDebug("Debug (" + _settings->id + "): Packet processing of packet " + packet->hexString() + " took " + std::to_string(processingTime) + " ms.");
-				if(processingTime > _maxPacketProcessingTime) _bl->out.printInfo("Info (" + _settings->id + "): Packet processing took longer than 1 second (" + std::to_string(processingTime) + " ms).");
+			}
+			else _bl->out.printWarning("Warning (" + _settings->id + "): Packet was nullptr.");
+			int64_t handlerEndTime = HelperFunctions::getTimeMicroseconds();
+			_handlerTimeHistogram.record(handlerEndTime - handlerStartTime);
+			int64_t receiveTime = packet && packet->timeReceived() > 0 ? packet->timeReceived() * 1000 : queueTime;
+			_endToEndHistogram.record(handlerEndTime - (receiveTime < queueTime ? receiveTime : queueTime));
 
-				_lifetick1Mutex.lock();
-				_lifetick1.second = true;
-				_lifetick1Mutex.unlock();
+			processingTime = HelperFunctions::getTime() - processingTime;
+			if(packet && (_bl->settings.devLog() || _bl->debugLevel >= 5)) _bl->out.printDebug("Debug (" + _settings->id + "): Packet processing of packet " + packet->hexString() + " took " + std::to_string(processingTime) + " ms.");
+			if(processingTime > _maxPacketProcessingTime) _bl->out.printInfo("Info (" + _settings->id + "): Packet processing took longer than 1 second (" + std::to_string(processingTime) + " ms).");
 
-				lock.lock();
-			}
+			_lifetick1.store(0, std::memory_order_relaxed);
 		}
 		catch(const std::exception& ex)
 		{
@@ -241,25 +234,32 @@ void IPhysicalInterface::raisePacketReceived(std::shared_ptr<Packet> packet)
 	try
 	{
 		if(_bl->debugLevel >= 5) _bl->out.printDebug("Debug (" + _settings->id + "): Packet " + packet->hexString() + " enters raisePacketReceived.");
-		std::unique_lock<std::mutex> lock(_packetProcessingThreadMutex);
-		int32_t tempHead = _packetBufferHead + 1;
-		if(tempHead >= _packetBufferSize) tempHead = 0;
-		if(tempHead == _packetBufferTail)
+		_packetsReceived.fetch_add(1, std::memory_order_relaxed);
 		{
-			_bl->out.printError("Error (" + _settings->id + "): More than " + std::to_string(_packetBufferSize) + " packets are queued to be processed. Your packet processing is too slow. Dropping packet.");
-			return;
+			std::lock_guard<std::mutex> producerGuard(_packetBufferProducerMutex);
+			int32_t head = _packetBufferHead.load(std::memory_order_relaxed);
+			int32_t nextHead = head + 1;
+			if(nextHead >= _packetBufferSize) nextHead = 0;
+			if(nextHead == _packetBufferTail.load(std::memory_order_acquire))
+			{
+				_packetsDropped.fetch_add(1, std::memory_order_relaxed);
+				_bl->out.printError("Error (" + _settings->id + "): More than " + std::to_string(_packetBufferSize) + " packets are queued to be processed. Your packet processing is too slow. Dropping packet.");
+				return;
+			}
+
+			_packetBuffer[head] = packet;
+			_packetBufferTimes[head] = HelperFunctions::getTimeMicroseconds();
+			_packetBufferHead.store(nextHead); //Sequentially consistent, see processPackets()
 		}
 
-		_packetBuffer[_packetBufferHead] = packet;
-		_packetBufferHead++;
-		if(_packetBufferHead >= _packetBufferSize)
+		if(_packetProcessingThreadWaiting)
 		{
-			_packetBufferHead = 0;
+			//Locking makes sure the processing thread is either waiting or hasn't checked the ring yet.
+			{
+				std::lock_guard<std::mutex> processingGuard(_packetProcessingThreadMutex);
+			}
+			_packetProcessingConditionVariable.notify_one();
 		}
-		_packetProcessingPacketAvailable = true;
-
-		lock.unlock();
-		_packetProcessingConditionVariable.notify_one();
 	}
     catch(const std::exception& ex)
     {
@@ -275,6 +275,26 @@ void IPhysicalInterface::raisePacketReceived(std::shared_ptr<Packet> packet)
     }
 }
 
+IPhysicalInterface::PacketStatistics IPhysicalInterface::getPacketStatistics()
+{
+	PacketStatistics statistics;
+	statistics.received = _packetsReceived.load(std::memory_order_relaxed);
+	statistics.dropped = _packetsDropped.load(std::memory_order_relaxed);
+	statistics.queueWait = _queueWaitHistogram.getStatistics();
+	statistics.handlerTime = _handlerTimeHistogram.getStatistics();
+	statistics.endToEnd = _endToEndHistogram.getStatistics();
+	return statistics;
+}
+
+void IPhysicalInterface::resetPacketStatistics()
+{
+	_packetsReceived.store(0, std::memory_order_relaxed);
+	_packetsDropped.store(0, std::memory_order_relaxed);
+	_queueWaitHistogram.reset();
+	_handlerTimeHistogram.reset();
+	_endToEndHistogram.reset();
+}
+
 void IPhysicalInterface::setDevicePermission(int32_t userID, int32_t groupID)
 {
 	try
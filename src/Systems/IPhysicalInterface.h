@@ -32,6 +32,7 @@
 #define IPHYSICALINTERFACE_H_
 
 #include "../IEvents.h"
+#include "../LatencyHistogram.h"
 #include "PhysicalInterfaceSettings.h"
 #include "../Managers/FileDescriptorManager.h"
 
@@ -84,6 +85,39 @@ public:
 	};
 	//End event handling
 
+	/**
+	 * Packet statistics of an interface. All times are in microseconds.
+	 */
+	struct PacketStatistics
+	{
+		/**
+		 * The number of packets passed to raisePacketReceived().
+		 */
+		uint64_t received = 0;
+
+		/**
+		 * The number of packets dropped because the processing queue was full.
+		 */
+		uint64_t dropped = 0;
+
+		/**
+		 * The time packets waited in the queue until processPackets() took them.
+		 */
+		LatencyHistogram::Statistics queueWait;
+
+		/**
+		 * The time all event handlers needed to process a packet.
+		 */
+		LatencyHistogram::Statistics handlerTime;
+
+		/**
+		 * The time from receiving a packet until all event handlers processed it. When the interface set the packet's
+		 * receive time, it is used as start time (with millisecond resolution), otherwise the time the packet was passed to
+		 * raisePacketReceived().
+		 */
+		LatencyHistogram::Statistics endToEnd;
+	};
+
 	IPhysicalInterface(BaseLib::SharedObjects* baseLib, int32_t familyId);
 	IPhysicalInterface(BaseLib::SharedObjects* baseLib, int32_t familyId, std::shared_ptr<PhysicalInterfaceSettings> settings);
 
@@ -107,6 +141,17 @@ public:
 	virtual int32_t getAddress() { return _myAddress; }
 	virtual std::string getIpAddress() { return _ipAddress; }
 	virtual std::string getHostname() { return _hostname; }
+
+	/**
+	 * Returns the packet counters and latency statistics. Statistics are always collected, no debug output needs to be
+	 * enabled.
+	 */
+	PacketStatistics getPacketStatistics();
+
+	/**
+	 * Sets all packet counters and latency statistics to 0.
+	 */
+	void resetPacketStatistics();
 protected:
 	BaseLib::SharedObjects* _bl = nullptr;
 	int32_t _familyId = -1;
@@ -114,13 +159,34 @@ protected:
 	std::thread _listenThread;
 	std::thread _callbackThread;
 	std::atomic_bool _stopCallbackThread;
+
+	// {{{ Single producer, single consumer ring between raisePacketReceived() and processPackets()
 	static const int32_t _packetBufferSize = 1000;
-	int32_t _packetBufferHead = 0;
-	int32_t _packetBufferTail = 0;
+	/**
+	 * Written by raisePacketReceived() only.
+	 */
+	std::atomic<int32_t> _packetBufferHead{0};
+	/**
+	 * Written by processPackets() only.
+	 */
+	std::atomic<int32_t> _packetBufferTail{0};
 	std::shared_ptr<Packet> _packetBuffer[_packetBufferSize];
+	/**
+	 * The time in microseconds each packet in _packetBuffer was queued.
+	 */
+	int64_t _packetBufferTimes[_packetBufferSize];
+	/**
+	 * Serializes derived classes calling raisePacketReceived() from more than one thread. Never locked by processPackets().
+	 */
+	std::mutex _packetBufferProducerMutex;
+	// }}}
+
+	/**
+	 * Only used to put processPackets() to sleep when the ring is empty.
+	 */
 	std::mutex _packetProcessingThreadMutex;
 	std::thread _packetProcessingThread;
-	bool _packetProcessingPacketAvailable = false;
+	std::atomic_bool _packetProcessingThreadWaiting{false};
 	std::condition_variable _packetProcessingConditionVariable;
 	std::atomic_bool _stopPacketProcessingThread;
 	std::string _lockfile;
@@ -132,8 +198,19 @@ protected:
 	int64_t _lastPacketReceived = -1;
 	int64_t _maxPacketProcessingTime = 1000;
 	bool _updateMode = false;
-	std::mutex _lifetick1Mutex;
-	std::pair<int64_t, bool> _lifetick1;
+
+	/**
+	 * The time processing of the current packet started or 0 when no packet is being processed.
+	 */
+	std::atomic<int64_t> _lifetick1{0};
+
+	// {{{ Packet statistics
+	std::atomic<uint64_t> _packetsReceived{0};
+	std::atomic<uint64_t> _packetsDropped{0};
+	LatencyHistogram _queueWaitHistogram;
+	LatencyHistogram _handlerTimeHistogram;
+	LatencyHistogram _endToEndHistogram;
+	// }}}
 
 	int32_t _myAddress = 0;
 	std::string _hostname;
@@ -143,6 +220,11 @@ protected:
 	virtual void raisePacketReceived(std::shared_ptr<Packet> packet);
 	//End event handling
 	void processPackets();
+
+	/**
+	 * Wakes up processPackets() and waits for it to finish.
+	 */
+	void stopPacketProcessingThread();
 	virtual void setDevicePermission(int32_t userID, int32_t groupID);
 	virtual void openGPIO(uint32_t index, bool readOnly);
 	virtual void getGPIOPath(uint32_t index);
@@ -231,12 +231,15 @@ Peer::Peer(BaseLib::SharedObjects* baseLib, int32_t id, int32_t address, std::st
 
 Peer::~Peer()
 {
+	//Values held back are dropped, because the event handler might be gone already.
+	dropEventCoalescer();
 	serviceMessages->resetEventHandler();
 }
 
 void Peer::dispose()
 {
 	_disposing = true;
+	stopEventCoalescer();
 	_central.reset();
 	_peersMutex.lock();
 	_peers.clear();
@@ -250,9 +253,74 @@ void Peer::homegearStarted()
 
 void Peer::homegearShuttingDown()
 {
+	stopEventCoalescer();
 	raiseEvent(_peerID, -1, std::shared_ptr<std::vector<std::string>>(new std::vector<std::string>{"DISPOSING"}), PArray(new Array{PVariable(new Variable(true))}));
 }
 
+// {{{ Event coalescing
+void Peer::setEventCoalescing(int32_t channel, const std::string& variable, uint32_t window, double deadband)
+{
+	try
+	{
+		std::lock_guard<std::mutex> eventCoalescerGuard(_eventCoalescerMutex);
+		if(!_eventCoalescer)
+		{
+			std::shared_ptr<EventCoalescer> eventCoalescer = std::make_shared<EventCoalescer>(_bl, [this](bool rpcEvent, int32_t channel, const std::string& deviceAddress, std::shared_ptr<std::vector<std::string>> variables, std::shared_ptr<std::vector<PVariable>> values)
+			{
+				if(_peerID == 0 || !_eventHandler) return;
+				if(rpcEvent) ((IPeerEventSink*)_eventHandler)->onRPCEvent(_peerID, channel, deviceAddress, variables, values);
+				else ((IPeerEventSink*)_eventHandler)->onEvent(_peerID, channel, variables, values);
+			});
+			std::atomic_store(&_eventCoalescer, eventCoalescer);
+		}
+		EventCoalescer::Policy policy;
+		policy.window = window;
+		policy.deadband = deadband;
+		_eventCoalescer->setPolicy(channel, variable, policy);
+	}
+	catch(const std::exception& ex)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(BaseLib::Exception& ex)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
+void Peer::removeEventCoalescing(int32_t channel, const std::string& variable)
+{
+	std::shared_ptr<EventCoalescer> eventCoalescer = std::atomic_load(&_eventCoalescer);
+	if(eventCoalescer) eventCoalescer->removePolicy(channel, variable);
+}
+
+void Peer::stopEventCoalescer()
+{
+	std::shared_ptr<EventCoalescer> eventCoalescer;
+	{
+		std::lock_guard<std::mutex> eventCoalescerGuard(_eventCoalescerMutex);
+		eventCoalescer = std::atomic_exchange(&_eventCoalescer, std::shared_ptr<EventCoalescer>());
+	}
+	//Passes on all values held back.
+	if(eventCoalescer) eventCoalescer->stop();
+}
+
+void Peer::dropEventCoalescer()
+{
+	std::shared_ptr<EventCoalescer> eventCoalescer;
+	{
+		std::lock_guard<std::mutex> eventCoalescerGuard(_eventCoalescerMutex);
+		eventCoalescer = std::atomic_exchange(&_eventCoalescer, std::shared_ptr<EventCoalescer>());
+	}
+	//Waits for a running flush, which calls the event handler of this peer.
+	if(eventCoalescer) eventCoalescer->drop();
+}
+// }}}
+
 //Event handling
 void Peer::raiseAddWebserverEventHandler(BaseLib::Rpc::IWebserverEventSink* eventHandler)
 {
@@ -267,6 +335,8 @@ void Peer::raiseRemoveWebserverEventHandler()
 void Peer::raiseRPCEvent(uint64_t peerId, int32_t channel, std::string deviceAddress, std::shared_ptr<std::vector<std::string>> valueKeys, std::shared_ptr<std::vector<PVariable>> values)
 {
 	if(_peerID == 0) return;
+	std::shared_ptr<EventCoalescer> eventCoalescer = std::atomic_load(&_eventCoalescer);
+	if(eventCoalescer && !eventCoalescer->filter(true, channel, deviceAddress, valueKeys, values)) return;
 	if(_eventHandler) ((IPeerEventSink*)_eventHandler)->onRPCEvent(peerId, channel, deviceAddress, valueKeys, values);
 }
 
@@ -278,6 +348,8 @@ void Peer::raiseRPCUpdateDevice(uint64_t id, int32_t channel, std::string addres
 void Peer::raiseEvent(uint64_t peerId, int32_t channel, std::shared_ptr<std::vector<std::string>> variables, std::shared_ptr<std::vector<PVariable>> values)
 {
 	if(_peerID == 0) return;
+	std::shared_ptr<EventCoalescer> eventCoalescer = std::atomic_load(&_eventCoalescer);
+	if(eventCoalescer && !eventCoalescer->filter(false, channel, "", variables, values)) return;
 	if(_eventHandler) ((IPeerEventSink*)_eventHandler)->onEvent(peerId, channel, variables, values);
 }
 
@@ -382,6 +454,7 @@ void Peer::setID(uint64_t id)
 	if(_peerID == 0)
 	{
 		_peerID = id;
+		invalidateDeviceDescriptionCache();
 		if(serviceMessages) serviceMessages->setPeerID(id);
 	}
 	else _bl->out.printError("Cannot reset peer ID");
@@ -391,6 +464,7 @@ void Peer::setSerialNumber(std::string serialNumber)
 {
 	if(serialNumber.length() > 20) return;
 	_serialNumber = serialNumber;
+	invalidateDeviceDescriptionCache();
 	if(serviceMessages) serviceMessages->setPeerSerial(serialNumber);
 	if(_peerID > 0) save(true, false, false);
 }
@@ -860,6 +934,7 @@ void Peer::saveParameter(uint32_t parameterID, std::vector<uint8_t>& value)
 			if(!isTeam() || _saveTeam) _bl->out.printError("Error: Peer " + std::to_string(_peerID) + ": Tried to save parameter without parameterID");
 			return;
 		}
+		if(_configParameterDatabaseIds.find(parameterID) != _configParameterDatabaseIds.end()) invalidateDeviceDescriptionCache();
 		Database::DataRow data;
 		data.push_back(std::shared_ptr<Database::DataColumn>(new Database::DataColumn(value)));
 		data.push_back(std::shared_ptr<Database::DataColumn>(new Database::DataColumn(parameterID)));
@@ -889,6 +964,7 @@ void Peer::saveParameter(uint32_t parameterID, uint32_t address, std::vector<uin
 			return;
 		}
 		if(_peerID == 0 || (isTeam() && !_saveTeam)) return;
+		invalidateDeviceDescriptionCache();
 		//Creates a new entry for parameter in database
 		Database::DataRow data;
 		data.push_back(std::shared_ptr<Database::DataColumn>(new Database::DataColumn(_peerID)));
@@ -924,6 +1000,7 @@ void Peer::saveParameter(uint32_t parameterID, ParameterGroup::Type::Enum parame
 			return;
 		}
 		if(_peerID == 0 || (isTeam() && !_saveTeam)) return;
+		if(parameterSetType == ParameterGroup::Type::Enum::config) invalidateDeviceDescriptionCache();
 		//Creates a new entry for parameter in database
 		Database::DataRow data;
 		data.push_back(std::shared_ptr<Database::DataColumn>(new Database::DataColumn(_peerID)));
@@ -1046,6 +1123,7 @@ void Peer::saveVariable(uint32_t index, int32_t intValue)
 	try
 	{
 		if(isTeam() && !_saveTeam) return;
+		if(isDescriptionVariable(index)) invalidateDeviceDescriptionCache();
 		bool idIsKnown = _variableDatabaseIDs.find(index) != _variableDatabaseIDs.end();
 		Database::DataRow data;
 		if(idIsKnown)
@@ -1084,6 +1162,7 @@ void Peer::saveVariable(uint32_t index, int64_t intValue)
 	try
 	{
 		if(isTeam() && !_saveTeam) return;
+		if(isDescriptionVariable(index)) invalidateDeviceDescriptionCache();
 		bool idIsKnown = _variableDatabaseIDs.find(index) != _variableDatabaseIDs.end();
 		Database::DataRow data;
 		if(idIsKnown)
@@ -1122,6 +1201,7 @@ void Peer::saveVariable(uint32_t index, std::string& stringValue)
 	try
 	{
 		if(isTeam() && !_saveTeam) return;
+		if(isDescriptionVariable(index)) invalidateDeviceDescriptionCache();
 		bool idIsKnown = _variableDatabaseIDs.find(index) != _variableDatabaseIDs.end();
 		Database::DataRow data;
 		if(idIsKnown)
@@ -1160,6 +1240,7 @@ void Peer::saveVariable(uint32_t index, std::vector<char>& binaryValue)
 	try
 	{
 		if(isTeam() && !_saveTeam) return;
+		if(isDescriptionVariable(index)) invalidateDeviceDescriptionCache();
 		bool idIsKnown = _variableDatabaseIDs.find(index) != _variableDatabaseIDs.end();
 		Database::DataRow data;
 		if(idIsKnown)
@@ -1198,6 +1279,7 @@ void Peer::saveVariable(uint32_t index, std::vector<uint8_t>& binaryValue)
 	try
 	{
 		if(isTeam() && !_saveTeam) return;
+		if(isDescriptionVariable(index)) invalidateDeviceDescriptionCache();
 		bool idIsKnown = _variableDatabaseIDs.find(index) != _variableDatabaseIDs.end();
 		Database::DataRow data;
 		if(idIsKnown)
@@ -1236,6 +1318,7 @@ void Peer::saveConfig()
 	try
 	{
 		if(_peerID == 0 || (isTeam() && !_saveTeam)) return;
+		invalidateDeviceDescriptionCache();
 		for(std::unordered_map<uint32_t, ConfigDataBlock>::iterator i = binaryConfig.begin(); i != binaryConfig.end(); ++i)
 		{
 			std::string emptyString;
@@ -1329,6 +1412,7 @@ void Peer::loadConfig()
 		{
 			uint32_t databaseId = row->second.at(0)->intValue;
 			ParameterGroup::Type::Enum parameterGroupType = (ParameterGroup::Type::Enum)row->second.at(2)->intValue;
+			if(parameterGroupType == ParameterGroup::Type::Enum::none || parameterGroupType == ParameterGroup::Type::Enum::config) _configParameterDatabaseIds.insert(databaseId);
 
 			if(parameterGroupType == ParameterGroup::Type::Enum::none)
 			{
@@ -2165,6 +2249,75 @@ PVariable Peer::getDeviceDescription(PRpcClientInfo clientInfo, int32_t channel,
     return Variable::createError(-32500, "Unknown application error.");
 }
 
+std::shared_ptr<std::vector<PVariable>> Peer::copyDeviceDescriptions(const std::shared_ptr<std::vector<PVariable>>& descriptions)
+{
+	std::shared_ptr<std::vector<PVariable>> copy = std::make_shared<std::vector<PVariable>>();
+	copy->reserve(descriptions->size());
+	for(auto& description : *descriptions)
+	{
+		if(!description) continue;
+		PVariable descriptionCopy = std::make_shared<Variable>();
+		*descriptionCopy = *description;
+		copy->push_back(descriptionCopy);
+	}
+	return copy;
+}
+
+std::shared_ptr<std::vector<PVariable>> Peer::getCachedDeviceDescriptions(PRpcClientInfo clientInfo, bool channels, std::map<std::string, bool>& fields)
+{
+	try
+	{
+		std::string key;
+		key.reserve(64);
+		key.push_back(channels ? '1' : '0');
+		if(clientInfo)
+		{
+			key.append(std::to_string((int32_t)clientInfo->clientType));
+			key.push_back(clientInfo->initNewFormat ? '1' : '0');
+		}
+		for(auto& field : fields)
+		{
+			key.push_back(',');
+			key.append(field.first);
+		}
+
+		uint32_t version = _deviceDescriptionCacheVersion;
+		int64_t time = HelperFunctions::getTime();
+		{
+			std::lock_guard<std::mutex> cacheGuard(_deviceDescriptionCacheMutex);
+			if(_deviceDescriptionCacheInfo.first != version || time - _deviceDescriptionCacheInfo.second > _deviceDescriptionCacheMaxAge || time < _deviceDescriptionCacheInfo.second)
+			{
+				_deviceDescriptionCache.clear();
+				_deviceDescriptionCacheInfo.first = version;
+				_deviceDescriptionCacheInfo.second = time;
+			}
+			auto cacheIterator = _deviceDescriptionCache.find(key);
+			if(cacheIterator != _deviceDescriptionCache.end()) return copyDeviceDescriptions(cacheIterator->second);
+		}
+
+		std::shared_ptr<std::vector<PVariable>> descriptions = getDeviceDescriptions(clientInfo, channels, fields);
+		if(!descriptions) return descriptions;
+
+		std::lock_guard<std::mutex> cacheGuard(_deviceDescriptionCacheMutex);
+		//Don't store descriptions created before a change. The caller might modify the returned descriptions, so store a copy.
+		if(_deviceDescriptionCacheInfo.first == version && _deviceDescriptionCacheVersion == version) _deviceDescriptionCache[key] = copyDeviceDescriptions(descriptions);
+		return descriptions;
+	}
+	catch(const std::exception& ex)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(BaseLib::Exception& ex)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return std::shared_ptr<std::vector<PVariable>>();
+}
+
 std::shared_ptr<std::vector<PVariable>> Peer::getDeviceDescriptions(PRpcClientInfo clientInfo, bool channels, std::map<std::string, bool> fields)
 {
 	try
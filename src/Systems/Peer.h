@@ -36,9 +36,11 @@
 #include "../Sockets/RpcClientInfo.h"
 #include "../ScriptEngine/ScriptInfo.h"
 #include "ServiceMessages.h"
+#include "EventCoalescer.h"
 
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <memory>
 
@@ -252,7 +254,7 @@ public:
 
 	bool deleting = false; //Needed, so the peer gets not saved in central's worker thread while being deleted
 
-	void setRpcDevice(std::shared_ptr<HomegearDevice> value) { _rpcDevice = value; initializeTypeString(); }
+	void setRpcDevice(std::shared_ptr<HomegearDevice> value) { _rpcDevice = value; initializeTypeString(); invalidateDeviceDescriptionCache(); }
 	std::shared_ptr<HomegearDevice> getRpcDevice() { return _rpcDevice; }
 
 	std::unordered_map<uint32_t, ConfigDataBlock> binaryConfig;
@@ -266,6 +268,25 @@ public:
 	virtual ~Peer();
 	virtual void dispose();
 
+	// {{{ Event coalescing
+	/**
+	 * Limits the event rate of a parameter. Within the window only the first value is passed on immediately, later values
+	 * replace each other and the latest one is passed on when the window ends. Optionally numeric values changing less than
+	 * the deadband are dropped. Applies to events and RPC events.
+	 *
+	 * @param channel The channel of the parameter.
+	 * @param variable The name of the parameter.
+	 * @param window The minimum time between two events in milliseconds.
+	 * @param deadband The minimum change of numeric values to raise an event. 0 disables the deadband.
+	 */
+	void setEventCoalescing(int32_t channel, const std::string& variable, uint32_t window, double deadband = 0);
+
+	/**
+	 * Removes the coalescing policy of a parameter. A value held back is passed on immediately.
+	 */
+	void removeEventCoalescing(int32_t channel, const std::string& variable);
+	// }}}
+
 	//Features
 	virtual bool wireless() = 0;
 	//End features
@@ -275,7 +296,7 @@ public:
 	virtual int32_t getAddress() { return _address; }
 	virtual uint64_t getID() { return _peerID; }
 	virtual void setID(uint64_t id);
-	virtual void setAddress(int32_t value) { _address = value; if(_peerID > 0) save(true, false, false); }
+	virtual void setAddress(int32_t value) { _address = value; invalidateDeviceDescriptionCache(); if(_peerID > 0) save(true, false, false); }
 	virtual std::string getSerialNumber() { return _serialNumber; }
 	virtual void setSerialNumber(std::string serialNumber);
 	//End
@@ -286,7 +307,7 @@ public:
 	virtual std::string getFirmwareVersionString() { return _firmwareVersionString; }
 	virtual void setFirmwareVersionString(std::string value) { _firmwareVersionString = value; saveVariable(1003, value); }
 	virtual uint32_t getDeviceType() { return _deviceType; }
-	virtual void setDeviceType(uint32_t value) { _deviceType = value; saveVariable(1002, (int32_t)_deviceType); initializeTypeString(); }
+	virtual void setDeviceType(uint32_t value) { _deviceType = value; saveVariable(1002, (int32_t)_deviceType); initializeTypeString(); invalidateDeviceDescriptionCache(); }
     virtual std::string getName() { return _name; }
 	virtual void setName(std::string value) { _name = value; saveVariable(1000, _name); }
 	virtual std::string getIp() { return _ip; }
@@ -366,6 +387,20 @@ public:
 	virtual PVariable getAllValues(PRpcClientInfo clientInfo, bool returnWriteOnly);
 	virtual PVariable getConfigParameter(PRpcClientInfo clientInfo, uint32_t channel, std::string name);
 	virtual std::shared_ptr<std::vector<PVariable>> getDeviceDescriptions(PRpcClientInfo clientInfo, bool channels, std::map<std::string, bool> fields);
+
+	/**
+	 * Returns the result of getDeviceDescriptions() from a cache. The cache is cleared by invalidateDeviceDescriptionCache(),
+	 * which is called whenever a configuration parameter or one of the peer variables 1000 to 1008 is saved, and after one
+	 * minute at the latest, as derived classes
+	 * might change fields like INTERFACE without saving anything. Returns a copy of the cached descriptions, so the caller
+	 * can modify them.
+	 */
+	std::shared_ptr<std::vector<PVariable>> getCachedDeviceDescriptions(PRpcClientInfo clientInfo, bool channels, std::map<std::string, bool>& fields);
+
+	/**
+	 * Needs to be called when anything returned by getDeviceDescriptions() changes.
+	 */
+	void invalidateDeviceDescriptionCache() { _deviceDescriptionCacheVersion++; }
     virtual PVariable getDeviceDescription(PRpcClientInfo clientInfo, int32_t channel, std::map<std::string, bool> fields);
     virtual PVariable getDeviceInfo(PRpcClientInfo clientInfo, std::map<std::string, bool> fields);
     virtual PVariable getLink(PRpcClientInfo clientInfo, int32_t channel, int32_t flags, bool avoidDuplicates);
@@ -438,6 +473,58 @@ protected:
 	bool _saveTeam = false;
 	uint32_t _lastPacketReceived = 0;
 
+	// {{{ Device description cache
+		static const int64_t _deviceDescriptionCacheMaxAge = 60000;
+		std::atomic<uint32_t> _deviceDescriptionCacheVersion{0};
+		std::mutex _deviceDescriptionCacheMutex;
+
+		/**
+		 * The cache version and the time the cache was created.
+		 */
+		std::pair<uint32_t, int64_t> _deviceDescriptionCacheInfo{0, 0};
+
+		/**
+		 * Descriptions by client type, format, channels and fields.
+		 */
+		std::unordered_map<std::string, std::shared_ptr<std::vector<PVariable>>> _deviceDescriptionCache;
+
+		/**
+		 * Database IDs of the configuration parameters loaded by loadConfig(). saveParameter() only gets the ID of existing
+		 * parameters, so this is needed to not clear the cache when values are saved.
+		 */
+		std::unordered_set<uint64_t> _configParameterDatabaseIds;
+
+		/**
+		 * Returns "true" for the peer variables used by getDeviceDescriptions() (name, firmware, device type, IP address, room,
+		 * categories, ...).
+		 */
+		static bool isDescriptionVariable(uint32_t index) { return index >= 1000 && index <= 1008; }
+
+		/**
+		 * Returns a deep copy of descriptions.
+		 */
+		static std::shared_ptr<std::vector<PVariable>> copyDeviceDescriptions(const std::shared_ptr<std::vector<PVariable>>& descriptions);
+	// }}}
+
+	// {{{ Event coalescing
+		std::mutex _eventCoalescerMutex;
+
+		/**
+		 * Created when the first policy is set. Read with std::atomic_load, so raising events doesn't need a lock.
+		 */
+		std::shared_ptr<EventCoalescer> _eventCoalescer;
+
+		/**
+		 * Passes on all values held back and removes the coalescer.
+		 */
+		void stopEventCoalescer();
+
+		/**
+		 * Drops all values held back and removes the coalescer.
+		 */
+		void dropEventCoalescer();
+	// }}}
+
 	// {{{ Event handling
 		//Hooks
 		std::map<int32_t, PEventHandler> _webserverEventHandlers;
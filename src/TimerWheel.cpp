@@ -0,0 +1,174 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "TimerWheel.h"
+
+namespace BaseLib
+{
+
+TimerWheel::TimerWheel(int64_t resolution, int64_t startTime)
+{
+	_resolution = resolution > 0 ? resolution : 1;
+	_currentTick = startTime / _resolution;
+	_slots.resize(_levels * _slotCount);
+}
+
+void TimerWheel::clear()
+{
+	_timers.clear();
+	for(auto& slot : _slots)
+	{
+		slot.clear();
+	}
+}
+
+void TimerWheel::add(int64_t id, int64_t expirationTime)
+{
+	auto timerIterator = _timers.find(id);
+	if(timerIterator != _timers.end()) _slots[timerIterator->second.slot].erase(timerIterator->second.position);
+	else timerIterator = _timers.emplace(id, Timer()).first;
+
+	//Round up, so timers never expire early
+	timerIterator->second.expirationTick = (expirationTime + _resolution - 1) / _resolution;
+	insert(id, timerIterator->second, _currentTick + 1);
+}
+
+bool TimerWheel::remove(int64_t id)
+{
+	auto timerIterator = _timers.find(id);
+	if(timerIterator == _timers.end()) return false;
+	_slots[timerIterator->second.slot].erase(timerIterator->second.position);
+	_timers.erase(timerIterator);
+	return true;
+}
+
+void TimerWheel::insert(int64_t id, Timer& timer, int64_t minimumTick)
+{
+	int64_t tick = timer.expirationTick < minimumTick ? minimumTick : timer.expirationTick;
+	int64_t delta = tick - _currentTick;
+
+	int32_t level = 0;
+	while(level < _levels - 1 && delta >= ((int64_t)1 << (_slotBits * (level + 1)))) level++;
+	//Timers beyond the range of the wheel are put into a slot of the highest level that is cascaded before they expire and are
+	//inserted again then.
+	int64_t maximumDelta = ((int64_t)1 << (_slotBits * _levels)) - ((int64_t)1 << (_slotBits * (_levels - 1)));
+	if(delta > maximumDelta) tick = _currentTick + maximumDelta;
+
+	timer.slot = level * _slotCount + ((tick >> (_slotBits * level)) & _slotMask);
+	auto& slot = _slots[timer.slot];
+	timer.position = slot.insert(slot.end(), id);
+}
+
+void TimerWheel::cascade(int32_t level, int64_t tick)
+{
+	std::list<int64_t> timers;
+	timers.swap(_slots[level * _slotCount + ((tick >> (_slotBits * level)) & _slotMask)]);
+	for(auto id : timers)
+	{
+		auto timerIterator = _timers.find(id);
+		if(timerIterator == _timers.end()) continue;
+		insert(id, timerIterator->second, _currentTick);
+	}
+}
+
+void TimerWheel::advance(int64_t time, std::vector<int64_t>& expired)
+{
+	int64_t targetTick = time / _resolution;
+	while(_currentTick < targetTick)
+	{
+		//Jump directly to the next tick with work to do instead of stepping through empty ticks. After a clock jump or a long
+		//wait this keeps the number of iterations proportional to the number of occupied slots.
+		int64_t nextTick = nextEventTick();
+		if(nextTick == -1 || nextTick > targetTick)
+		{
+			_currentTick = targetTick;
+			break;
+		}
+		_currentTick = nextTick;
+
+		//Move timers of higher levels down when the lower level wraps around, highest level first.
+		if((_currentTick & _slotMask) == 0)
+		{
+			int32_t level = 1;
+			while(level < _levels - 1 && ((_currentTick >> (_slotBits * level)) & _slotMask) == 0) level++;
+			for(; level > 0; level--)
+			{
+				cascade(level, _currentTick);
+			}
+		}
+
+		std::list<int64_t> timers;
+		timers.swap(_slots[_currentTick & _slotMask]);
+		for(auto id : timers)
+		{
+			auto timerIterator = _timers.find(id);
+			if(timerIterator == _timers.end()) continue;
+			if(timerIterator->second.expirationTick > _currentTick)
+			{
+				insert(id, timerIterator->second, _currentTick + 1);
+				continue;
+			}
+			_timers.erase(timerIterator);
+			expired.push_back(id);
+		}
+	}
+}
+
+int64_t TimerWheel::nextEventTick()
+{
+	if(_timers.empty()) return -1;
+	int64_t nextTick = -1;
+	for(int32_t level = 0; level < _levels; level++)
+	{
+		int32_t shift = _slotBits * level;
+		int64_t position = _currentTick >> shift;
+		//Timers on level 0 expire at their slot's tick, timers on higher levels are moved down when the lower levels wrap around.
+		for(int64_t i = 1; i <= _slotCount; i++)
+		{
+			int64_t tick = (position + i) << shift;
+			if(nextTick != -1 && tick >= nextTick) break;
+			if(!_slots[level * _slotCount + ((position + i) & _slotMask)].empty())
+			{
+				nextTick = tick;
+				break;
+			}
+		}
+	}
+	if(nextTick == -1) nextTick = _currentTick + 1;
+	return nextTick;
+}
+
+int64_t TimerWheel::nextEventTime()
+{
+	int64_t nextTick = nextEventTick();
+	return nextTick == -1 ? -1 : nextTick * _resolution;
+}
+
+}
@@ -0,0 +1,132 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef TIMERWHEEL_H_
+#define TIMERWHEEL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+namespace BaseLib
+{
+
+/**
+ * Hierarchical timer wheel with four levels of 64 slots each. Adding, rescheduling and removing a timer is O(1), expiring
+ * timers costs O(1) per timer. advance() skips empty ticks, so its cost doesn't depend on the time passed. Timers are
+ * identified by a caller defined ID.
+ *
+ * The class is not thread safe, callers need to serialize access.
+ *
+ * Example:
+ *
+ *     BaseLib::TimerWheel wheel(100, BaseLib::HelperFunctions::getTime());
+ *     wheel.add(clientId, BaseLib::HelperFunctions::getTime() + 30000);
+ *     ...
+ *     std::vector<int64_t> expired;
+ *     wheel.advance(BaseLib::HelperFunctions::getTime(), expired);
+ */
+class TimerWheel
+{
+public:
+	/**
+	 * @param resolution The length of one tick in the unit of the times passed to the other methods (e. g. milliseconds).
+	 * @param startTime The current time.
+	 */
+	TimerWheel(int64_t resolution, int64_t startTime);
+	virtual ~TimerWheel() {}
+
+	/**
+	 * Adds a timer. If a timer with the same ID exists, it is rescheduled. Timers that already expired expire with the next
+	 * tick.
+	 *
+	 * @param id The ID of the timer.
+	 * @param expirationTime The time the timer expires.
+	 */
+	void add(int64_t id, int64_t expirationTime);
+
+	/**
+	 * Removes a timer.
+	 *
+	 * @return Returns true when the timer existed.
+	 */
+	bool remove(int64_t id);
+
+	bool contains(int64_t id) { return _timers.find(id) != _timers.end(); }
+	size_t size() { return _timers.size(); }
+	bool empty() { return _timers.empty(); }
+	void clear();
+
+	/**
+	 * Advances the wheel to "time" and removes all timers that expired until then.
+	 *
+	 * @param time The current time.
+	 * @param[out] expired The IDs of the expired timers are appended to this vector.
+	 */
+	void advance(int64_t time, std::vector<int64_t>& expired);
+
+	/**
+	 * Returns the time advance() needs to be called next. This might be earlier than the next expiration, because timers
+	 * on higher levels need to be moved down first.
+	 *
+	 * @return Returns the time or -1 when there are no timers.
+	 */
+	int64_t nextEventTime();
+private:
+	static const int32_t _levels = 4;
+	static const int32_t _slotBits = 6;
+	static const int32_t _slotCount = 1 << _slotBits;
+	static const int64_t _slotMask = _slotCount - 1;
+
+	struct Timer
+	{
+		int64_t expirationTick = 0;
+		int32_t slot = 0;
+		std::list<int64_t>::iterator position;
+	};
+
+	int64_t _resolution = 1;
+	int64_t _currentTick = 0;
+	std::vector<std::list<int64_t>> _slots;
+	std::unordered_map<int64_t, Timer> _timers;
+
+	void insert(int64_t id, Timer& timer, int64_t minimumTick);
+	void cascade(int32_t level, int64_t tick);
+
+	/**
+	 * Returns the next tick with a non-empty slot on level 0 or a cascade of a non-empty slot, or -1 when there are no timers.
+	 */
+	int64_t nextEventTick();
+};
+
+}
+#endif